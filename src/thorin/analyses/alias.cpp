@@ -0,0 +1,155 @@
+#include "thorin/analyses/alias.h"
+
+#include <algorithm>
+
+#include "thorin/primop.h"
+#include "thorin/world.h"
+
+namespace thorin {
+
+bool is_allocation_function(const Def* callee) {
+    return callee->isa_nom<Continuation>() && callee->name() == "anydsl_alloc";
+}
+
+/// Is @p param the pointer returned by a call to an allocation function?
+static bool is_allocation_result(const Param* param) {
+    if (!param->type()->isa<PtrType>())
+        return false;
+    for (auto use : param->continuation()->uses()) {
+        auto app = use->isa<App>();
+        if (app && use.index() != 0 && is_allocation_function(app->callee()))
+            return true;
+    }
+    return false;
+}
+
+/// Casts between pointers to a definite array and an indefinite array of the same element type keep the layout intact.
+static bool is_layout_preserving(const ConvOp* conv) {
+    auto ptr_to   = conv->type()->isa<PtrType>();
+    auto ptr_from = conv->from()->type()->isa<PtrType>();
+    if (!ptr_to || !ptr_from)
+        return false;
+    if (ptr_to->pointee() == ptr_from->pointee())
+        return true;
+    auto array_to   = ptr_to->pointee()->isa<ArrayType>();
+    auto array_from = ptr_from->pointee()->isa<ArrayType>();
+    return array_to && array_from && array_to->elem_type() == array_from->elem_type();
+}
+
+AliasAnalysis::Location AliasAnalysis::location(const Def* ptr) const {
+    Location loc { ptr, {}, true };
+    while (true) {
+        if (auto lea = loc.base->isa<LEA>()) {
+            loc.path.push_back(lea->index());
+            loc.base = lea->ptr();
+        } else if (auto conv = loc.base->isa<ConvOp>(); conv && conv->from()->type()->isa<PtrType>()) {
+            loc.exact &= is_layout_preserving(conv);
+            loc.base = conv->from();
+        } else {
+            break;
+        }
+    }
+    std::reverse(loc.path.begin(), loc.path.end());
+    return loc;
+}
+
+bool AliasAnalysis::is_identified_object(const Def* base) {
+    if (base->isa<Slot>() || base->isa<Global>())
+        return true;
+    if (Def::is_out<1, Alloc>(base))
+        return true;
+    if (auto param = base->isa<Param>())
+        return is_allocation_result(param);
+    return false;
+}
+
+bool AliasAnalysis::escapes(const Def* base) {
+    if (auto global = base->isa<Global>(); global && !global->is_mutable())
+        return false; // nobody can write to it anyway
+
+    if (auto i = escapes_.find(base); i != escapes_.end())
+        return i->second;
+
+    // break cycles conservatively
+    escapes_[base] = true;
+
+    bool result = false;
+    for (auto use : base->uses()) {
+        auto def = use.def();
+        if (def->isa<Load>()) {
+            result = use.index() != 1;
+        } else if (def->isa<Store>()) {
+            result = use.index() != 1; // storing the pointer itself leaks it
+        } else if (def->isa<LEA>()) {
+            result = use.index() != 0 || escapes(def);
+        } else if (def->isa<ConvOp>() && def->type()->isa<PtrType>()) {
+            result = escapes(def);
+        } else {
+            result = true;
+        }
+
+        if (result)
+            break;
+    }
+
+    return escapes_[base] = result;
+}
+
+AliasResult AliasAnalysis::alias(const Def* ptr1, const Def* ptr2) {
+    if (ptr1 == ptr2)
+        return AliasResult::Must;
+
+    auto type1 = ptr1->type()->as<PtrType>(), type2 = ptr2->type()->as<PtrType>();
+    if (type1->is_vector() || type2->is_vector())
+        return AliasResult::May; // vectors of pointers
+    if (type1->addr_space() != type2->addr_space()
+            && type1->addr_space() != AddrSpace::Generic
+            && type2->addr_space() != AddrSpace::Generic)
+        return AliasResult::No;
+
+    auto loc1 = location(ptr1), loc2 = location(ptr2);
+    if (loc1.base != loc2.base) {
+        bool identified1 = is_identified_object(loc1.base), identified2 = is_identified_object(loc2.base);
+        if (identified1 && identified2)
+            return AliasResult::No;
+        if ((identified1 && !escapes(loc1.base)) || (identified2 && !escapes(loc2.base)))
+            return AliasResult::No;
+        return AliasResult::May;
+    }
+
+    if (!loc1.exact || !loc2.exact)
+        return AliasResult::May;
+
+    for (size_t i = 0, e = std::min(loc1.path.size(), loc2.path.size()); i != e; ++i) {
+        auto index1 = loc1.path[i], index2 = loc2.path[i];
+        if (index1 == index2)
+            continue;
+        if (index1->isa<PrimLit>() && index2->isa<PrimLit>() && primlit_value<u64>(index1) != primlit_value<u64>(index2))
+            return AliasResult::No;
+        return AliasResult::May;
+    }
+
+    // one path is a prefix of the other: the shorter one contains the longer one
+    return loc1.path.size() == loc2.path.size() ? AliasResult::Must : AliasResult::May;
+}
+
+const Def* AliasAnalysis::clobber(const Def* mem, const Def* ptr, size_t budget) {
+    for (; budget != 0; --budget) {
+        if (auto extract = mem->isa<Extract>(); extract && extract->agg()->isa<MemOp>())
+            mem = extract->agg();
+
+        if (auto store = mem->isa<Store>()) {
+            if (alias(store->ptr(), ptr) != AliasResult::No)
+                return store;
+            mem = store->mem();
+        } else if (mem->isa<Load>() || mem->isa<Enter>() || mem->isa<Alloc>()) {
+            // these do not write to memory that already exists
+            mem = mem->as<MemOp>()->mem();
+        } else {
+            return mem;
+        }
+    }
+    return mem;
+}
+
+}
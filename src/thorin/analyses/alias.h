@@ -0,0 +1,63 @@
+#ifndef THORIN_ANALYSES_ALIAS_H
+#define THORIN_ANALYSES_ALIAS_H
+
+#include <vector>
+
+#include "thorin/continuation.h"
+
+namespace thorin {
+
+enum class AliasResult { No, May, Must };
+
+/**
+ * A simple, flow-insensitive alias analysis for pointers into @p Slot%s, @p Alloc%s, @p Global%s and opaque pointers.
+ * Each pointer is decomposed into an access path: a @em base pointer and the @p LEA indices applied to it.
+ * Two paths do not alias if
+ *  - they point into different address spaces,
+ *  - their bases are different @em identified objects (@p Slot, @p Global, @p Alloc or result of an allocation function),
+ *  - one base is an identified object whose address never escapes, or
+ *  - they share a base and differ in a constant index.
+ *
+ * On top of that, @p clobber answers memory-dependence queries by walking up the explicit @c mem chain.
+ */
+class AliasAnalysis {
+public:
+    /// An access path @c base[path[0]][path[1]]...
+    struct Location {
+        const Def* base;
+        std::vector<const Def*> path;
+        bool exact; ///< @c false if a cast on the way changed the layout - the @p path is meaningless then
+    };
+
+    /// @name access paths
+    //@{
+    Location location(const Def* ptr) const;
+    /// Is @p base a pointer to a fresh object which is distinct from every other identified object?
+    static bool is_identified_object(const Def* base);
+    /// Does the address of the identified object @p base (or of a part of it) leave the loads and stores through it?
+    bool escapes(const Def* base);
+    //@}
+
+    /// @name queries
+    //@{
+    AliasResult alias(const Def* ptr1, const Def* ptr2);
+    bool no_alias(const Def* ptr1, const Def* ptr2) { return alias(ptr1, ptr2) == AliasResult::No; }
+    /**
+     * Which memory operation may have written the value that a load from @p ptr with effect @p mem observes?
+     * Walks up the @c mem chain at most @p budget steps and returns the first @p Store that may alias @p ptr.
+     * Otherwise, the @c mem object at which the walk had to stop (a @p Param, an @p Assembly, ...) is returned.
+     */
+    const Def* clobber(const Def* mem, const Def* ptr, size_t budget = 128);
+    const Def* clobber(const Load* load, size_t budget = 128) { return clobber(load->mem(), load->ptr(), budget); }
+    //@}
+
+private:
+    DefMap<bool> escapes_;
+};
+
+/// Is @p callee a runtime function that returns a fresh allocation via its return continuation?
+bool is_allocation_function(const Def* callee);
+
+}
+
+#endif
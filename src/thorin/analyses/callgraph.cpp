@@ -0,0 +1,188 @@
+#include "thorin/analyses/callgraph.h"
+
+#include <algorithm>
+#include <queue>
+
+namespace thorin {
+
+void CallGraph::resolve() {
+    if (dirty_defs_.empty()) return;
+
+    // one walk up the uses for all dirty defs - a def shared by many of them is only visited once
+    std::queue<const Def*> queue;
+    DefSet done;
+
+    auto enqueue = [&] (const Def* def) {
+        for (auto use : def->uses()) {
+            if (use->isa<Param>())
+                continue;
+            if (done.emplace(use).second)
+                queue.push(use);
+        }
+    };
+
+    for (auto def : dirty_defs_) {
+        done.insert(def);
+        enqueue(def);
+    }
+    dirty_defs_.clear();
+
+    while (!queue.empty()) {
+        auto def = pop(queue);
+        if (auto continuation = def->isa_nom<Continuation>())
+            invalidate(continuation);
+        else
+            enqueue(def);
+    }
+}
+
+void CallGraph::update(Continuation* continuation) {
+    auto& succs = succs_[continuation];
+    for (auto succ : succs)
+        preds_[succ].erase(continuation);
+    succs.clear();
+
+    std::queue<const Def*> queue;
+    DefSet done;
+
+    auto enqueue = [&] (const Def* def) {
+        if (done.emplace(def).second)
+            queue.push(def);
+    };
+
+    done.insert(continuation);
+    if (continuation->has_body())
+        enqueue(continuation->body());
+
+    while (!queue.empty()) {
+        auto def = pop(queue);
+        if (auto succ = def->isa_nom<Continuation>()) {
+            succs.push_back(succ);
+            continue;
+        }
+
+        for (auto op : def->ops()) {
+            if (op->has_dep(Dep::Cont))
+                enqueue(op);
+        }
+    }
+
+    for (auto succ : succs)
+        preds_[succ].emplace(continuation);
+}
+
+void CallGraph::flush() {
+    resolve();
+    for (auto continuation : dirty_)
+        update(continuation);
+    dirty_.clear();
+}
+
+Continuations CallGraph::preds(const Continuation* continuation) {
+    flush();
+    auto i = preds_.find(const_cast<Continuation*>(continuation));
+    return i != preds_.end() ? Continuations(i->second.begin(), i->second.end()) : Continuations();
+}
+
+Continuations CallGraph::succs(const Continuation* continuation) {
+    auto cont = const_cast<Continuation*>(continuation);
+    resolve();
+    if (dirty_.erase(cont))
+        update(cont);
+    auto i = succs_.find(cont);
+    return i != succs_.end() ? i->second : Continuations();
+}
+
+ContinuationSet CallGraph::reachable(Continuation* entry) {
+    ContinuationSet done;
+    std::queue<Continuation*> queue;
+    done.emplace(entry);
+    queue.push(entry);
+
+    while (!queue.empty()) {
+        for (auto succ : succs(pop(queue))) {
+            if (done.emplace(succ).second)
+                queue.push(succ);
+        }
+    }
+
+    return done;
+}
+
+bool CallGraph::reaches(Continuation* from, Continuation* to) { return reachable(from).contains(to); }
+
+std::vector<Continuations> CallGraph::sccs() {
+    flush();
+
+    // iterative version of Tarjan's algorithm - call chains may be far deeper than the native stack
+    struct Frame {
+        Continuation* continuation;
+        size_t next;
+    };
+    struct Info {
+        size_t index;
+        size_t lowlink;
+        bool on_stack;
+    };
+
+    std::vector<Continuations> result;
+    ContinuationMap<Info> info;
+    Continuations stack;
+    std::vector<Frame> frames;
+
+    // visit in gid order to keep the result deterministic
+    Continuations roots;
+    for (auto& [continuation, _] : succs_)
+        roots.push_back(continuation);
+    std::sort(roots.begin(), roots.end(), [] (Continuation* a, Continuation* b) { return a->gid() < b->gid(); });
+
+    auto push = [&] (Continuation* continuation) {
+        auto index = info.size();
+        info[continuation] = { index, index, true };
+        stack.push_back(continuation);
+        frames.push_back({ continuation, 0 });
+    };
+
+    for (auto root : roots) {
+        if (info.contains(root)) continue;
+        push(root);
+
+        while (!frames.empty()) {
+            auto& frame = frames.back();
+            auto& succs = succs_[frame.continuation];
+
+            if (frame.next != succs.size()) {
+                auto succ = succs[frame.next++];
+                if (auto i = info.find(succ); i == info.end())
+                    push(succ);
+                else if (i->second.on_stack)
+                    info[frame.continuation].lowlink = std::min(info[frame.continuation].lowlink, i->second.index);
+                continue;
+            }
+
+            auto continuation = frame.continuation;
+            frames.pop_back();
+            auto& cur = info[continuation];
+            if (!frames.empty()) {
+                auto& parent = info[frames.back().continuation];
+                parent.lowlink = std::min(parent.lowlink, cur.lowlink);
+            }
+
+            if (cur.lowlink == cur.index) {
+                Continuations scc;
+                Continuation* member;
+                do {
+                    member = stack.back();
+                    stack.pop_back();
+                    info[member].on_stack = false;
+                    scc.push_back(member);
+                } while (member != continuation);
+                result.emplace_back(std::move(scc));
+            }
+        }
+    }
+
+    return result;
+}
+
+}
@@ -0,0 +1,64 @@
+#ifndef THORIN_ANALYSES_CALLGRAPH_H
+#define THORIN_ANALYSES_CALLGRAPH_H
+
+#include <vector>
+
+#include "thorin/continuation.h"
+
+namespace thorin {
+
+/**
+ * World-wide index of the direct predecessors and successors of all @p Continuation%s.
+ * A successor of @c c is a @p Continuation reachable from @c c's body through @p App callees/args, @p Global%s, tuples, and other structural nodes
+ * without passing through another @p Continuation; @c c is then a predecessor of that successor.
+ *
+ * The @p World owns its @p CallGraph and keeps it up to date:
+ * whenever a @p Continuation gets a new body, or an op which depends on a @p Continuation is changed somewhere below a body (e.g. by @p Def::replace_uses),
+ * the affected @p Continuation%s are marked dirty.
+ * Changing an op below a body only records the changed def; the @p Continuation%s whose bodies contain it are looked up once for all such defs on the next query.
+ * Edges are recomputed lazily - @p succs only recomputes the queried @p Continuation, @p preds flushes all dirty ones.
+ * As all queries update this state, a @p CallGraph must not be used from several threads at once.
+ */
+class CallGraph {
+public:
+    CallGraph() = default;
+    CallGraph(const CallGraph&) = delete;
+    CallGraph(CallGraph&&) = default;
+    CallGraph& operator=(CallGraph&&) = default;
+
+    Continuations preds(const Continuation*);
+    Continuations succs(const Continuation*);
+
+    /// All @p Continuation%s reachable from @p entry, including @p entry itself.
+    ContinuationSet reachable(Continuation* entry);
+    bool reaches(Continuation* from, Continuation* to);
+
+    /**
+     * Strongly connected components of all @p Continuation%s of the @p World in reverse topological order,
+     * i.e. each component comes before all components that reach it - callees before their callers.
+     */
+    std::vector<Continuations> sccs();
+
+    /// @name incremental maintenance - called by @p Def::set_op and @p Def::unset_op
+    //@{
+    /// @p continuation's body has changed.
+    void invalidate(const Continuation* continuation) { dirty_.emplace(const_cast<Continuation*>(continuation)); }
+    /// An op of @p def which depends on a @p Continuation has changed - invalidates all @p Continuation%s whose bodies contain @p def.
+    void invalidate_users(const Def* def) { dirty_defs_.emplace(def); }
+    //@}
+
+private:
+    /// Marks the @p Continuation%s whose bodies contain one of the @p dirty_defs_ as dirty.
+    void resolve();
+    void update(Continuation*);
+    void flush();
+
+    ContinuationMap<Continuations> succs_;
+    ContinuationMap<ContinuationSet> preds_;
+    ContinuationSet dirty_;
+    DefSet dirty_defs_;
+};
+
+}
+
+#endif
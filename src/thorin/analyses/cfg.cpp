@@ -1,5 +1,6 @@
 #include "thorin/analyses/cfg.h"
 
+#include <algorithm>
 #include <fstream>
 #include <map>
 #include <memory>
@@ -25,6 +26,13 @@ void CFNode::link(const CFNode* other) const {
 
 Stream& CFNode::stream(Stream& s) const { return s << continuation(); }
 
+/// @p nodes by gid - the order a @p CFNodes set iterates in differs between hash table implementations.
+static std::vector<const CFNode*> sorted(const CFNodes& nodes) {
+    std::vector<const CFNode*> result(nodes.begin(), nodes.end());
+    std::sort(result.begin(), result.end(), GIDLt<const CFNode*>());
+    return result;
+}
+
 //------------------------------------------------------------------------------
 
 CFA::CFA(const Scope& scope)
@@ -134,7 +142,7 @@ void CFA::link_to_exit() {
         auto n = stack.top();
 
         bool todo = false;
-        for (auto succ : n->succs())
+        for (auto succ : sorted(n->succs()))
             todo |= push(succ);
 
         if (!todo) {
@@ -180,7 +188,7 @@ size_t CFG<forward>::post_order_visit(const CFNode* n, size_t i) {
     auto& n_index = forward ? n->f_index_ : n->b_index_;
     n_index = size_t(-2);
 
-    for (auto succ : succs(n)) {
+    for (auto succ : sorted(succs(n))) {
         if (index(succ) == size_t(-1))
             i = post_order_visit(succ, i);
     }
@@ -0,0 +1,203 @@
+#include "thorin/analyses/fingerprint.h"
+
+#include <algorithm>
+#include <queue>
+#include <vector>
+
+#include "thorin/primop.h"
+#include "thorin/world.h"
+#include "thorin/analyses/scope.h"
+#include "thorin/util/cast.h"
+
+namespace thorin {
+
+/// 64-bit variant of FNV-1a - see http://www.isthe.com/chongo/tech/comp/fnv/index.html#FNV-param .
+static u64 mix(u64 seed, u64 val) {
+    for (size_t i = 0; i != sizeof(val); ++i) {
+        seed ^= val & 0xff_u64;
+        seed *= 1099511628211_u64;
+        val >>= 8_u64;
+    }
+    return seed;
+}
+
+static u64 mix(u64 seed, const std::string& str) {
+    for (auto c : str) {
+        seed ^= u64(u8(c));
+        seed *= 1099511628211_u64;
+    }
+    return mix(seed, str.size());
+}
+
+static const u64 fnv_offset = 14695981039346656037_u64;
+
+/// Kinds of nodes the fingerprint needs to tell apart beyond their @p NodeTag.
+enum : u64 { Free = 1, Local, Back };
+
+class Fingerprinter {
+public:
+    u64 run(const Scope&);
+    u64 type(const Type*);
+
+    /// Free @p Continuation%s in the order they were first reached - across all @p Scope%s run so far.
+    const std::vector<Continuation*>& free() const { return free_; }
+
+private:
+    u64 def(const Def*);
+    u64 attributes(const Continuation*);
+
+    // per scope
+    const Scope* scope_ = nullptr;
+    ContinuationMap<u64> index_;
+    std::queue<Continuation*> queue_;
+    DefMap<u64> slots_;
+    DefMap<u64> defs_;
+
+    // shared by all scopes run, so that the same free continuation or global gets the same number everywhere
+    ContinuationMap<u64> free_index_;
+    std::vector<Continuation*> free_;
+    DefMap<u64> globals_;
+    TypeMap<u64> types_;
+    TypeSet active_;
+};
+
+u64 Fingerprinter::run(const Scope& scope) {
+    scope_ = &scope;
+    index_.clear();
+    slots_.clear();
+    defs_.clear();
+
+    auto entry = scope.entry();
+    auto seed = mix(fnv_offset, entry->name());
+    seed = mix(seed, def(entry));
+
+    while (!queue_.empty()) {
+        auto cont = queue_.front();
+        queue_.pop();
+        seed = mix(seed, index_[cont]);
+        seed = mix(seed, attributes(cont));
+        for (auto op : cont->ops())
+            seed = mix(seed, def(op));
+    }
+
+    return seed;
+}
+
+u64 Fingerprinter::attributes(const Continuation* cont) {
+    auto seed = mix(fnv_offset, type(cont->type()));
+    seed = mix(seed, u64(cont->intrinsic()));
+    seed = mix(seed, u64(cont->cc()));
+    return mix(seed, u64(cont->is_external()));
+}
+
+u64 Fingerprinter::type(const Type* type) {
+    if (auto hash = types_.lookup(type)) return *hash;
+
+    // nominal types may refer to themselves
+    if (active_.contains(type)) return mix(Back, type->tag());
+
+    auto seed = mix(fnv_offset, type->tag());
+    if (auto nominal = type->isa<NominalType>()) {
+        seed = mix(seed, nominal->name().str());
+        for (auto name : nominal->op_names())
+            seed = mix(seed, name.str());
+    } else if (auto ptr = type->isa<PtrType>()) {
+        seed = mix(seed, u64(ptr->addr_space()));
+        seed = mix(seed, u64(ptr->device()));
+    } else if (auto array = type->isa<DefiniteArrayType>()) {
+        seed = mix(seed, array->dim());
+    }
+    if (auto vector = type->isa<VectorType>())
+        seed = mix(seed, vector->length());
+
+    active_.insert(type);
+    for (auto op : type->ops())
+        seed = mix(seed, this->type(op));
+    active_.erase(type);
+
+    return types_[type] = seed;
+}
+
+u64 Fingerprinter::def(const Def* def) {
+    if (auto cont = def->isa_nom<Continuation>()) {
+        if (!scope_->contains(cont) && cont != scope_->entry()) {
+            // names are not unique - number free continuations by first occurrence like slots
+            auto [i, fresh] = free_index_.emplace(cont, free_index_.size());
+            if (fresh) free_.push_back(cont);
+            return mix(mix(mix(mix(fnv_offset, Free), i->second), cont->name()), attributes(cont));
+        }
+        if (auto i = index_.lookup(cont)) return mix(Local, *i);
+        auto i = index_.size();
+        index_[cont] = i;
+        queue_.push(cont);
+        return mix(Local, i);
+    }
+
+    if (auto hash = defs_.lookup(def)) return *hash;
+
+    auto seed = mix(fnv_offset, def->tag());
+    seed = mix(seed, type(def->type()));
+
+    if (auto param = def->isa<Param>()) {
+        seed = mix(seed, param->index());
+    } else if (auto lit = def->isa<PrimLit>()) {
+        seed = mix(seed, bitcast<u64, Box>(lit->value()));
+    } else if (auto variant = def->isa<Variant>()) {
+        seed = mix(seed, variant->index());
+    } else if (auto extract = def->isa<VariantExtract>()) {
+        seed = mix(seed, extract->index());
+    } else if (def->isa<Slot>()) {
+        // slots are distinct by identity
+        auto [i, _] = slots_.emplace(def, slots_.size());
+        seed = mix(seed, i->second);
+    } else if (auto global = def->isa<Global>()) {
+        // globals with the same init are still distinct by identity
+        auto [i, _] = globals_.emplace(def, globals_.size());
+        seed = mix(seed, i->second);
+        seed = mix(seed, u64(global->is_mutable()));
+    } else if (auto assembly = def->isa<Assembly>()) {
+        seed = mix(seed, assembly->asm_template());
+        for (auto& str : assembly->output_constraints()) seed = mix(seed, str);
+        for (auto& str : assembly->input_constraints())  seed = mix(seed, str);
+        for (auto& str : assembly->clobbers())           seed = mix(seed, str);
+        seed = mix(seed, u64(assembly->flags()));
+    }
+
+    for (auto op : def->ops())
+        seed = mix(seed, this->def(op));
+
+    return defs_[def] = seed;
+}
+
+u64 fingerprint_mix(u64 seed, u64 val) { return mix(seed, val); }
+u64 fingerprint_mix(u64 seed, const std::string& str) { return mix(seed, str); }
+
+u64 fingerprint(const Scope& scope) { return Fingerprinter().run(scope); }
+u64 fingerprint(const Type* type) { return Fingerprinter().type(type); }
+
+u64 fingerprint(const World& world) {
+    // external names are unique and fix the order to start from - everything else is numbered in the order it is reached
+    std::vector<Continuation*> externals;
+    for (auto&& [_, cont] : world.externals()) {
+        if (cont->has_body()) externals.push_back(cont);
+    }
+    std::sort(externals.begin(), externals.end(), [] (Continuation* a, Continuation* b) { return a->name() < b->name(); });
+
+    Fingerprinter fingerprinter;
+    ContinuationSet done;
+    auto seed = fnv_offset;
+    auto visit = [&] (Continuation* cont) {
+        if (!cont->has_body() || !done.emplace(cont).second) return;
+        seed = mix(seed, fingerprinter.run(Scope(cont)));
+    };
+
+    for (auto cont : externals) {
+        visit(cont);
+        // free() grows while we walk it
+        for (size_t i = 0; i != fingerprinter.free().size(); ++i)
+            visit(fingerprinter.free()[i]);
+    }
+    return seed;
+}
+
+}
@@ -0,0 +1,37 @@
+#ifndef THORIN_ANALYSES_FINGERPRINT_H
+#define THORIN_ANALYSES_FINGERPRINT_H
+
+#include "thorin/continuation.h"
+
+namespace thorin {
+
+class Scope;
+
+/**
+ * Structural 64-bit hashes of @p Scope%s and whole @p World%s.
+ * In contrast to @p Def::hash, these do not depend on gids, i.e. on the order in which a front-end happened to create nodes,
+ * so they stay the same across runs and processes as long as the program does not change.
+ *  - @p Continuation%s within a @p Scope are numbered in the order they are reached from the entry,
+ *  - free @p Continuation%s and @p Global%s are numbered in the order they are first reached - names are not unique -
+ *    and free @p Continuation%s are hashed by their name, type and attributes on top - not by their bodies,
+ *  - debug names of everything but the entry, and all source locations are ignored.
+ */
+u64 fingerprint(const Scope&);
+/// Structural hash of @p Type - the same for equal types of different @p World%s.
+u64 fingerprint(const Type*);
+/**
+ * Combines the fingerprints of all top-level @p Scope%s of @p world.
+ * The externals are visited sorted by name, everything else in the order it is reached from them;
+ * free @p Continuation%s and @p Global%s share one numbering across all @p Scope%s, so each free @p Continuation is tied to the @p Scope that defines it.
+ */
+u64 fingerprint(const World& world);
+
+/// @name mixing further data into a fingerprint - e.g. the settings of a backend
+//@{
+u64 fingerprint_mix(u64 seed, u64 val);
+u64 fingerprint_mix(u64 seed, const std::string& str);
+//@}
+
+}
+
+#endif
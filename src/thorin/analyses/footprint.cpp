@@ -0,0 +1,138 @@
+#include "thorin/analyses/footprint.h"
+
+#include <algorithm>
+#include <cstdint>
+
+#include "thorin/primop.h"
+#include "thorin/world.h"
+#include "thorin/analyses/scope.h"
+
+namespace thorin {
+
+static size_t def_size(NodeTag tag) {
+    if (is_primtype(tag)) return sizeof(PrimLit);
+    if (is_arithop(tag))  return sizeof(ArithOp);
+    if (is_cmp(tag))      return sizeof(Cmp);
+    if (is_mathop(tag))   return sizeof(MathOp);
+
+    switch (tag) {
+#define CODE(T) case Node_##T: return sizeof(T);
+        CODE(Continuation) CODE(Param) CODE(Filter) CODE(App)
+        CODE(Top) CODE(Bottom) CODE(Alloc) CODE(Load) CODE(Store) CODE(Enter)
+        CODE(Select) CODE(AlignOf) CODE(SizeOf) CODE(Global) CODE(Slot) CODE(Cast) CODE(Bitcast)
+        CODE(DefiniteArray) CODE(IndefiniteArray) CODE(Tuple) CODE(Variant) CODE(VariantIndex) CODE(VariantExtract)
+        CODE(StructAgg) CODE(Vector) CODE(Closure) CODE(Extract) CODE(Insert) CODE(LEA)
+        CODE(Hlt) CODE(Known) CODE(Run) CODE(Assembly)
+#undef CODE
+        default: return sizeof(Def);
+    }
+}
+
+static size_t type_size(int tag) {
+    if (is_primtype(tag)) return sizeof(PrimType);
+
+    switch (tag) {
+#define CODE(T) case Node_##T: return sizeof(T);
+        CODE(FnType) CODE(ClosureType) CODE(PtrType) CODE(StructType) CODE(VariantType) CODE(TupleType)
+        CODE(DefiniteArrayType) CODE(IndefiniteArrayType) CODE(MemType) CODE(FrameType)
+#undef CODE
+        case Node_BotType: return sizeof(BottomType);
+        default:           return sizeof(Type);
+    }
+}
+
+/// Short strings live inside the @c std::string itself, longer ones in a heap buffer of @c capacity() characters plus the terminating null.
+static size_t string_size(const std::string& str) {
+    auto data = reinterpret_cast<uintptr_t>(str.data()), self = reinterpret_cast<uintptr_t>(&str);
+    return data >= self && data < self + sizeof(std::string) ? 0 : str.capacity() + 1;
+}
+
+Footprint::Row& Footprint::Row::operator+=(const Row& other) {
+    count += other.count;
+    node  += other.node;
+    ops   += other.ops;
+    uses  += other.uses;
+    debug += other.debug;
+    return *this;
+}
+
+Footprint::Row Footprint::total_defs() const {
+    Row result;
+    for (auto& row : defs) result += row;
+    return result;
+}
+
+Footprint::Row Footprint::total_types() const {
+    Row result;
+    for (auto& row : types) result += row;
+    return result;
+}
+
+Footprint footprint(const World& world, size_t num_top_scopes) {
+    Footprint result;
+
+    auto add = [&] (const Def* def) {
+        auto& row = result.defs[def->tag()];
+        auto dbg = def->debug();
+        ++row.count;
+        row.node  += def_size(def->tag());
+        row.ops   += def->num_ops() * sizeof(const Def*);
+        row.uses  += def->uses().heap_bytes();
+        row.debug += string_size(dbg.name) + string_size(dbg.loc.file);
+    };
+
+    for (auto def : world.defs()) {
+        add(def);
+        if (auto cont = def->isa_nom<Continuation>()) {
+            result.defs[Node_Continuation].ops += cont->num_params() * sizeof(const Param*);
+            for (auto param : cont->params())
+                add(param);
+        }
+    }
+
+    for (auto type : world.types()) {
+        auto& row = result.types[type->tag()];
+        ++row.count;
+        row.node += type_size(type->tag());
+        row.ops  += type->num_ops() * sizeof(const Type*);
+    }
+
+    if (num_top_scopes != 0) {
+        auto& top = result.top_scopes;
+        Scope::for_each(world, [&] (const Scope& scope) { top.emplace_back(scope.entry(), scope.defs().size()); });
+        auto n = std::min(num_top_scopes, top.size());
+        std::partial_sort(top.begin(), top.begin() + n, top.end(), [] (const auto& a, const auto& b) {
+            return a.second != b.second ? a.second > b.second : a.first->gid() < b.first->gid();
+        });
+        top.resize(n);
+    }
+
+    return result;
+}
+
+Stream& Footprint::stream(Stream& s) const {
+    auto stream_row = [&] (const Row& row) {
+        s.fmt("{{\"count\":{},\"node\":{},\"ops\":{},\"uses\":{},\"debug\":{},\"bytes\":{}}}", row.count, row.node, row.ops, row.uses, row.debug, row.bytes());
+    };
+    auto stream_rows = [&] (const char* name, const std::array<Row, NumTags>& rows, const Row& total) {
+        s.fmt("\"{}\":{{\"total\":", name);
+        stream_row(total);
+        for (size_t tag = 0; tag != NumTags; ++tag) {
+            if (rows[tag].count == 0) continue;
+            s.fmt(",\"{}\":", tag2str(NodeTag(tag)));
+            stream_row(rows[tag]);
+        }
+        s.fmt("}}");
+    };
+
+    s.fmt("{{");
+    stream_rows("defs", defs, total_defs());
+    s.fmt(",");
+    stream_rows("types", types, total_types());
+    s.fmt(",\"top_scopes\":[");
+    for (size_t i = 0, e = top_scopes.size(); i != e; ++i)
+        s.fmt("{}{{\"entry\":{},\"defs\":{}}}", i == 0 ? "" : ",", World::quote_json(top_scopes[i].first->unique_name()), top_scopes[i].second);
+    return s.fmt("]}}");
+}
+
+}
@@ -0,0 +1,50 @@
+#ifndef THORIN_ANALYSES_FOOTPRINT_H
+#define THORIN_ANALYSES_FOOTPRINT_H
+
+#include <array>
+#include <vector>
+
+#include "thorin/continuation.h"
+
+namespace thorin {
+
+/**
+ * Node counts and estimated memory of a @p World, broken down by @p NodeTag.
+ * Byte counts are estimates: the size of the node itself, its ops, the heap part of its @p Uses, and the heap part of its @p Debug strings.
+ * Allocator overhead is not included.
+ */
+struct Footprint : public Streamable<Footprint> {
+    struct Row {
+        size_t count = 0;
+        size_t node  = 0;
+        size_t ops   = 0;
+        size_t uses  = 0;
+        size_t debug = 0;
+
+        size_t bytes() const { return node + ops + uses + debug; }
+        Row& operator+=(const Row&);
+    };
+
+    /// All @p NodeTag%s - note that @c Num_AllNodes does not cover the @p MathOp%s.
+    static constexpr size_t NumTags = End_MathOp;
+
+    /// Defs of the @p World including the @p Param%s of its @p Continuation%s.
+    std::array<Row, NumTags> defs;
+    /// Types of the @p TypeTable - only @p Row::count, @p Row::node and @p Row::ops are used.
+    std::array<Row, NumTags> types;
+    /// The largest top-level @p Scope%s and the number of defs they contain - largest first.
+    std::vector<std::pair<Continuation*, size_t>> top_scopes;
+
+    Row total_defs() const;
+    Row total_types() const;
+
+    /// Streams as a single-line JSON object; tags that do not occur are left out.
+    Stream& stream(Stream&) const;
+};
+
+/// Walks all defs and types of @p world; if @p num_top_scopes is not @c 0, also builds all top-level @p Scope%s to rank them by size.
+Footprint footprint(const World& world, size_t num_top_scopes = 10);
+
+}
+
+#endif
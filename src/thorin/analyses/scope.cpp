@@ -122,8 +122,11 @@ void Scope::for_each(const World& world, std::function<void(Scope&)> f) {
         Scope scope(continuation);
         f(scope);
 
+        // backends emit the scopes in this order, so go by gid rather than by the layout of the set
         unique_queue<DefSet> def_queue;
-        for (auto def : scope.free())
+        std::vector<const Def*> free(scope.free().begin(), scope.free().end());
+        std::sort(free.begin(), free.end(), GIDLt<const Def*>());
+        for (auto def : free)
             def_queue.push(def);
 
         while (!def_queue.empty()) {
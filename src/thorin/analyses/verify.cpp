@@ -1,3 +1,14 @@
+#include "thorin/analyses/verify.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
 #include "thorin/primop.h"
 #include "thorin/type.h"
 #include "thorin/world.h"
@@ -5,33 +16,176 @@
 
 namespace thorin {
 
-// TODO this needs serious rewriting
+namespace {
+
+struct Failure {
+    const char* what;
+    const Def* def;
+    const Def* other;
+};
+
+/// Runs @p f on @p num_threads threads - the calling thread being one of them - and waits for all of them.
+template<class F>
+void run_workers(size_t num_threads, F f) {
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < num_threads; ++i)
+        threads.emplace_back(f);
+    f();
+    for (auto& thread : threads)
+        thread.join();
+}
+
+}
+
+/// Only reads @p world so that several threads may call it at the same time.
+static void verify_def(const World& world, const Def* def, std::vector<Failure>& failures) {
+    auto within = [&] (const Def* other) {
+        if (other->isa<Param>()) return true; // TODO remove once Params are within World's sea of nodes
+        return world.defs().contains(other) && world.types().contains(other->type());
+    };
 
-static void verify_calls(World& world) {
-    for (auto def : world.defs()) {
-        if (auto cont = def->isa<Continuation>())
-            cont->verify();
+    for (size_t i = 0, e = def->num_ops(); i != e; ++i) {
+        auto op = def->op(i);
+        if (op == nullptr) {
+            failures.push_back({ "missing op", def, nullptr });
+            continue;
+        }
+        if (!within(op))
+            failures.push_back({ "op not in world", def, op });
+        if (!op->uses().contains(Use(i, def)))
+            failures.push_back({ "can't find def in op's uses", def, op });
+    }
+
+    for (const auto& use : def->uses()) {
+        if (!within(use.def()))
+            failures.push_back({ "use not in world", def, use.def() });
+        if (use.index() >= use->num_ops() || use->op(use.index()) != def)
+            failures.push_back({ "use doesn't point to def", def, use.def() });
     }
+
+    if (auto cont = def->isa_nom<Continuation>())
+        cont->verify();
 }
 
-static bool verify_top_level(World& world) {
-    bool ok = true;
-    Scope::for_each(world, [&] (const Scope& scope) {
-        if (scope.has_free_params()) {
+/// Does the same walk as @p Scope::for_each but hands out the @p Scope%s to @p num_threads workers.
+static void verify_top_level(const World& world, size_t num_threads, std::vector<Failure>& failures) {
+    std::mutex mutex;
+    std::condition_variable cv;
+    ContinuationSet done;
+    std::vector<Continuation*> todo;
+    size_t busy = 0;
+
+    for (auto&& [_, cont] : world.externals()) {
+        if (cont->has_body() && done.emplace(cont).second)
+            todo.push_back(cont);
+    }
+
+    run_workers(num_threads, [&] {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            cv.wait(lock, [&] { return !todo.empty() || busy == 0; });
+            if (todo.empty()) break;
+
+            auto entry = todo.back();
+            todo.pop_back();
+            ++busy;
+            lock.unlock();
+
+            Scope scope(entry);
+            std::vector<Failure> local;
             for (auto param : scope.free_params())
-                world.ELOG("top-level continuation '{}' got free param '{}' belonging to continuation {}", scope.entry(), param, param->continuation());
-            world.ELOG("here: {}", scope.entry());
-            ok = false;
+                local.push_back({ "top-level continuation got free param", entry, param });
+
+            std::vector<Continuation*> found;
+            unique_queue<DefSet> queue;
+            for (auto def : scope.free())
+                queue.push(def);
+            while (!queue.empty()) {
+                auto def = queue.pop();
+                if (auto cont = def->isa_nom<Continuation>())
+                    found.push_back(cont);
+                else {
+                    for (auto op : def->ops())
+                        queue.push(op);
+                }
+            }
+
+            lock.lock();
+            failures.insert(failures.end(), local.begin(), local.end());
+            for (auto cont : found) {
+                if (cont->has_body() && done.emplace(cont).second)
+                    todo.push_back(cont);
+            }
+            --busy;
+            cv.notify_all();
+        }
+    });
+}
+
+bool verify(World& world, const VerifyOptions& options) {
+    auto num_threads = options.num_threads != 0 ? options.num_threads : std::max(size_t(std::thread::hardware_concurrency()), size_t(1));
+    bool sampling = options.sample < 1.0;
+
+    // a new random subset for each call
+    static std::atomic<u32> round = 0;
+    auto seed = murmur3(hash_begin(round++));
+    auto threshold = u64(std::max(options.sample, 0.0) * double(u64(1) << 32));
+    auto sampled = [&] (hash_t h) { return !sampling || u64(murmur3(h)) < threshold; };
+
+    std::vector<Failure> failures;
+    std::mutex mutex;
+    auto defs = world.copy_defs();
+    std::atomic<size_t> next = 0, checked = 0;
+    constexpr size_t chunk = 1024;
+
+    run_workers(std::min(num_threads, (defs.size() + chunk - 1) / chunk), [&] {
+        std::vector<Failure> local;
+        for (size_t begin; (begin = next.fetch_add(chunk)) < defs.size();) {
+            for (size_t i = begin, e = std::min(begin + chunk, defs.size()); i != e; ++i) {
+                if (!sampled(hash_combine(seed, defs[i]->gid()))) continue;
+                if (options.budget != 0 && checked++ >= options.budget) {
+                    next = defs.size();
+                    break;
+                }
+                verify_def(world, defs[i], local);
+            }
         }
+        std::lock_guard<std::mutex> guard(mutex);
+        failures.insert(failures.end(), local.begin(), local.end());
+    });
+
+    bool top_level = sampled(seed);
+    if (top_level)
+        verify_top_level(world, num_threads, failures);
+
+    // failures are reported in a fixed order regardless of the number of threads
+    std::sort(failures.begin(), failures.end(), [] (const Failure& a, const Failure& b) {
+        if (a.def->gid() != b.def->gid()) return a.def->gid() < b.def->gid();
+        auto a_other = a.other ? a.other->gid() : 0, b_other = b.other ? b.other->gid() : 0;
+        if (a_other != b_other) return a_other < b_other;
+        return std::strcmp(a.what, b.what) < 0;
     });
-    if (!ok)
+    for (auto& failure : failures) {
+        if (failure.other)
+            world.ELOG("{}: {} - {}", failure.what, failure.def, failure.other);
+        else
+            world.ELOG("{}: {}", failure.what, failure.def);
+    }
+    if (!failures.empty())
         world.dump();
-    return ok;
+
+    return failures.empty();
 }
 
-void verify(World& world) {
-    verify_calls(world);
-    verify_top_level(world);
+void debug_verify(World& world) {
+#if THORIN_ENABLE_CHECKS || !defined(NDEBUG)
+    if (!verify(world, world.verify_options())) {
+        Stream(std::cerr).fmt("verification of world '{}' failed{}", world.name(), world.is_logged(LogLevel::Error) ? "" : " - set a log stream to see why").endl();
+        std::abort();
+    }
+#else
+    (void) world;
+#endif
 }
 
 }
@@ -1,6 +1,8 @@
 #ifndef THORIN_ANALYSES_VERIFY_H
 #define THORIN_ANALYSES_VERIFY_H
 
+#include <cstddef>
+
 #include "thorin/config.h"
 
 namespace thorin {
@@ -8,13 +10,31 @@ namespace thorin {
 class Continuation;
 class World;
 
-void verify(World& world);
+/**
+ * How much of the @p World @p verify checks.
+ * With the defaults, everything is checked on the calling thread.
+ */
+struct VerifyOptions {
+    /// Worker threads that check disjoint slices of @p World::defs - @c 0 means one per hardware thread.
+    size_t num_threads = 1;
+    /// Fraction of all defs checked per call; a different random subset is drawn each time.
+    /// The walk over all top-level @p Scope%s is done with the same probability.
+    double sample = 1.0;
+    /// Upper bound of defs checked per call - @c 0 means unlimited.
+    size_t budget = 0;
+};
 
-#if THORIN_ENABLE_CHECKS
-inline void debug_verify(World& world) { verify(world); }
-#else
-inline void debug_verify(World&) {}
-#endif
+/**
+ * Checks that
+ * - ops and uses of each def agree with each other and only refer to defs and types of @p world,
+ * - each @p Continuation is well-formed (see @p Continuation::verify), and
+ * - no top-level @p Scope has free @p Param%s.
+ * Failures are logged as errors; returns whether there was none.
+ */
+bool verify(World& world, const VerifyOptions& = {});
+
+/// Runs @p verify with @p World::verify_options if assertions are enabled - i.e. in Debug builds or whenever @c NDEBUG is not defined - and aborts if it fails.
+void debug_verify(World& world);
 
 }
 
@@ -3,19 +3,25 @@
 #include "thorin/type.h"
 #include "thorin/world.h"
 #include "thorin/analyses/cfg.h"
+#include "thorin/analyses/fingerprint.h"
 #include "thorin/analyses/schedule.h"
 #include "thorin/analyses/scope.h"
 #include "thorin/transform/hls_channels.h"
+#include "thorin/be/cache.h"
 #include "thorin/be/emitter.h"
 #include "thorin/util/stream.h"
 #include "c.h"
 
 #include <cctype>
 #include <cmath>
+#include <atomic>
+#include <mutex>
 #include <regex>
 #include <sstream>
+#include <thread>
 #include <type_traits>
 #include <unordered_map> // TODO don't use std::unordered_*
+#include <unordered_set>
 #include <variant>
 
 namespace thorin::c {
@@ -37,6 +43,29 @@ struct BB {
     }
 };
 
+/// A declaration at file scope; @c key identifies it when the declarations of several functions are merged.
+struct Decl {
+    std::string key;
+    std::string text;
+};
+
+/// A warning about a def; it is logged together with the function it belongs to.
+struct Warning {
+    Loc loc;
+    std::string text;
+};
+
+struct Names;
+
+/// Everything emitted for one function: its definition, the declarations it relies on, and the warnings raised on the way.
+struct Function {
+    std::vector<Decl> type_decls;
+    std::vector<Decl> func_decls;
+    std::vector<Decl> vars_decls;
+    std::string impl;
+    std::vector<Warning> warnings;
+};
+
 using FuncMode = ChannelMode;
 
 enum class CLDialect : uint8_t {
@@ -73,7 +102,7 @@ enum class HlsInterface : uint8_t {
 
 class CCodeGen : public thorin::Emitter<std::string, std::string, BB, CCodeGen> {
 public:
-    CCodeGen(World& world, const Cont2Config& kernel_config, Stream& stream, Lang lang, bool debug, std::string& flags)
+    CCodeGen(World& world, const Cont2Config& kernel_config, Stream& stream, Lang lang, bool debug, std::string& flags, CompilationCache* cache = nullptr)
         : world_(world)
         , kernel_config_(kernel_config)
         , lang_(lang)
@@ -81,10 +110,15 @@ public:
         , debug_(debug)
         , flags_(flags)
         , stream_(stream)
+        , cache_(cache)
     {}
 
     World& world() const { return world_; }
-    void emit_module();
+    void emit_module(size_t num_threads = 1);
+    void emit_parallel(size_t num_threads);
+    u64 scope_key(const Scope&, Names&);
+    bool emit_header();
+    void emit_function(const Function&);
     void emit_c_int();
     void emit_epilogue(Continuation*);
 
@@ -104,6 +138,7 @@ public:
 private:
     std::string convert(const Type*);
     std::string addr_space_prefix(AddrSpace);
+    std::string opencl_vector_name(const PrimType*);
     std::string constructor_prefix(const Type*);
     std::string device_prefix();
     Stream& emit_debug_info(Stream&, const Def*);
@@ -112,6 +147,21 @@ private:
     template <typename T, typename IsInfFn, typename IsNanFn>
     std::string emit_float(T, IsInfFn, IsNanFn);
 
+    /// Worker threads must not log concurrently, so warnings are collected and logged by @p emit_function in a fixed order.
+    template<class... Args>
+    void warn(const Def* def, const char* fmt, Args&&... args) {
+        StringStream s;
+        s.fmt(fmt, std::forward<Args&&>(args)...);
+        func_warnings_.push_back({def->loc(), s.str()});
+    }
+
+    template<class F>
+    auto locked(F f) {
+        if (!world_mutex_) return f();
+        std::lock_guard<std::mutex> guard(*world_mutex_);
+        return f();
+    }
+
     std::string array_name(const DefiniteArrayType*);
     std::string tuple_name(const TupleType*);
 
@@ -130,15 +180,25 @@ private:
     std::string flags_;
     Stream& stream_;
 
+    /// Body of the function currently emitted - written to @p stream_ as soon as the function is complete.
     StringStream func_impls_;
-    StringStream func_decls_;
-    StringStream type_decls_;
-    StringStream vars_decls_;
+    /// Declarations needed by the current function that have not been written to @p stream_ yet.
+    std::vector<Decl> func_decls_;
+    std::vector<Decl> type_decls_;
+    std::vector<Decl> vars_decls_;
+    std::vector<Warning> func_warnings_;
+    /// Keys of the declarations written to @p stream_ so far.
+    std::unordered_set<std::string> declared_;
+    /// If set, completed functions are collected here instead of being written to @p stream_.
+    std::vector<Function>* functions_ = nullptr;
+    /// Guards extending the @p World while several functions are emitted in parallel.
+    std::mutex* world_mutex_ = nullptr;
+    /// Holds the @p Function%s of the @p Scope%s emitted in earlier runs, keyed by @p scope_key.
+    CompilationCache* cache_;
     /// Tracks defs that have been emitted as local variables of the current function
     DefSet func_defs_;
-
-    std::ostringstream macro_xilinx_;
-    std::ostringstream macro_intel_;
+    /// Names of the vector typedefs emitted so far - different @p PrimType%s share the same C vector type
+    std::unordered_set<std::string> vector_types_;
 
     ContinuationMap<FuncMode> builtin_funcs_; // OpenCL builtin functions
 };
@@ -162,9 +222,7 @@ static inline bool is_string_type(const Type* type) {
 }
 
 // TODO I think we should have a full-blown channel type
-inline bool is_channel_type(const StructType* struct_type) {
-    return struct_type->name().str().find("channel") != std::string::npos;
-}
+inline bool is_channel_type(const StructType* struct_type) { return struct_type->is_channel(); }
 
 /// Returns true when the def carries concrete data in the final generated code
 inline bool is_concrete(const Def* def) { return !is_mem(def) && def->order() == 0 && !is_unit(def);}
@@ -236,8 +294,25 @@ std::string CCodeGen::convert(const Type* type) {
             case PrimType_pf64: case PrimType_qf64: s <<  "f64";  use_fp_64_ = true; break;
             default: THORIN_UNREACHABLE;
         }
-        if (primtype->is_vector())
-            s << primtype->length();
+        if (primtype->is_vector()) {
+            if (lang_ == Lang::OpenCL) {
+                // OpenCL has native vector types; masks are integer vectors
+                return types_[type] = opencl_vector_name(primtype);
+            } else if (lang_ == Lang::C99 || lang_ == Lang::HLS) {
+                // GCC vector extensions; masks are integer vectors
+                auto elem = is_type_bool(primtype) ? "i32" : s.str();
+                auto bits = is_type_bool(primtype) ? 32 : num_bits(primtype->primtype_tag());
+                name = elem + "x" + std::to_string(primtype->length());
+                if (vector_types_.emplace(name).second) {
+                    StringStream decl;
+                    decl.fmt("typedef {} {} __attribute__((vector_size({})));\n", elem, name, bits / 8 * primtype->length());
+                    type_decls_.push_back({name, decl.str()});
+                }
+                return types_[type] = name;
+            } else {
+                s << primtype->length();
+            }
+        }
     } else if (auto array = type->isa<IndefiniteArrayType>()) {
         return types_[type] = convert(array->elem_type()); // IndefiniteArrayType always occurs within a pointer
     } else if (type->isa<FnType>()) {
@@ -299,11 +374,31 @@ std::string CCodeGen::convert(const Type* type) {
         return types_[type] = s.str();
     } else {
         assert(!s.str().empty());
-        type_decls_ << s.str();
+        type_decls_.push_back({name, s.str()});
         return types_[type] = name;
     }
 }
 
+std::string CCodeGen::opencl_vector_name(const PrimType* primtype) {
+    std::string elem;
+    switch (primtype->primtype_tag()) {
+        case PrimType_bool:                     elem = "int";    break;
+        case PrimType_ps8:  case PrimType_qs8:  elem = "char";   break;
+        case PrimType_pu8:  case PrimType_qu8:  elem = "uchar";  break;
+        case PrimType_ps16: case PrimType_qs16: elem = "short";  break;
+        case PrimType_pu16: case PrimType_qu16: elem = "ushort"; break;
+        case PrimType_ps32: case PrimType_qs32: elem = "int";    break;
+        case PrimType_pu32: case PrimType_qu32: elem = "uint";   break;
+        case PrimType_ps64: case PrimType_qs64: elem = "long";   break;
+        case PrimType_pu64: case PrimType_qu64: elem = "ulong";  break;
+        case PrimType_pf16: case PrimType_qf16: elem = "half";   use_fp_16_ = true; break;
+        case PrimType_pf32: case PrimType_qf32: elem = "float";  break;
+        case PrimType_pf64: case PrimType_qf64: elem = "double"; use_fp_64_ = true; break;
+        default: THORIN_UNREACHABLE;
+    }
+    return elem + std::to_string(primtype->length());
+}
+
 std::string CCodeGen::addr_space_prefix(AddrSpace addr_space) {
     if (lang_ == Lang::OpenCL) {
         switch (addr_space) {
@@ -348,48 +443,465 @@ std::string CCodeGen::device_prefix() {
  * emit
  */
 
+static inline const Type* ret_type(const FnType* fn_type) {
+    auto ret_fn_type = (*std::find_if(
+        fn_type->ops().begin(), fn_type->ops().end(), [] (const Type* op) {
+            return op->order() % 2 == 1;
+        }))->as<FnType>();
+    std::vector<const Type*> types;
+    for (auto op : ret_fn_type->ops()) {
+        if (op->isa<MemType>() || is_type_unit(op) || op->order() > 0) continue;
+        types.push_back(op);
+    }
+    return fn_type->table().tuple_type(types);
+}
+
 HlsInterface interface, gmem_config;
 bool interface_status, hls_top_scope = false;
 
-void CCodeGen::emit_module() {
+void CCodeGen::emit_module(size_t num_threads) {
     Continuation* hls_top = nullptr;
     interface_status = get_interface(interface, gmem_config);
 
-    Scope::for_each(world(), [&] (const Scope& scope) {
-        if (scope.entry()->name() == "hls_top")
-            hls_top = scope.entry();
-        else
-            emit_scope(scope);
+    bool use_channels = emit_header();
+
+    // with channels, the code emitted for a type depends on what has been converted before; HLS also tracks the top-level scope globally
+    // the cache relies on the Functions of the parallel path, too
+    if ((num_threads > 1 || cache_) && !use_channels && lang_ != Lang::HLS) {
+        emit_parallel(std::max(num_threads, size_t(1)));
+    } else {
+        Scope::for_each(world(), [&] (const Scope& scope) {
+            if (scope.entry()->name() == "hls_top")
+                hls_top = scope.entry();
+            else
+                emit_scope(scope);
+        });
+        if (hls_top) {
+            hls_top_scope = true;
+            emit_scope(Scope(hls_top));
+        }
+    }
+
+    if (lang_ == Lang::CUDA || lang_ == Lang::HLS)
+        stream_.fmt("}} /* extern \"C\" */\n");
+}
+
+static inline std::string make_identifier(const std::string& str) {
+    auto copy = str;
+    // Transform non-alphanumeric characters
+    std::transform(copy.begin(), copy.end(), copy.begin(), [] (auto c) {
+        if (c == '*') return 'p';
+        if (!std::isalnum(c)) return '_';
+        return c;
     });
-    if (hls_top) {
-        hls_top_scope = true;
-        emit_scope(Scope(hls_top));
+    // First character must be a letter or '_'
+    if (!std::isalpha(copy[0]) && copy[0] != '_')
+        copy.insert(copy.begin(), '_');
+    return copy;
+}
+
+static inline std::string label_name(const Def* def) {
+    return make_identifier(def->as_nom<Continuation>()->unique_name());
+}
+
+/**
+ * The names of defs and types in the generated code are derived from their gids, which shift whenever anything is created earlier in the @p World.
+ * So cached code refers to them by placeholder: the index of the name in the order @p CCodeGen::scope_key reaches its def or type.
+ */
+struct Names {
+    /// Adds the spellings of one def or type.
+    void add(std::vector<std::string>&& spellings) {
+        std::sort(spellings.begin(), spellings.end());
+        spellings.erase(std::unique(spellings.begin(), spellings.end()), spellings.end());
+        for (auto& spelling : spellings) {
+            if (indices.emplace(spelling, names.size()).second)
+                names.emplace_back(std::move(spelling));
+            else
+                unique = false;
+        }
+    }
+
+    std::vector<std::string> names;
+    std::unordered_map<std::string, size_t> indices;
+    /// Two defs or types share a spelling - their placeholders would be ambiguous, so such scopes are not cached.
+    bool unique = true;
+};
+
+/// Replaces the identifiers in @p str that are among @p names by placeholders.
+static std::string to_placeholders(const std::string& str, const Names& names) {
+    std::string result;
+    for (size_t i = 0, e = str.size(); i != e;) {
+        auto c = (unsigned char) str[i];
+        if (!std::isalnum(c) && c != '_') {
+            result += str[i++];
+            continue;
+        }
+        auto j = i;
+        while (j != e && (std::isalnum((unsigned char) str[j]) || str[j] == '_')) ++j;
+        auto token = str.substr(i, j - i);
+        // number literals are no identifiers
+        if (auto name = names.indices.find(token); !std::isdigit(c) && name != names.indices.end())
+            result += '\x01' + std::to_string(name->second) + '\x02';
+        else
+            result += token;
+        i = j;
+    }
+    return result;
+}
+
+/// Dual of @p to_placeholders; returns false if @p str refers to a name @p names does not have.
+static bool from_placeholders(std::string& str, const Names& names) {
+    std::string result;
+    for (size_t i = 0, e = str.size(); i != e;) {
+        if (str[i] != '\x01') {
+            result += str[i++];
+            continue;
+        }
+        size_t index = 0, j = i + 1;
+        for (; j != e && std::isdigit((unsigned char) str[j]); ++j)
+            index = index * 10 + size_t(str[j] - '0');
+        if (j == e || str[j] != '\x02' || j == i + 1 || index >= names.names.size()) return false;
+        result += names.names[index];
+        i = j + 1;
+    }
+    str = std::move(result);
+    return true;
+}
+
+/// Applies @p f to every string of @p functions that may contain names.
+template<class F>
+static bool for_each_string(std::vector<Function>& functions, F f) {
+    for (auto& function : functions) {
+        for (auto decls : { &function.type_decls, &function.func_decls, &function.vars_decls }) {
+            for (auto& decl : *decls) {
+                if (!f(decl.key) || !f(decl.text)) return false;
+            }
+        }
+        if (!f(function.impl)) return false;
+        for (auto& warning : function.warnings) {
+            if (!f(warning.text)) return false;
+        }
+    }
+    return true;
+}
+
+static void serialize(std::string& buf, const std::string& str) {
+    buf += std::to_string(str.size());
+    buf += ':';
+    buf += str;
+}
+
+static void serialize(std::string& buf, const std::vector<Decl>& decls) {
+    serialize(buf, std::to_string(decls.size()));
+    for (auto& decl : decls) {
+        serialize(buf, decl.key);
+        serialize(buf, decl.text);
+    }
+}
+
+static void serialize(std::string& buf, const std::vector<Warning>& warnings) {
+    serialize(buf, std::to_string(warnings.size()));
+    for (auto& warning : warnings) {
+        serialize(buf, warning.loc.file);
+        for (auto row_col : { warning.loc.begin.row, warning.loc.begin.col, warning.loc.finis.row, warning.loc.finis.col })
+            serialize(buf, std::to_string(row_col));
+        serialize(buf, warning.text);
+    }
+}
+
+static std::string serialize(const std::vector<Function>& functions) {
+    std::string buf;
+    serialize(buf, std::to_string(functions.size()));
+    for (auto& function : functions) {
+        serialize(buf, function.type_decls);
+        serialize(buf, function.func_decls);
+        serialize(buf, function.vars_decls);
+        serialize(buf, function.impl);
+        serialize(buf, function.warnings);
+    }
+    return buf;
+}
+
+/// Reads a string written by @p serialize from @p buf at @p pos; returns false if @p buf is malformed.
+static bool deserialize(const std::string& buf, size_t& pos, std::string& str) {
+    auto colon = buf.find(':', pos);
+    if (colon == std::string::npos || colon == pos || colon - pos > 19) return false;
+    size_t size = 0;
+    for (size_t i = pos; i != colon; ++i) {
+        if (!std::isdigit(buf[i])) return false;
+        size = size * 10 + size_t(buf[i] - '0');
+    }
+    if (size > buf.size() - colon - 1) return false;
+    str = buf.substr(colon + 1, size);
+    pos = colon + 1 + size;
+    return true;
+}
+
+static bool deserialize(const std::string& buf, size_t& pos, size_t& num) {
+    std::string str;
+    if (!deserialize(buf, pos, str) || str.empty() || str.size() > 19) return false;
+    num = 0;
+    for (auto c : str) {
+        if (!std::isdigit(c)) return false;
+        num = num * 10 + size_t(c - '0');
+    }
+    return true;
+}
+
+static bool deserialize(const std::string& buf, size_t& pos, std::vector<Decl>& decls) {
+    size_t num;
+    if (!deserialize(buf, pos, num)) return false;
+    for (size_t i = 0; i != num; ++i) {
+        Decl decl;
+        if (!deserialize(buf, pos, decl.key) || !deserialize(buf, pos, decl.text)) return false;
+        decls.emplace_back(std::move(decl));
+    }
+    return true;
+}
+
+static bool deserialize(const std::string& buf, size_t& pos, std::vector<Warning>& warnings) {
+    size_t num;
+    if (!deserialize(buf, pos, num)) return false;
+    for (size_t i = 0; i != num; ++i) {
+        Warning warning;
+        size_t row_col[4];
+        if (!deserialize(buf, pos, warning.loc.file)) return false;
+        for (auto& n : row_col) {
+            if (!deserialize(buf, pos, n)) return false;
+        }
+        if (!deserialize(buf, pos, warning.text)) return false;
+        warning.loc.begin = { u32(row_col[0]), u32(row_col[1]) };
+        warning.loc.finis = { u32(row_col[2]), u32(row_col[3]) };
+        warnings.emplace_back(std::move(warning));
+    }
+    return true;
+}
+
+static bool deserialize(const std::string& buf, std::vector<Function>& functions) {
+    size_t pos = 0, num;
+    if (!deserialize(buf, pos, num)) return false;
+    for (size_t i = 0; i != num; ++i) {
+        Function function;
+        if (!deserialize(buf, pos, function.type_decls) ||
+            !deserialize(buf, pos, function.func_decls) ||
+            !deserialize(buf, pos, function.vars_decls) ||
+            !deserialize(buf, pos, function.impl) ||
+            !deserialize(buf, pos, function.warnings))
+            return false;
+        functions.emplace_back(std::move(function));
+    }
+    return pos == buf.size();
+}
+
+/**
+ * Each worker thread has its own @p CCodeGen and emits whole scopes into @p Function%s.
+ * These are written in the order of @p Scope::for_each afterwards - skipping declarations already written - so the output does not depend on the number of threads.
+ * With a @p cache_, the @p Function%s of each scope are looked up by @p scope_key first;
+ * missing ones are emitted by a fresh @p CCodeGen, so that they carry all the declarations they need, and stored - with placeholders for their @p Names.
+ */
+void CCodeGen::emit_parallel(size_t num_threads) {
+    std::vector<Continuation*> entries;
+    Scope::for_each(world(), [&] (const Scope& scope) { entries.push_back(scope.entry()); });
+
+    // the names of tuple types are derived from their gids, so create the return types in a fixed order beforehand
+    std::vector<const Def*> fns;
+    std::vector<const Assembly*> asms;
+    for (auto def : world().defs()) {
+        if (auto fn_type = def->type()->isa<FnType>(); fn_type && fn_type->is_returning())
+            fns.push_back(def);
+        if (auto ass = def->isa<Assembly>())
+            asms.push_back(ass);
+    }
+    std::sort(fns.begin(), fns.end(), GIDLt<const Def*>());
+    for (auto def : fns)
+        ret_type(def->type()->as<FnType>());
+    // likewise the outputs of inline assembly - the workers must not create defs, which registers uses on shared ones
+    std::sort(asms.begin(), asms.end(), GIDLt<const Assembly*>());
+    for (auto ass : asms) {
+        if (auto tuple_type = ass->type()->isa<TupleType>()) {
+            for (size_t i = 1, e = tuple_type->num_ops(); i != e; ++i)
+                ass->out(i);
+        }
+    }
+
+    static const char* cache_ext = ".cfn";
+    std::mutex world_mutex;
+    std::vector<std::vector<Function>> functions(entries.size());
+    std::atomic<size_t> next = 0;
+    auto work = [&] {
+        CCodeGen cg(world(), kernel_config_, stream_, lang_, debug_, flags_);
+        cg.world_mutex_ = &world_mutex;
+        for (size_t i; (i = next++) < entries.size();) {
+            Scope scope(entries[i]);
+            if (!cache_) {
+                cg.functions_ = &functions[i];
+                cg.emit_scope(scope);
+                continue;
+            }
+
+            Names names;
+            auto key = cg.scope_key(scope, names);
+            auto restore = [&] (std::string& str) { return from_placeholders(str, names); };
+            if (names.unique) {
+                if (auto entry = cache_->lookup(key, cache_ext); entry && deserialize(*entry, functions[i]) && for_each_string(functions[i], restore))
+                    continue;
+            }
+            functions[i].clear();
+            CCodeGen fresh(world(), kernel_config_, stream_, lang_, debug_, flags_);
+            fresh.world_mutex_ = &world_mutex;
+            fresh.functions_ = &functions[i];
+            fresh.emit_scope(scope);
+            if (names.unique) {
+                auto cached = functions[i];
+                for_each_string(cached, [&] (std::string& str) { str = to_placeholders(str, names); return true; });
+                cache_->store(key, cache_ext, serialize(cached));
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (size_t i = 0, e = std::min(num_threads, entries.size()); i != e; ++i)
+        threads.emplace_back(work);
+    for (auto& thread : threads)
+        thread.join();
+
+    for (auto& scope_functions : functions) {
+        for (auto& function : scope_functions)
+            emit_function(function);
+    }
+}
+
+/**
+ * The @p fingerprint of @p scope does not cover what the generated code depends on beyond the structure of the program:
+ * the settings of this generator, the kernel configurations, and the debug names of defs.
+ * So mix these in - for each def @p scope refers to - together with the structure of its type, including the return types the code uses.
+ * The names the code uses for these defs and types are derived from their gids and go to @p names instead.
+ */
+u64 CCodeGen::scope_key(const Scope& scope, Names& names) {
+    auto key = fingerprint(scope);
+    key = fingerprint_mix(key, lang_as_string(lang_));
+    key = fingerprint_mix(key, u64(debug_));
+    key = fingerprint_mix(key, flags_);
+
+    TypeSet types;
+    auto visit_type = [&] (const Type* type, auto& visit_type) -> void {
+        if (!types.emplace(type).second) return;
+        key = fingerprint_mix(key, fingerprint(type));
+        if (auto tuple_type = type->isa<TupleType>())
+            names.add({ tuple_name(tuple_type) });
+        else if (auto array_type = type->isa<DefiniteArrayType>())
+            names.add({ array_name(array_type) });
+        else if (auto struct_type = type->isa<StructType>(); struct_type && is_channel_type(struct_type))
+            names.add({ struct_type->name().str() + "_" + std::to_string(struct_type->gid()) });
+        if (auto fn_type = type->isa<FnType>(); fn_type && fn_type->is_returning())
+            visit_type(locked([&] { return ret_type(fn_type); }), visit_type);
+        for (auto op : type->ops())
+            visit_type(op, visit_type);
+    };
+
+    DefSet done;
+    std::vector<const Def*> stack;
+    auto push = [&] (const Def* def) {
+        if (done.emplace(def).second) stack.push_back(def);
+    };
+    push(scope.entry());
+    while (!stack.empty()) {
+        auto def = stack.back();
+        stack.pop_back();
+        key = fingerprint_mix(key, def->name());
+        auto unique_name = def->unique_name();
+        // all the names the emitter derives from a def
+        std::vector<std::string> spellings = {
+            unique_name, make_identifier(unique_name), "p_" + unique_name, "g_" + unique_name,
+            unique_name + "_", unique_name + "_reserved", unique_name + "_slot", unique_name + "_u"
+        };
+        if (auto cont = def->isa_nom<Continuation>(); cont && cont->intrinsic() == Intrinsic::Pipeline)
+            spellings.emplace_back("i" + std::to_string(def->gid())); // loop counter
+        names.add(std::move(spellings));
+        if (debug_) {
+            key = fingerprint_mix(key, def->loc().file);
+            key = fingerprint_mix(key, def->loc().begin.row);
+        }
+        visit_type(def->type(), visit_type);
+
+        if (auto cont = def->isa_nom<Continuation>()) {
+            if (auto config = kernel_config_.find(cont); config != kernel_config_.end())
+                key = fingerprint_mix(key, cont, *config->second);
+            // only the signature of free continuations matters
+            if (!scope.contains(cont) && cont != scope.entry()) continue;
+            for (auto param : cont->params())
+                push(param);
+        }
+
+        for (auto op : def->ops())
+            push(op);
+    }
+
+    return key;
+}
+
+/// The header goes out before any function is emitted, so the features it enables are collected from the whole @p World up front.
+/// Returns whether channels are used.
+bool CCodeGen::emit_header() {
+    bool use_channels = false;
+    TypeSet done;
+    auto visit = [&] (const Type* type, auto& visit) -> void {
+        if (!done.emplace(type).second) return;
+        if (auto primtype = type->isa<PrimType>()) {
+            switch (primtype->primtype_tag()) {
+                case PrimType_pf16: case PrimType_qf16: use_fp_16_ = true; break;
+                case PrimType_pf64: case PrimType_qf64: use_fp_64_ = true; break;
+                default: break;
+            }
+        } else if (auto struct_type = type->isa<StructType>()) {
+            if ((lang_ == Lang::OpenCL || lang_ == Lang::HLS) && is_channel_type(struct_type))
+                use_channels = true;
+        }
+        for (auto op : type->ops())
+            visit(op, visit);
+    };
+
+    for (auto def : world().defs()) {
+        visit(def->type(), visit);
+        if (def->isa<MathOp>()) {
+            use_math_ = true;
+        } else if (def->isa<AlignOf>()) {
+            use_align_of_ |= lang_ == Lang::C99 || lang_ == Lang::OpenCL;
+        } else if (def->isa<Bitcast>()) {
+            use_memcpy_ |= lang_ != Lang::OpenCL;
+        } else if (def->isa<Alloc>()) {
+            use_malloc_ = true;
+        } else if (auto app = def->isa<App>(); app && lang_ == Lang::OpenCL) {
+            if (auto callee = app->callee()->isa_nom<Continuation>(); callee && callee->is_channel()) {
+                auto name = callee->name();
+                builtin_funcs_.emplace(callee, name.find("write") != std::string::npos ? FuncMode::Write : FuncMode::Read);
+            }
+        }
     }
 
     if (lang_ == Lang::OpenCL) {
-        if (use_channels_) {
+        if (use_channels) {
             std::string write_channel_params = "(channel, val) ";
             std::string read_channel_params = "(val, channel) ";
 
-            macro_xilinx_ << " #define PIPE pipe\n";
-            macro_intel_  << " #pragma OPENCL EXTENSION cl_intel_channels : enable\n"
-                          << " #define PIPE channel\n";
-            for (auto map : builtin_funcs_) {
-                if (map.first->is_channel()) {
-                    if (map.second == FuncMode::Write) {
-                        macro_xilinx_ << " #define " << map.first->name() << write_channel_params << "write_pipe_block(channel, &val)\n";
-                        macro_intel_  << " #define " << map.first->name() << write_channel_params << "write_channel_intel(channel, val)\n";
-                    } else if (map.second == FuncMode::Read) {
-                        macro_xilinx_ << " #define " << map.first->name() << read_channel_params << "read_pipe_block(channel, &val)\n";
-                        macro_intel_  << " #define " << map.first->name() << read_channel_params << "val = read_channel_intel(channel)\n";
+            auto emit_macros = [&] (bool xilinx) {
+                for (auto map : builtin_funcs_) {
+                    if (map.first->is_channel()) {
+                        if (map.second == FuncMode::Write)
+                            stream_ << " #define " << map.first->name() << write_channel_params << (xilinx ? "write_pipe_block(channel, &val)\n" : "write_channel_intel(channel, val)\n");
+                        else if (map.second == FuncMode::Read)
+                            stream_ << " #define " << map.first->name() << read_channel_params << (xilinx ? "read_pipe_block(channel, &val)\n" : "val = read_channel_intel(channel)\n");
                     }
                 }
-            }
+            };
             stream_ << "#if defined(__xilinx__)\n";
-            stream_ << macro_xilinx_.str();
+            stream_ << " #define PIPE pipe\n";
+            emit_macros(true);
 
             stream_ << "#elif defined(INTELFPGA_CL)\n";
-            stream_ << macro_intel_.str();
+            stream_ << " #pragma OPENCL EXTENSION cl_intel_channels : enable\n"
+                       " #define PIPE channel\n";
+            emit_macros(false);
 
             stream_ << "#else\n"
                        " #define PIPE pipe\n";
@@ -484,38 +996,51 @@ void CCodeGen::emit_module() {
         stream_.fmt("extern \"C\" {{\n");
     }
 
-    stream_ << type_decls_.str() << "\n";
-
-    // For Xilinx hardware, we have to ifdef the function declarations away
-    // In CL mode we don't want them at all, for HLS we only want them when doing simulations and not for synthesis
-    if (lang_ == Lang::OpenCL)
-        stream_ << "#ifndef __xilinx__\n";
-    else if (lang_ == Lang::HLS)
-        stream_ << "#ifndef __SYNTHESIS__\n";
-
-    stream_ << func_decls_.str();
-
-    if (lang_ == Lang::OpenCL)
-        stream_ << "#endif /* __xilinx__ */\n";
-    else if (lang_ == Lang::HLS)
-        stream_ << "#endif /* __SYNTHESIS__ */\n";
-
-    stream_ << vars_decls_.str();
-
     if (lang_ == Lang::CUDA) {
-        stream_.endl();
         for (auto x : std::array {'x', 'y', 'z'}) {
             stream_.fmt("__device__ inline int threadIdx_{}() {{ return threadIdx.{}; }}\n", x, x);
             stream_.fmt("__device__ inline int blockIdx_{}() {{ return blockIdx.{}; }}\n", x, x);
             stream_.fmt("__device__ inline int blockDim_{}() {{ return blockDim.{}; }}\n", x, x);
             stream_.fmt("__device__ inline int gridDim_{}() {{ return gridDim.{}; }}\n", x, x);
         }
+        stream_.endl();
+    }
+
+    return use_channels;
+}
+
+/// Writes @p function preceded by those of its declarations that have not been written before.
+void CCodeGen::emit_function(const Function& function) {
+    auto emit = [&] (const std::vector<Decl>& decls) {
+        for (auto& decl : decls) {
+            if (declared_.emplace(decl.key).second)
+                stream_ << decl.text;
+        }
+    };
+
+    emit(function.type_decls);
+
+    if (std::any_of(function.func_decls.begin(), function.func_decls.end(), [&] (const Decl& decl) { return declared_.count(decl.key) == 0; })) {
+        // For Xilinx hardware, we have to ifdef the function declarations away
+        // In CL mode we don't want them at all, for HLS we only want them when doing simulations and not for synthesis
+        if (lang_ == Lang::OpenCL)
+            stream_ << "#ifndef __xilinx__\n";
+        else if (lang_ == Lang::HLS)
+            stream_ << "#ifndef __SYNTHESIS__\n";
+
+        emit(function.func_decls);
+
+        if (lang_ == Lang::OpenCL)
+            stream_ << "#endif /* __xilinx__ */\n";
+        else if (lang_ == Lang::HLS)
+            stream_ << "#endif /* __SYNTHESIS__ */\n";
     }
 
-    stream_.endl() << func_impls_.str();
+    emit(function.vars_decls);
+    stream_ << function.impl;
 
-    if (lang_ == Lang::CUDA || lang_ == Lang::HLS)
-        stream_.fmt("}} /* extern \"C\" */\n");
+    for (auto& warning : function.warnings)
+        world().log(LogLevel::Warn, warning.loc, "{}", warning.text);
 }
 
 static inline bool is_passed_via_buffer(const Param* param) {
@@ -524,19 +1049,6 @@ static inline bool is_passed_via_buffer(const Param* param) {
         || param->type()->isa<TupleType>();
 }
 
-static inline const Type* ret_type(const FnType* fn_type) {
-    auto ret_fn_type = (*std::find_if(
-        fn_type->ops().begin(), fn_type->ops().end(), [] (const Type* op) {
-            return op->order() % 2 == 1;
-        }))->as<FnType>();
-    std::vector<const Type*> types;
-    for (auto op : ret_fn_type->ops()) {
-        if (op->isa<MemType>() || is_type_unit(op) || op->order() > 0) continue;
-        types.push_back(op);
-    }
-    return fn_type->table().tuple_type(types);
-}
-
 static inline const Type* pointee_or_elem_type(const PtrType* ptr_type) {
     auto elem_type = ptr_type->as<PtrType>()->pointee();
     if (auto array_type = elem_type->isa<ArrayType>())
@@ -597,7 +1109,7 @@ std::string CCodeGen::prepare(const Scope& scope) {
                 }
             } else {
                 interface = HlsInterface::None;
-                world().WLOG("HLS accelerator generated with no interface");
+                warn(scope.entry(), "HLS accelerator generated with no interface");
             }
             func_impls_ << "#pragma HLS top name = hls_top\n";
             if (use_channels_)
@@ -646,24 +1158,6 @@ void CCodeGen::prepare(Continuation* cont, const std::string&) {
     }
 }
 
-static inline std::string make_identifier(const std::string& str) {
-    auto copy = str;
-    // Transform non-alphanumeric characters
-    std::transform(copy.begin(), copy.end(), copy.begin(), [] (auto c) {
-        if (c == '*') return 'p';
-        if (!std::isalnum(c)) return '_';
-        return c;
-    });
-    // First character must be a letter or '_'
-    if (!std::isalpha(copy[0]) && copy[0] != '_')
-        copy.insert(copy.begin(), '_');
-    return copy;
-}
-
-static inline std::string label_name(const Def* def) {
-    return make_identifier(def->as_nom<Continuation>()->unique_name());
-}
-
 void CCodeGen::finalize(const Scope&) {
     for (auto& def : func_defs_) {
         assert(defs_.contains(def) && "sanity check, should have been emitted if it's here");
@@ -671,6 +1165,18 @@ void CCodeGen::finalize(const Scope&) {
     }
     func_defs_.clear();
     func_impls_.fmt("}}\n\n");
+    cont2bb_.clear();
+
+    Function function{std::move(type_decls_), std::move(func_decls_), std::move(vars_decls_), func_impls_.str(), std::move(func_warnings_)};
+    type_decls_.clear();
+    func_decls_.clear();
+    vars_decls_.clear();
+    func_warnings_.clear();
+    func_impls_.clear();
+    if (functions_)
+        functions_->push_back(std::move(function));
+    else
+        emit_function(function);
 }
 
 void CCodeGen::finalize(Continuation* cont) {
@@ -704,7 +1210,7 @@ void CCodeGen::emit_epilogue(Continuation* cont) {
             case 0: bb.tail.fmt(lang_ == Lang::HLS ? "return void();" : "return;"); break;
             case 1: bb.tail.fmt("return {};", values[0]); break;
             default:
-                auto tuple = convert(world().tuple_type(types));
+                auto tuple = convert(locked([&] { return world().tuple_type(types); }));
                 bb.tail.fmt("{} ret_val;\n", tuple);
                 for (size_t i = 0, e = types.size(); i != e; ++i)
                     bb.tail.fmt("ret_val.e{} = {};\n", i, values[i]);
@@ -860,7 +1366,7 @@ void CCodeGen::emit_epilogue(Continuation* cont) {
         }
 
         // Do not store the result of `void` calls
-        auto ret_type = thorin::c::ret_type(callee->type());
+        auto ret_type = locked([&] { return thorin::c::ret_type(callee->type()); });
         if (!is_type_unit(ret_type) && !channel_transaction)
             bb.tail.fmt("{} ret_val = ", convert(ret_type));
 
@@ -939,6 +1445,8 @@ void CCodeGen::emit_access(Stream& s, const Type* agg_type, const Def* index, co
         s.fmt("{}e{}", prefix, emit_constant(index));
     } else if (agg_type->isa<StructType>()) {
         s.fmt("{}{}", prefix, agg_type->as<StructType>()->op_name(primlit_value<size_t>(index)));
+    } else if (agg_type->isa<VectorType>() && lang_ != Lang::OpenCL) {
+        s.fmt("[{}]", emit(index)); // GCC vector extensions
     } else if (agg_type->isa<VectorType>()) {
         std::ostringstream os;
         // OpenCL indices must be in hex format
@@ -997,7 +1505,17 @@ std::string CCodeGen::emit_def(BB* bb, const Def* def) {
                 case ArithOp_shr: op = ">>"; break;
             }
         }
-        s.fmt("({} {} {})", emit_unsafe(bin->lhs()), op, emit_unsafe(bin->rhs()));
+        auto lhs = emit_unsafe(bin->lhs()), rhs = emit_unsafe(bin->rhs());
+        auto operand_type = bin->lhs()->type()->isa<PrimType>();
+        if (bin->isa<Cmp>() && operand_type && operand_type->is_vector() && !is_type_bool(operand_type) && num_bits(operand_type->primtype_tag()) != 32) {
+            // vector comparisons yield lanes as wide as their operands - bring them to the width of the mask type
+            if (lang_ == Lang::OpenCL)
+                s.fmt("convert_int{}({} {} {})", operand_type->length(), lhs, op, rhs);
+            else
+                s.fmt("__builtin_convertvector({} {} {}, {})", lhs, op, rhs, convert(bin->type()));
+        } else {
+            s.fmt("({} {} {})", lhs, op, rhs);
+        }
     } else if (auto mathop = def->isa<MathOp>()) {
         use_math_ = true;
         auto make_key = [] (MathOpTag tag, unsigned bitwidth) { return (static_cast<unsigned>(tag) << 16) | bitwidth; };
@@ -1081,7 +1599,7 @@ std::string CCodeGen::emit_def(BB* bb, const Def* def) {
         } else THORIN_UNREACHABLE;
     } else if (auto align_of = def->isa<AlignOf>()) {
         if (lang_ == Lang::C99 || lang_ == Lang::OpenCL) {
-            world().wdef(def, "alignof() is only available in C11");
+            warn(def, "alignof() is only available in C11");
             use_align_of_ = true;
         }
         return "alignof(" + convert(align_of->of()) + ")";
@@ -1093,22 +1611,32 @@ std::string CCodeGen::emit_def(BB* bb, const Def* def) {
         func_defs_.insert(def);
         return name;
     } else if (def->isa<Aggregate>()) {
+        // a true lane of a mask has all bits set, as if it came from a vector comparison
+        auto is_mask = def->isa<Vector>() && is_type_bool(def->type());
+        auto emit_lane = [&] (const std::string& op) { return is_mask ? "-(" + op + ")" : op; };
         if (bb) {
             func_impls_.fmt("{} {};\n", convert(def->type()), name);
             func_defs_.insert(def);
             for (size_t i = 0, n = def->num_ops(); i < n; ++i) {
                 auto op = emit_unsafe(def->op(i));
                 bb->body << name;
-                emit_access(bb->body, def->type(), world().literal(thorin::pu64{i}));
-                bb->body.fmt(" = {};\n", op);
+                emit_access(bb->body, def->type(), locked([&] { return world().literal(thorin::pu64{i}); }));
+                bb->body.fmt(" = {};\n", emit_lane(op));
             }
             return name;
         } else {
             auto is_array = def->isa<DefiniteArray>();
-            s.fmt("{} ", constructor_prefix(def->type()));
-            s.fmt(is_array ? "{{ {{ " : "{{ ");
-            s.range(def->ops(), ", ", [&] (const Def* op) { s << emit_constant(op); });
-            s.fmt(is_array ? " }} }}" : " }}");
+            if (def->isa<Vector>() && lang_ == Lang::OpenCL) {
+                // OpenCL vector literal
+                s.fmt("({})(", convert(def->type()));
+                s.range(def->ops(), ", ", [&] (const Def* op) { s << emit_lane(emit_constant(op)); });
+                s.fmt(")");
+            } else {
+                s.fmt("{} ", constructor_prefix(def->type()));
+                s.fmt(is_array ? "{{ {{ " : "{{ ");
+                s.range(def->ops(), ", ", [&] (const Def* op) { s << emit_lane(emit_constant(op)); });
+                s.fmt(is_array ? " }} }}" : " }}");
+            }
         }
     } else if (auto agg_op = def->isa<AggOp>()) {
         if (auto agg = emit_unsafe(agg_op->agg()); !agg.empty()) {
@@ -1179,7 +1707,7 @@ std::string CCodeGen::emit_def(BB* bb, const Def* def) {
                 if (auto value = emit_constant(variant->value()); !value.empty()) // TODO what exactly does the value.empty() case represent and why do we emit bottom instead ?
                     s.fmt("{{ {{ {} }}, ", value);
                 else
-                    s.fmt("{{ {{ {} }}, ", emit_constant(world().bottom(variant->value()->type())));
+                    s.fmt("{{ {{ {} }}, ", emit_constant(locked([&] { return world().bottom(variant->value()->type()); })));
             }
             s.fmt("{} }}", variant->index());
         }
@@ -1191,7 +1719,7 @@ std::string CCodeGen::emit_def(BB* bb, const Def* def) {
     } else if (auto load = def->isa<Load>()) {
         emit_unsafe(load->mem());
         auto ptr = emit(load->ptr());
-        emitted_type = load->out_val()->type();
+        emitted_type = load->out_val_type();
         s.fmt("*{}", ptr);
     } else if (auto store = def->isa<Store>()) {
         // TODO: IndefiniteArray should be removed
@@ -1240,7 +1768,7 @@ std::string CCodeGen::emit_def(BB* bb, const Def* def) {
     } else if (auto ass = def->isa<Assembly>()) {
         assert(bb && "basic block is required for asm");
         if (ass->is_alignstack() || ass->is_inteldialect())
-            world().wdef(ass, "stack alignment and inteldialect flags unsupported for C output");
+            warn(ass, "stack alignment and inteldialect flags unsupported for C output");
 
         emit_unsafe(ass->mem());
         size_t num_inputs = ass->num_inputs();
@@ -1251,11 +1779,12 @@ std::string CCodeGen::emit_def(BB* bb, const Def* def) {
         std::vector<std::string> outputs;
         if (auto tup = ass->type()->isa<TupleType>()) {
             for (size_t i = 1, e = tup->num_ops(); i != e; ++i) {
-                auto name = ass->out(i)->unique_name();
+                auto out = locked([&] { return ass->out(i); });
+                auto name = out->unique_name();
                 func_impls_.fmt("{} {};\n", convert(tup->op(i)), name);
-                func_defs_.insert(ass->out(i));
+                func_defs_.insert(out);
                 outputs.emplace_back(name);
-                defs_[ass->out(i)] = name;
+                defs_[out] = name;
             }
         }
 
@@ -1299,11 +1828,20 @@ std::string CCodeGen::emit_def(BB* bb, const Def* def) {
         auto cond = emit_unsafe(select->cond());
         auto tval = emit_unsafe(select->tval());
         auto fval = emit_unsafe(select->fval());
-        s.fmt("({} ? {} : {})", cond, tval, fval);
+        auto vector_type = select->type()->isa<PrimType>();
+        if (vector_type && vector_type->is_vector() && lang_ != Lang::OpenCL) {
+            // C has no conditional operator on vectors
+            s.fmt("(({}){{ ", convert(vector_type));
+            for (size_t i = 0, e = vector_type->length(); i != e; ++i)
+                s.fmt("{}{}[{}] ? {}[{}] : {}[{}]", i == 0 ? "" : ", ", cond, i, tval, i, fval, i);
+            s.fmt(" }})");
+        } else {
+            s.fmt("({} ? {} : {})", cond, tval, fval);
+        }
     } else if (auto global = def->isa<Global>()) {
         assert(!global->init()->isa_nom<Continuation>());
         if (global->is_mutable() && lang_ != Lang::C99)
-            world().wdef(global, "{}: Global variable '{}' will not be synced with host", lang_as_string(lang_), global);
+            warn(global, "{}: Global variable '{}' will not be synced with host", lang_as_string(lang_), global);
 
         auto converted_type = convert(global->alloced_type());
 
@@ -1315,11 +1853,13 @@ std::string CCodeGen::emit_def(BB* bb, const Def* def) {
             suffix = " __attribute__((xcl_reqd_pipe_depth(32)))";
         }
 
-        vars_decls_.fmt("{}{} g_{} {}", prefix, converted_type, name, suffix);
+        StringStream decl;
+        decl.fmt("{}{} g_{} {}", prefix, converted_type, name, suffix);
         if (global->init()->isa<Bottom>())
-            vars_decls_.fmt("; // bottom\n");
+            decl.fmt("; // bottom\n");
         else
-            vars_decls_.fmt(" = {};\n", emit_constant(global->init()));
+            decl.fmt(" = {};\n", emit_constant(global->init()));
+        vars_decls_.push_back({"g_" + name, decl.str()});
         if (use_channels_)
             s.fmt("g_{}", name);
         else
@@ -1385,7 +1925,7 @@ std::string CCodeGen::emit_fun_head(Continuation* cont, bool is_proto) {
     }
 
     s.fmt("{} {}(",
-        convert(ret_type(cont->type())),
+        convert(locked([&] { return ret_type(cont->type()); })),
         !world().is_external(cont) ? cont->unique_name() : cont->name());
 
     // Emit and store all first-order params
@@ -1440,9 +1980,10 @@ std::string CCodeGen::emit_fun_head(Continuation* cont, bool is_proto) {
 }
 
 std::string CCodeGen::emit_fun_decl(Continuation* cont) {
+    auto name = !world().is_external(cont) ? cont->unique_name() : cont->name();
     if (cont->cc() != CC::Device)
-        func_decls_.fmt("{};\n", emit_fun_head(cont, true));
-    return !world().is_external(cont) ? cont->unique_name() : cont->name();
+        func_decls_.push_back({name, emit_fun_head(cont, true) + ";\n"});
+    return name;
 }
 
 Stream& CCodeGen::emit_debug_info(Stream& s, const Def* def) {
@@ -1514,12 +2055,12 @@ void CCodeGen::emit_c_int() {
                 "typedef    float f32;\n"
                 "typedef   double f64;\n\n");
 
-    if (!type_decls_.str().empty())
-        stream_.fmt("{}\n", type_decls_.str());
-    if (!func_decls_.str().empty())
-        stream_.fmt("{}\n", func_decls_.str());
-    if (!vars_decls_.str().empty())
-        stream_.fmt("{}\n", vars_decls_.str());
+    for (auto decls : { &type_decls_, &func_decls_, &vars_decls_ }) {
+        if (decls->empty()) continue;
+        for (auto& decl : *decls)
+            stream_ << decl.text;
+        stream_.endl();
+    }
 
     stream_.fmt("#ifdef __cplusplus\n");
     stream_.fmt("}}\n");
@@ -1584,9 +2125,16 @@ std::string CCodeGen::tuple_name(const TupleType* tuple_type) {
 
 //------------------------------------------------------------------------------
 
+u64 CodeGen::cache_key(u64 seed) const {
+    seed = thorin::CodeGen::cache_key(seed);
+    seed = fingerprint_mix(seed, lang_as_string(lang_));
+    seed = fingerprint_mix(seed, flags_);
+    return fingerprint_mix(seed, kernel_config_);
+}
+
 void CodeGen::emit_stream(std::ostream& stream) {
     Stream s(stream);
-    CCodeGen(world(), kernel_config_, s, lang_, debug_, flags_).emit_module();
+    CCodeGen(world(), kernel_config_, s, lang_, debug_, flags_, cache_).emit_module(num_threads_);
 }
 
 void emit_c_int(World& world, Stream& stream) {
@@ -8,6 +8,7 @@
 
 namespace thorin {
 
+class CompilationCache;
 class World;
 
 namespace c {
@@ -16,15 +17,20 @@ enum class Lang : uint8_t { C99, HLS, CUDA, OpenCL };
 
 class CodeGen : public thorin::CodeGen {
 public:
-    CodeGen(World& world, const Cont2Config& kernel_config, Lang lang, bool debug, std::string& flags)
+    /// With @p num_threads > 1, the functions are emitted in parallel; the output is the same for any number of threads.
+    /// With a @p cache, the functions of @p Scope%s that have not changed since they were stored there are not emitted again.
+    CodeGen(World& world, const Cont2Config& kernel_config, Lang lang, bool debug, std::string& flags, size_t num_threads = 1, CompilationCache* cache = nullptr)
         : thorin::CodeGen(world, debug)
         , kernel_config_(kernel_config)
         , lang_(lang)
         , debug_(debug)
         , flags_(flags)
+        , num_threads_(num_threads)
+        , cache_(cache)
     {}
 
     void emit_stream(std::ostream& stream) override;
+    u64 cache_key(u64 seed) const override;
 
     const char* file_ext() const override {
         switch (lang_) {
@@ -41,6 +47,8 @@ private:
     Lang lang_;
     bool debug_;
     std::string flags_;
+    size_t num_threads_;
+    CompilationCache* cache_;
 };
 
 void emit_c_int(World&, Stream& stream);
@@ -0,0 +1,59 @@
+#include "thorin/be/cache.h"
+
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+#include "thorin/be/codegen.h"
+#include "thorin/analyses/fingerprint.h"
+
+namespace thorin {
+
+CompilationCache::CompilationCache(std::string directory)
+    : directory_(std::move(directory))
+{
+    std::error_code error;
+    std::filesystem::create_directories(directory_, error);
+}
+
+std::string CompilationCache::path(u64 key, const char* ext) const {
+    std::ostringstream name;
+    name << std::hex << key << ext;
+    return (std::filesystem::path(directory_) / name.str()).string();
+}
+
+std::optional<std::string> CompilationCache::lookup(u64 key, const char* ext) const {
+    std::ifstream file(path(key, ext), std::ios::binary);
+    if (!file)
+        return std::nullopt;
+    std::ostringstream code;
+    code << file.rdbuf();
+    return code.str();
+}
+
+void CompilationCache::store(u64 key, const char* ext, const std::string& code) const {
+    // write to a temporary first so that concurrent builds never see half an entry
+    auto file = path(key, ext), tmp = file + ".tmp";
+    {
+        std::ofstream stream(tmp, std::ios::binary);
+        if (!stream.write(code.data(), code.size()))
+            return;
+    }
+    std::error_code error;
+    std::filesystem::rename(tmp, file, error);
+}
+
+std::string CompilationCache::emit(CodeGen& cg, u64 key) {
+    if (auto code = lookup(key, cg.file_ext()))
+        return *code;
+
+    std::ostringstream stream;
+    cg.emit_stream(stream);
+    auto code = stream.str();
+    store(key, cg.file_ext(), code);
+    return code;
+}
+
+std::string CompilationCache::emit(CodeGen& cg) { return emit(cg, cg.cache_key(fingerprint(cg.world()))); }
+
+}
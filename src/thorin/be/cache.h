@@ -0,0 +1,39 @@
+#ifndef THORIN_BE_CACHE_H
+#define THORIN_BE_CACHE_H
+
+#include <optional>
+#include <string>
+
+#include "thorin/util/types.h"
+
+namespace thorin {
+
+class CodeGen;
+
+/**
+ * On-disk store for generated code keyed by a @p fingerprint of the @p World or @p Scope it was generated from.
+ * Each entry is the file <tt>directory/<fingerprint><ext></tt>, where @c ext is the @p CodeGen::file_ext of the backend that produced it,
+ * so LLVM, C, CUDA, and OpenCL code for the same program live next to each other.
+ * Mix everything else that influences the generated code - optimization level, target, flags - into the key; @p CodeGen::cache_key does so for a whole module.
+ */
+class CompilationCache {
+public:
+    explicit CompilationCache(std::string directory);
+
+    std::optional<std::string> lookup(u64 key, const char* ext) const;
+    void store(u64 key, const char* ext, const std::string& code) const;
+
+    /// Returns the code @p cg generates for its @p World, running @p cg only if there is no entry for @p key yet.
+    std::string emit(CodeGen& cg, u64 key);
+    /// As above but keyed by the @p fingerprint of the @p World of @p cg mixed with the settings of @p cg - see @p CodeGen::cache_key.
+    std::string emit(CodeGen& cg);
+
+private:
+    std::string path(u64 key, const char* ext) const;
+
+    std::string directory_;
+};
+
+}
+
+#endif
@@ -1,5 +1,11 @@
 #include "thorin/be/codegen.h"
+
+#include <algorithm>
+
+#include "thorin/analyses/alias.h"
+#include "thorin/analyses/fingerprint.h"
 #include "thorin/analyses/scope.h"
+#include "thorin/be/tuning.h"
 #include "thorin/transform/hls_channels.h"
 #include "thorin/transform/hls_kernel_launch.h"
 
@@ -12,6 +18,34 @@
 
 namespace thorin {
 
+u64 CodeGen::cache_key(u64 seed) const { return fingerprint_mix(seed, u64(debug_)); }
+
+u64 fingerprint_mix(u64 seed, const Continuation* cont, const KernelConfig& config) {
+    if (auto gpu_config = config.isa<GPUKernelConfig>()) {
+        auto [x, y, z] = gpu_config->block_size();
+        seed = fingerprint_mix(seed, u64(x));
+        seed = fingerprint_mix(seed, u64(y));
+        seed = fingerprint_mix(seed, u64(z));
+        seed = fingerprint_mix(seed, u64(gpu_config->has_restrict()));
+    } else if (auto hls_config = config.isa<HLSKernelConfig>()) {
+        for (auto param : cont->params())
+            seed = fingerprint_mix(seed, u64(hls_config->param_size(param)));
+    }
+    return seed;
+}
+
+u64 fingerprint_mix(u64 seed, const Cont2Config& configs) {
+    std::vector<std::pair<const Continuation*, const KernelConfig*>> sorted;
+    for (auto& [cont, config] : configs)
+        sorted.emplace_back(cont, config.get());
+    std::sort(sorted.begin(), sorted.end(), [] (auto a, auto b) { return a.first->name() < b.first->name(); });
+    for (auto [cont, config] : sorted) {
+        seed = fingerprint_mix(seed, cont->name());
+        seed = fingerprint_mix(seed, cont, *config);
+    }
+    return seed;
+}
+
 static void get_kernel_configs(
     Importer& importer,
     const std::vector<Continuation*>& kernels,
@@ -58,8 +92,7 @@ static const App* get_alloc_call(const Def* def) {
         auto call = use.def()->isa<App>();
         if (!call || use.index() == 0) continue;
 
-        auto callee = call->callee();
-        if (callee->name() != "anydsl_alloc") continue;
+        if (!is_allocation_function(call->callee())) continue;
 
         return call;
     }
@@ -75,9 +108,27 @@ static uint64_t get_alloc_size(const Def* def) {
     return size ? static_cast<uint64_t>(size->value().get_qu64()) : 0_u64;
 }
 
-DeviceBackends::DeviceBackends(World& world, int opt, bool debug, std::string& flags)
+DeviceBackends::DeviceBackends(World& world, int opt, bool debug, std::string& flags, const TuningDB* tuning)
     : cgs {}
 {
+    if (tuning) {
+        std::vector<std::pair<Continuation*, const LaunchConfig*>> tuned;
+        Scope::for_each(world, [&] (const Scope& scope) {
+            if (!is_passed_to_accelerator(scope.entry())) return;
+            if (auto config = tuning->lookup(fingerprint(scope)))
+                tuned.emplace_back(scope.entry(), config);
+        });
+
+        // the kernel is unrolled before it is imported below; launches with a configuration that is only known at run time use the tuned one instead
+        bool unrolled = false;
+        for (auto [continuation, config] : tuned) {
+            unrolled |= specialize_loops(continuation, *config);
+            specialize_launches(continuation, *config);
+        }
+        if (unrolled)
+            world.cleanup();
+    }
+
     for (size_t i = 0; i < cgs.size(); ++i)
         importers_.emplace_back(world);
 
@@ -116,16 +167,18 @@ DeviceBackends::DeviceBackends(World& world, int opt, bool debug, std::string& f
         if (!importers_[backend].world().empty()) {
             get_kernel_configs(importers_[backend], kernels, kernel_config, [&](Continuation *use, Continuation * /* imported */) {
                 auto app = use->body();
-                // determine whether or not this kernel uses restrict pointers
+                // determine whether or not this kernel uses restrict pointers:
+                // all pointer arguments must point to distinct allocations
                 bool has_restrict = true;
-                DefSet allocs;
+                AliasAnalysis alias;
+                std::vector<const Def*> ptrs;
                 for (size_t i = LaunchArgs::Num, e = app->num_args(); has_restrict && i != e; ++i) {
                     auto arg = app->arg(i);
                     if (!arg->type()->isa<PtrType>()) continue;
-                    auto alloc = get_alloc_call(arg);
-                    if (!alloc) has_restrict = false;
-                    auto p = allocs.insert(alloc);
-                    has_restrict &= p.second;
+                    has_restrict &= AliasAnalysis::is_identified_object(alias.location(arg).base);
+                    for (auto ptr : ptrs)
+                        has_restrict &= alias.no_alias(ptr, arg);
+                    ptrs.push_back(arg);
                 }
 
                 auto it_config = app->arg(LaunchArgs::Config)->as<Tuple>();
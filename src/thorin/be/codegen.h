@@ -14,6 +14,8 @@ public:
 
     virtual void emit_stream(std::ostream& stream) = 0;
     virtual const char* file_ext() const = 0;
+    /// Mixes everything into @p seed that influences the generated code besides the @p World itself - @p CompilationCache::emit keys its entries with this.
+    virtual u64 cache_key(u64 seed) const;
 
     /// @name getters
     //@{
@@ -38,8 +40,16 @@ struct LaunchArgs {
     };
 };
 
+class TuningDB;
+
+/// Mixes the settings @p config has for @p cont into @p seed.
+u64 fingerprint_mix(u64 seed, const Continuation* cont, const KernelConfig& config);
+/// Mixes all of @p configs into @p seed - in the order of the names of their continuations, which are unique as these are externals.
+u64 fingerprint_mix(u64 seed, const Cont2Config& configs);
+
 struct DeviceBackends {
-    DeviceBackends(World& world, int opt, bool debug, std::string& hls_flags);
+    /// Launches of kernels that have an entry in @p tuning use the tuned @p LaunchConfig as far as @p specialize_launches allows.
+    DeviceBackends(World& world, int opt, bool debug, std::string& hls_flags, const TuningDB* tuning = nullptr);
 
     Cont2Config kernel_config;
     std::vector<Continuation*> kernels;
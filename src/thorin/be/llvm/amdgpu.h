@@ -16,6 +16,7 @@ public:
     AMDGPUCodeGen(World& world, const Cont2Config&, int opt, bool debug);
 
     const char* file_ext() const override { return ".amdgpu"; }
+    u64 cache_key(u64 seed) const override { return fingerprint_mix(CodeGen::cache_key(seed), kernel_config_); }
 
 protected:
     void emit_fun_decl_hook(Continuation*, llvm::Function*) override;
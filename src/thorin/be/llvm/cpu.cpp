@@ -1,17 +1,23 @@
 #include "thorin/be/llvm/cpu.h"
 
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/Bitcode/BitcodeWriter.h>
+#include <llvm/IR/LegacyPassManager.h>
 #include <llvm/MC/TargetRegistry.h>
 #include <llvm/Support/Host.h>
 #include <llvm/Support/TargetSelect.h>
 #include <llvm/Target/TargetMachine.h>
+#include <llvm/Support/raw_os_ostream.h>
 #include <llvm/Target/TargetOptions.h>
 
 namespace thorin::llvm {
 
-CPUCodeGen::CPUCodeGen(World& world, int opt, bool debug, std::string& target_triple, std::string& target_cpu, std::string& target_attr)
+CPUCodeGen::CPUCodeGen(World& world, int opt, bool debug, std::string& target_triple, std::string& target_cpu, std::string& target_attr, Output output)
     : CodeGen(world, llvm::CallingConv::C, llvm::CallingConv::C, llvm::CallingConv::C, opt, debug)
+    , output_(output)
 {
     llvm::InitializeNativeTarget();
+    llvm::InitializeNativeTargetAsmPrinter();
     auto triple_str = llvm::sys::getDefaultTargetTriple();
     auto cpu_str    = llvm::sys::getHostCPUName();
     std::string features_str;
@@ -23,6 +29,7 @@ CPUCodeGen::CPUCodeGen(World& world, int opt, bool debug, std::string& target_tr
     if (!target_triple.empty() && !target_cpu.empty()) {
         llvm::InitializeAllTargets();
         llvm::InitializeAllTargetMCs();
+        llvm::InitializeAllAsmPrinters();
         triple_str   = target_triple;
         cpu_str      = target_cpu;
         features_str = target_attr;
@@ -37,4 +44,43 @@ CPUCodeGen::CPUCodeGen(World& world, int opt, bool debug, std::string& target_tr
     module().setTargetTriple(triple_str);
 }
 
+const char* CPUCodeGen::file_ext() const {
+    switch (output_) {
+        case Output::IR:       return ".ll";
+        case Output::Bitcode:  return ".bc";
+        case Output::Assembly: return ".s";
+        case Output::Object:   return ".o";
+        default:               THORIN_UNREACHABLE;
+    }
+}
+
+void CPUCodeGen::emit_stream(std::ostream& stream) {
+    if (output_ == Output::IR)
+        return CodeGen::emit_stream(stream);
+    auto [context, module] = emit_module();
+    emit_file(*module, stream, output_);
+}
+
+void CPUCodeGen::emit_file(llvm::Module& module, std::ostream& stream, Output output) {
+    if (output == Output::IR) {
+        llvm::raw_os_ostream llvm_stream(stream);
+        module.print(llvm_stream, nullptr);
+        return;
+    }
+
+    // object files need a seekable stream, so everything goes through a buffer first
+    llvm::SmallVector<char, 0> buffer;
+    llvm::raw_svector_ostream llvm_stream(buffer);
+    if (output == Output::Bitcode) {
+        llvm::WriteBitcodeToFile(module, llvm_stream);
+    } else {
+        llvm::legacy::PassManager pass_manager;
+        auto file_type = output == Output::Assembly ? llvm::CGFT_AssemblyFile : llvm::CGFT_ObjectFile;
+        if (machine().addPassesToEmitFile(pass_manager, llvm_stream, nullptr, file_type))
+            world().error(Loc(), "target machine '{}' can't emit this file type", machine().getTargetTriple().str());
+        pass_manager.run(module);
+    }
+    stream.write(buffer.data(), buffer.size());
+}
+
 }
@@ -9,10 +9,28 @@ namespace llvm = ::llvm;
 
 class CPUCodeGen : public CodeGen {
 public:
-    CPUCodeGen(World& world, int opt, bool debug, std::string& target_triple, std::string& target_cpu, std::string& target_attr);
+    /// What @p emit_stream writes.
+    enum class Output {
+        IR,       ///< textual LLVM IR
+        Bitcode,  ///< LLVM bitcode
+        Assembly, ///< native assembly for the target machine
+        Object    ///< native object file for the target machine
+    };
+
+    CPUCodeGen(World& world, int opt, bool debug, std::string& target_triple, std::string& target_cpu, std::string& target_attr, Output output = Output::IR);
+
+    const char* file_ext() const override;
+    void emit_stream(std::ostream& stream) override;
+    /// Writes an already optimized @p module - e.g. one of the results of @p emit_partitioned - in the given @p output format.
+    void emit_file(llvm::Module& module, std::ostream& stream, Output output);
+
+    Output output() const { return output_; }
 
 protected:
     std::string get_alloc_name() const override { return "anydsl_alloc"; }
+
+private:
+    Output output_;
 };
 
 }
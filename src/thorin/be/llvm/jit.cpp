@@ -0,0 +1,156 @@
+#include "thorin/be/llvm/jit.h"
+
+#include <llvm/ADT/SmallString.h>
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/ADT/StringExtras.h>
+#include <llvm/Bitcode/BitcodeWriter.h>
+#include <llvm/ExecutionEngine/Orc/CompileUtils.h>
+#include <llvm/ExecutionEngine/Orc/ExecutionUtils.h>
+#include <llvm/ExecutionEngine/Orc/LLJIT.h>
+#include <llvm/ExecutionEngine/Orc/ThreadSafeModule.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/Path.h>
+#include <llvm/Support/TargetSelect.h>
+#include <llvm/Support/raw_ostream.h>
+#include <llvm/Support/xxhash.h>
+
+namespace thorin::llvm {
+
+/*
+ * JITCache
+ */
+
+uint64_t JITCache::hash(const llvm::Module& module) {
+    llvm::SmallVector<char, 0> buffer;
+    llvm::raw_svector_ostream stream(buffer);
+    llvm::WriteBitcodeToFile(module, stream);
+    return llvm::xxHash64(llvm::StringRef(buffer.data(), buffer.size()));
+}
+
+std::string JITCache::path(uint64_t hash) const {
+    llvm::SmallString<128> path(directory_);
+    llvm::sys::path::append(path, llvm::utohexstr(hash) + ".o");
+    return std::string(path);
+}
+
+std::unique_ptr<llvm::MemoryBuffer> JITCache::getObject(const llvm::Module* module) {
+    auto key = hash(*module);
+    std::lock_guard lock(mutex_);
+    pending_[module] = key;
+
+    auto i = objects_.find(key);
+    if (i == objects_.end() && !directory_.empty()) {
+        if (auto buffer = llvm::MemoryBuffer::getFile(path(key)))
+            i = objects_.emplace(key, std::move(*buffer)).first;
+    }
+    if (i == objects_.end())
+        return nullptr;
+    return llvm::MemoryBuffer::getMemBuffer(i->second->getMemBufferRef(), false);
+}
+
+void JITCache::notifyObjectCompiled(const llvm::Module* module, llvm::MemoryBufferRef object) {
+    std::lock_guard lock(mutex_);
+    auto i = pending_.find(module);
+    auto key = i != pending_.end() ? i->second : hash(*module);
+    if (i != pending_.end())
+        pending_.erase(i);
+    objects_[key] = llvm::MemoryBuffer::getMemBufferCopy(object.getBuffer(), object.getBufferIdentifier());
+
+    if (!directory_.empty()) {
+        // write to a temporary first so that concurrent processes never see half an object
+        auto file = path(key), tmp = file + ".tmp";
+        std::error_code error;
+        {
+            llvm::raw_fd_ostream stream(tmp, error, llvm::sys::fs::OF_None);
+            if (!error)
+                stream << object.getBuffer();
+        }
+        if (!error)
+            llvm::sys::fs::rename(tmp, file);
+    }
+}
+
+/*
+ * JIT
+ */
+
+/// Asks the SymbolResolver of the JIT for symbols that are not defined by any of its modules.
+class RuntimeGenerator : public llvm::orc::DefinitionGenerator {
+public:
+    RuntimeGenerator(JIT::SymbolResolver resolver, char prefix)
+        : resolver_(std::move(resolver))
+        , prefix_(prefix)
+    {}
+
+    llvm::Error tryToGenerate(llvm::orc::LookupState&, llvm::orc::LookupKind, llvm::orc::JITDylib& dylib,
+                              llvm::orc::JITDylibLookupFlags, const llvm::orc::SymbolLookupSet& symbols) override {
+        llvm::orc::SymbolMap found;
+        for (auto& [name, _] : symbols) {
+            auto str = (*name).str();
+            if (prefix_ != '\0' && !str.empty() && str.front() == prefix_)
+                str.erase(0, 1);
+            if (auto ptr = resolver_(str))
+                found[name] = llvm::JITEvaluatedSymbol(llvm::pointerToJITTargetAddress(ptr), llvm::JITSymbolFlags::Exported);
+        }
+        if (found.empty())
+            return llvm::Error::success();
+        return dylib.define(llvm::orc::absoluteSymbols(std::move(found)));
+    }
+
+private:
+    JIT::SymbolResolver resolver_;
+    char prefix_;
+};
+
+JIT::JIT(SymbolResolver resolver, bool lazy, std::shared_ptr<JITCache> cache)
+    : cache_(std::move(cache))
+{
+    llvm::InitializeNativeTarget();
+    llvm::InitializeNativeTargetAsmPrinter();
+
+    auto compiler = [cache = cache_.get()] (llvm::orc::JITTargetMachineBuilder builder)
+        -> llvm::Expected<std::unique_ptr<llvm::orc::IRCompileLayer::IRCompiler>> {
+        auto machine = builder.createTargetMachine();
+        if (!machine)
+            return machine.takeError();
+        return std::make_unique<llvm::orc::TMOwningSimpleCompiler>(std::move(*machine), cache);
+    };
+
+    if (lazy) {
+        auto jit = llvm::cantFail(llvm::orc::LLLazyJITBuilder().setCompileFunctionCreator(compiler).create());
+        lazy_ = jit.get();
+        jit_ = std::move(jit);
+    } else {
+        jit_ = llvm::cantFail(llvm::orc::LLJITBuilder().setCompileFunctionCreator(compiler).create());
+    }
+
+    auto prefix = jit_->getDataLayout().getGlobalPrefix();
+    auto& dylib = jit_->getMainJITDylib();
+    if (resolver)
+        dylib.addGenerator(std::make_unique<RuntimeGenerator>(std::move(resolver), prefix));
+    dylib.addGenerator(llvm::cantFail(llvm::orc::DynamicLibrarySearchGenerator::GetForCurrentProcess(prefix)));
+}
+
+JIT::~JIT() {}
+
+void JIT::add(ContextModule module) {
+    auto& [context, llvm_module] = module;
+    if (llvm_module->getDataLayout().isDefault())
+        llvm_module->setDataLayout(jit_->getDataLayout());
+
+    llvm::orc::ThreadSafeModule thread_safe_module(std::move(llvm_module), std::move(context));
+    auto error = lazy_ ? lazy_->addLazyIRModule(std::move(thread_safe_module)) : jit_->addIRModule(std::move(thread_safe_module));
+    if (error)
+        llvm::report_fatal_error(std::move(error));
+}
+
+void* JIT::lookup(const std::string& name) {
+    auto symbol = jit_->lookup(name);
+    if (!symbol) {
+        llvm::consumeError(symbol.takeError());
+        return nullptr;
+    }
+    return symbol->toPtr<void*>();
+}
+
+}
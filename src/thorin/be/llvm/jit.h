@@ -0,0 +1,79 @@
+#ifndef THORIN_BE_LLVM_JIT_H
+#define THORIN_BE_LLVM_JIT_H
+
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include <llvm/ExecutionEngine/ObjectCache.h>
+#include <llvm/Support/MemoryBuffer.h>
+
+#include "thorin/be/llvm/llvm.h"
+
+namespace llvm::orc {
+class LLJIT;
+class LLLazyJIT;
+}
+
+namespace thorin::llvm {
+
+namespace llvm = ::llvm;
+
+/**
+ * Keeps the native code compiled by a @p JIT, keyed by a hash of the module it was compiled from.
+ * Share one cache between several @p JIT%s to avoid recompiling identical modules.
+ * If a @p directory is given, compiled objects are also stored there and reused by later processes.
+ */
+class JITCache : public llvm::ObjectCache {
+public:
+    explicit JITCache(std::string directory = {})
+        : directory_(std::move(directory))
+    {}
+
+    void notifyObjectCompiled(const llvm::Module*, llvm::MemoryBufferRef) override;
+    std::unique_ptr<llvm::MemoryBuffer> getObject(const llvm::Module*) override;
+
+    static uint64_t hash(const llvm::Module&);
+
+private:
+    std::string path(uint64_t hash) const;
+
+    std::string directory_;
+    std::mutex mutex_;
+    std::unordered_map<const llvm::Module*, uint64_t> pending_;
+    std::unordered_map<uint64_t, std::unique_ptr<llvm::MemoryBuffer>> objects_;
+};
+
+/**
+ * Executes the modules of the CPU backend in-process through ORC.
+ * Feed it with the result of @p CodeGen::emit_module (or each of @p CodeGen::emit_partitioned) and @p lookup the externals afterwards.
+ */
+class JIT {
+public:
+    /**
+     * Returns the address of a symbol the modules import - usually one of the @c anydsl_* runtime functions.
+     * @c nullptr falls back to the symbols of the current process.
+     */
+    using SymbolResolver = std::function<void*(const std::string&)>;
+
+    /// With @p lazy set, functions are only compiled when they are called for the first time.
+    JIT(SymbolResolver resolver = {}, bool lazy = false, std::shared_ptr<JITCache> cache = {});
+    ~JIT();
+
+    void add(ContextModule module);
+    /// Address of the external @p name or @c nullptr if there is no such symbol.
+    void* lookup(const std::string& name);
+    template<class F>
+    F* lookup_function(const std::string& name) { return reinterpret_cast<F*>(lookup(name)); }
+
+private:
+    std::shared_ptr<JITCache> cache_;
+    std::unique_ptr<llvm::orc::LLJIT> jit_;
+    llvm::orc::LLLazyJIT* lazy_ = nullptr;
+};
+
+}
+
+#endif
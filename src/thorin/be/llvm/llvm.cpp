@@ -2,6 +2,7 @@
 
 #include <algorithm>
 #include <stdexcept>
+#include <thread>
 #include <unordered_map> // TODO don't used std::unordered_*
 
 #include <llvm/ADT/Triple.h>
@@ -36,6 +37,7 @@
 #include "thorin/primop.h"
 #include "thorin/type.h"
 #include "thorin/world.h"
+#include "thorin/analyses/fingerprint.h"
 #include "thorin/analyses/scope.h"
 #include "thorin/util/array.h"
 
@@ -287,13 +289,40 @@ unsigned CodeGen::convert_addr_space(const AddrSpace addr_space) {
  * emit
  */
 
+u64 CodeGen::cache_key(u64 seed) const {
+    seed = thorin::CodeGen::cache_key(seed);
+    seed = fingerprint_mix(seed, u64(opt_));
+    seed = fingerprint_mix(seed, u64(function_calling_convention_));
+    seed = fingerprint_mix(seed, u64(device_calling_convention_));
+    seed = fingerprint_mix(seed, u64(kernel_calling_convention_));
+    seed = fingerprint_mix(seed, module().getTargetTriple());
+    seed = fingerprint_mix(seed, module().getDataLayoutStr());
+    if (machine_) {
+        seed = fingerprint_mix(seed, machine_->getTargetCPU().str());
+        seed = fingerprint_mix(seed, machine_->getTargetFeatureString().str());
+    }
+
+    seed = fingerprint_mix(seed, u64(parallel_schedule_.policy));
+    seed = fingerprint_mix(seed, u64(parallel_schedule_.grain));
+    // bodies are no externals - order by everything mixed in so that equal names do not matter
+    std::vector<std::tuple<std::string, int, int>> schedules;
+    for (auto& [body, schedule] : parallel_schedules_)
+        schedules.emplace_back(body->name(), schedule.policy, schedule.grain);
+    std::sort(schedules.begin(), schedules.end());
+    for (auto& [name, policy, grain] : schedules) {
+        seed = fingerprint_mix(seed, name);
+        seed = fingerprint_mix(seed, u64(policy));
+        seed = fingerprint_mix(seed, u64(grain));
+    }
+    return seed;
+}
+
 void CodeGen::emit_stream(std::ostream& stream) {
     llvm::raw_os_ostream llvm_stream(stream);
     emit_module().second->print(llvm_stream, nullptr);
 }
 
-std::pair<std::unique_ptr<llvm::LLVMContext>, std::unique_ptr<llvm::Module>>
-CodeGen::emit_module() {
+void CodeGen::begin_module() {
     if (debug()) {
         module().addModuleFlag(llvm::Module::Warning, "Debug Info Version", llvm::DEBUG_METADATA_VERSION);
         // Darwin only supports dwarf2
@@ -301,9 +330,9 @@ CodeGen::emit_module() {
             module().addModuleFlag(llvm::Module::Warning, "Dwarf Version", 2);
         dicompile_unit_ = dibuilder_.createCompileUnit(llvm::dwarf::DW_LANG_C, dibuilder_.createFile(world().name(), llvm::StringRef()), "Impala", opt() > 0, llvm::StringRef(), 0);
     }
+}
 
-    Scope::for_each(world(), [&] (const Scope& scope) { emit_scope(scope); });
-
+void CodeGen::end_module() {
     if (debug()) dibuilder_.finalize();
 
 #if THORIN_ENABLE_RV
@@ -315,16 +344,98 @@ CodeGen::emit_module() {
 #endif
 
     verify();
-    optimize();
+}
 
+ContextModule CodeGen::release_module() {
     // We need to delete the runtime at this point, since the ownership of
     // the context and module is handed away.
     runtime_.reset();
     return std::pair { std::move(context_), std::move(module_) };
 }
 
+ContextModule CodeGen::emit_module() {
+    begin_module();
+    Scope::for_each(world(), [&] (const Scope& scope) { emit_scope(scope); });
+    end_module();
+    optimize();
+    return release_module();
+}
+
+std::vector<ContextModule> CodeGen::emit_partitioned(World& world, size_t num_partitions, std::function<std::unique_ptr<CodeGen>()> make_codegen) {
+    Partitioning partitioning(world, num_partitions);
+
+    // emission reads and occasionally extends the world, so it has to happen on this thread
+    std::vector<std::unique_ptr<CodeGen>> cgs;
+    for (size_t i = 0; i != partitioning.num_partitions(); ++i) {
+        auto& cg = cgs.emplace_back(make_codegen());
+        cg->partitioning_ = &partitioning;
+        cg->partition_ = i;
+        cg->begin_module();
+        for (auto entry : partitioning.entries[i]) {
+            Scope scope(entry);
+            cg->emit_scope(scope);
+        }
+        cg->end_module();
+        cg->partitioning_ = nullptr;
+    }
+
+    // each module lives in its own context, so they can be optimized independently
+    std::vector<std::thread> threads;
+    for (auto& cg : cgs)
+        threads.emplace_back([&] { cg->optimize(); });
+    for (auto& thread : threads)
+        thread.join();
+
+    std::vector<ContextModule> result;
+    for (auto& cg : cgs)
+        result.emplace_back(cg->release_module());
+    return result;
+}
+
+Partitioning::Partitioning(World& world, size_t num_partitions)
+    : entries(std::max(num_partitions, size_t(1)))
+{
+    // greedily hand each scope to the partition with the least amount of code so far
+    std::vector<size_t> sizes(entries.size());
+    ContinuationMap<size_t> owner;
+    std::vector<std::pair<size_t, const Def*>> refs;
+    Scope::for_each(world, [&] (const Scope& scope) {
+        auto i = std::min_element(sizes.begin(), sizes.end()) - sizes.begin();
+        entries[i].push_back(scope.entry());
+        sizes[i] += scope.defs().size();
+        owner[scope.entry()] = i;
+
+        unique_queue<DefSet> queue;
+        for (auto def : scope.free())
+            queue.push(def);
+        while (!queue.empty()) {
+            auto def = queue.pop();
+            if (def->isa_nom<Continuation>()) {
+                refs.emplace_back(i, def);
+            } else {
+                if (auto global = def->isa<Global>(); global && global->is_mutable() && !global->init()->isa_nom<Continuation>())
+                    refs.emplace_back(i, global);
+                for (auto op : def->ops())
+                    queue.push(op);
+            }
+        }
+    });
+
+    DefMap<size_t> global_users;
+    for (auto [i, def] : refs) {
+        if (auto cont = def->isa_nom<Continuation>()) {
+            if (auto j = owner.lookup(cont); j && *j != i)
+                shared.emplace(cont, world.is_external(cont) ? cont->name() : cont->unique_name());
+        } else if (auto [j, inserted] = global_users.emplace(def, i); !inserted && j->second != i) {
+            // the partition that uses it first defines it
+            shared_globals[def] = j->second;
+        }
+    }
+}
+
 llvm::Function* CodeGen::emit_fun_decl(Continuation* continuation) {
-    std::string name = world().is_external(continuation) ? continuation->name() : continuation->unique_name();
+    auto shared = partitioning_ ? partitioning_->shared.lookup(continuation) : std::nullopt;
+    std::string name = shared ? *shared : world().is_external(continuation) ? continuation->name() : continuation->unique_name();
     auto f = llvm::cast<llvm::Function>(module().getOrInsertFunction(name, convert_fn_type(continuation)).getCallee()->stripPointerCasts());
     if (machine_) {
         f->addFnAttr("target-cpu", machine().getTargetCPU());
@@ -343,10 +454,15 @@ llvm::Function* CodeGen::emit_fun_decl(Continuation* continuation) {
 #endif
 
     // set linkage
-    if (world().is_external(continuation))
+    if (world().is_external(continuation)) {
         f->setLinkage(llvm::Function::ExternalLinkage);
-    else
+    } else if (shared) {
+        // called from another partition of the same program
+        f->setLinkage(llvm::Function::ExternalLinkage);
+        f->setVisibility(llvm::GlobalValue::HiddenVisibility);
+    } else {
         f->setLinkage(llvm::Function::InternalLinkage);
+    }
 
     // set calling convention
     if (continuation->is_exported()) {
@@ -985,6 +1101,12 @@ llvm::Value* CodeGen::emit_global(const Global* global) {
         auto var = llvm::cast<llvm::GlobalVariable>(module().getOrInsertGlobal(global->unique_name().c_str(), llvm_type));
         var->setConstant(!global->is_mutable());
         var->setLinkage(llvm::GlobalValue::InternalLinkage);
+        if (auto owner = partitioning_ ? partitioning_->shared_globals.lookup(global) : std::nullopt) {
+            var->setLinkage(llvm::GlobalValue::ExternalLinkage);
+            var->setVisibility(llvm::GlobalValue::HiddenVisibility);
+            if (*owner != partition_)
+                return var; // defined by another partition
+        }
         if (global->init()->isa<Bottom>())
             var->setInitializer(llvm::Constant::getNullValue(llvm_type)); // HACK
         else
@@ -1371,8 +1493,8 @@ void CodeGen::create_loop(llvm::IRBuilder<>& irbuilder, llvm::Value* lower, llvm
     // add instructions to the loop body
     fun(loop_counter);
 
-    // inc loop counter
-    loop_counter->addIncoming(irbuilder.CreateAdd(loop_counter, increment), body);
+    // inc loop counter - fun may have left the body block, e.g. for a nested loop
+    loop_counter->addIncoming(irbuilder.CreateAdd(loop_counter, increment), irbuilder.GetInsertBlock());
     irbuilder.CreateBr(head);
     irbuilder.SetInsertPoint(exit);
 }
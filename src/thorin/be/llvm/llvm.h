@@ -24,6 +24,37 @@ namespace llvm {
 namespace llvm = ::llvm;
 
 using BB = std::pair<llvm::BasicBlock*, std::unique_ptr<llvm::IRBuilder<>>>;
+using ContextModule = std::pair<std::unique_ptr<llvm::LLVMContext>, std::unique_ptr<llvm::Module>>;
+
+/**
+ * Distribution of the top-level @p Scope%s of a @p World over independent LLVM modules.
+ * The assignment only depends on the @p World - not on the machine or on thread timing - so the emitted modules are reproducible.
+ */
+struct Partitioning {
+    Partitioning(World&, size_t num_partitions);
+
+    size_t num_partitions() const { return entries.size(); }
+
+    /// The entries of the @p Scope%s emitted into each partition.
+    std::vector<std::vector<Continuation*>> entries;
+    /// Continuations called from another partition than their own and the symbol name they are linked under.
+    ContinuationMap<std::string> shared;
+    /// Mutable @p Global%s used by several partitions and the partition that defines them; the others only declare them.
+    DefMap<size_t> shared_globals;
+};
+
+/// How the iterations of a @c parallel_for are distributed over the threads of the runtime.
+struct ParallelSchedule {
+    enum Policy {
+        Static,  ///< The runtime splits the range into one block per thread.
+        Chunked, ///< The runtime distributes chunks of @p grain iterations.
+        Dynamic, ///< Threads take the next chunk of @p grain iterations from a shared counter when they are done with the last one.
+        Guided   ///< As @p Dynamic but chunks start at a share of the remaining iterations per thread and shrink down to @p grain.
+    };
+
+    Policy policy = Static;
+    int grain = 1;
+};
 
 class CodeGen : public thorin::CodeGen, public thorin::Emitter<llvm::Value*, llvm::Type*, BB, CodeGen> {
 protected:
@@ -43,15 +74,33 @@ public:
     const llvm::Module& module() const { return *module_; }
     llvm::TargetMachine& machine() { return *machine_; }
     int opt() const { return opt_; }
+    const ParallelSchedule& parallel_schedule() const { return parallel_schedule_; }
+    /// The schedule of the @c parallel_for that runs @p body - set by @p set_parallel_schedule for @p body or the default one.
+    const ParallelSchedule& parallel_schedule(Continuation* body) const {
+        auto i = parallel_schedules_.find(body);
+        return i != parallel_schedules_.end() ? i->second : parallel_schedule_;
+    }
     //@}
 
+    /// Default for all @c parallel_for%s emitted afterwards that have no schedule of their own.
+    void set_parallel_schedule(ParallelSchedule schedule) { parallel_schedule_ = schedule; }
+    /// Applies to the @c parallel_for%s whose body is @p body - the continuation passed to the @c parallel intrinsic.
+    void set_parallel_schedule(Continuation* body, ParallelSchedule schedule) { parallel_schedules_[body] = schedule; }
+
     const char* file_ext() const override { return ".ll"; }
     void emit_stream(std::ostream& stream) override;
+    u64 cache_key(u64 seed) const override;
     // Note: This moves the context and module of the class,
     // rendering the current CodeGen object invalid.
-    std::pair<
-        std::unique_ptr<llvm::LLVMContext>,
-        std::unique_ptr<llvm::Module>> emit_module();
+    ContextModule emit_module();
+    /**
+     * Emits @p world into @p num_partitions independent modules, each one with its own context.
+     * @p make_codegen creates a fresh CodeGen for each partition.
+     * The partitions are emitted one after another but optimized concurrently on one thread each.
+     * Calls across partitions go to external symbols with hidden visibility,
+     * so the returned modules can be compiled to separate object files and linked afterwards.
+     */
+    static std::vector<ContextModule> emit_partitioned(World& world, size_t num_partitions, std::function<std::unique_ptr<CodeGen>()> make_codegen);
     llvm::Function* prepare(const Scope&);
     virtual void prepare(Continuation*, llvm::Function*);
     llvm::Value* emit_bb(BB&, const Def* def);
@@ -90,6 +139,9 @@ protected:
     virtual llvm::Value* emit_global(const Global*);
     llvm::GlobalVariable* emit_global_variable(llvm::Type*, const std::string&, unsigned, bool=false);
 
+    void begin_module();
+    void end_module();
+    ContextModule release_module();
     void optimize();
     void verify() const;
     void create_loop(llvm::IRBuilder<>&, llvm::Value*, llvm::Value*, llvm::Value*, llvm::Function*, std::function<void(llvm::Value*)>);
@@ -122,6 +174,10 @@ private:
     std::unique_ptr<llvm::Module> module_;
 
     int opt_;
+    ParallelSchedule parallel_schedule_;
+    ContinuationMap<ParallelSchedule> parallel_schedules_;
+    const Partitioning* partitioning_ = nullptr;
+    size_t partition_ = 0;
 
 protected:
     std::unique_ptr<llvm::TargetMachine> machine_;
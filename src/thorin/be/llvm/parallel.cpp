@@ -45,9 +45,39 @@ Continuation* CodeGen::emit_parallel(llvm::IRBuilder<>& irbuilder, Continuation*
         closure = emit(body->arg(PAR_NUM_ARGS));
     }
 
+    // with a schedule other than Static, the runtime iterates over chunks and the closure also carries
+    // the iteration range, the number of threads if the program fixes it, and the counter shared by all threads:
+    // { closure, lower, upper, num_threads, next }
+    auto& schedule = parallel_schedule(kernel);
+    auto policy = schedule.policy;
+    auto i32 = irbuilder.getInt32Ty(), i64 = irbuilder.getInt64Ty();
+    auto grain = irbuilder.getInt32(std::max(schedule.grain, 1));
+    auto sched_type = policy == ParallelSchedule::Static ? closure_type : llvm::StructType::get(*context_, { closure_type, i32, i32, i32, i64 });
+    auto smin = [&] (llvm::Value* a, llvm::Value* b) { return irbuilder.CreateSelect(irbuilder.CreateICmpSLT(a, b), a, b); };
+    auto smax = [&] (llvm::Value* a, llvm::Value* b) { return irbuilder.CreateSelect(irbuilder.CreateICmpSGT(a, b), a, b); };
+    // ceil(max(upper - lower, 0) / d)
+    auto div_up = [&] (llvm::Value* lower, llvm::Value* upper, llvm::Value* d) {
+        auto size = smax(irbuilder.CreateSub(upper, lower), irbuilder.getInt32(0));
+        auto rest = irbuilder.CreateICmpNE(irbuilder.CreateURem(size, d), irbuilder.getInt32(0));
+        return irbuilder.CreateAdd(irbuilder.CreateUDiv(size, d), irbuilder.CreateZExt(rest, i32));
+    };
+
     // allocate closure object and write values into it
-    auto ptr = emit_alloca(irbuilder, closure_type, "parallel_closure");
-    irbuilder.CreateStore(closure, ptr, false);
+    auto ptr = emit_alloca(irbuilder, sched_type, "parallel_closure");
+    if (policy == ParallelSchedule::Static) {
+        irbuilder.CreateStore(closure, ptr, false);
+    } else {
+        auto num_chunks = div_up(lower, upper, grain);
+        llvm::Value* sched = llvm::UndefValue::get(sched_type);
+        sched = irbuilder.CreateInsertValue(sched, closure, 0);
+        sched = irbuilder.CreateInsertValue(sched, lower, 1);
+        sched = irbuilder.CreateInsertValue(sched, upper, 2);
+        sched = irbuilder.CreateInsertValue(sched, num_threads, 3);
+        sched = irbuilder.CreateInsertValue(sched, irbuilder.CreateSExt(lower, i64), 4);
+        irbuilder.CreateStore(sched, ptr, false);
+        lower = irbuilder.getInt32(0);
+        upper = num_chunks;
+    }
 
     // create wrapper function and call the runtime
     // wrapper(void* closure, int lower, int upper)
@@ -66,7 +96,8 @@ Continuation* CodeGen::emit_parallel(llvm::IRBuilder<>& irbuilder, Continuation*
 
     // extract all arguments from the closure
     auto wrapper_args = wrapper->arg_begin();
-    auto val = irbuilder.CreateLoad(closure_type, &*wrapper_args);
+    auto wrapper_closure = &*wrapper_args;
+    auto val = irbuilder.CreateLoad(closure_type, policy == ParallelSchedule::Static ? wrapper_closure : irbuilder.CreateStructGEP(sched_type, wrapper_closure, 0));
     std::vector<llvm::Value*> target_args(num_kernel_args + 1);
     if (num_kernel_args != 1) {
         for (size_t i = 0; i < num_kernel_args; ++i)
@@ -75,18 +106,94 @@ Continuation* CodeGen::emit_parallel(llvm::IRBuilder<>& irbuilder, Continuation*
         target_args[1] = val;
     }
 
-    // create loop iterating over range:
-    // for (int i=lower; i<upper; ++i)
-    //   body(i, <closure_elems>);
+    auto par_type = llvm::FunctionType::get(irbuilder.getVoidTy(), llvm_ref(par_args), false);
+    auto kernel_par_func = (llvm::Function*)module_->getOrInsertFunction(kernel->unique_name(), par_type).getCallee()->stripPointerCasts();
+    auto call_kernel = [&] (llvm::Value* counter) {
+        target_args[0] = counter; // loop index
+        auto call = irbuilder.CreateCall(kernel_par_func, target_args);
+        // inline the body so that LLVM can vectorize the loop around it
+        call->addFnAttr(llvm::Attribute::AlwaysInline);
+    };
+
+    // iterations [begin, begin + min(grain, end - begin))
+    auto emit_chunk = [&] (llvm::Value* begin, llvm::Value* end) {
+        create_loop(irbuilder, begin, irbuilder.CreateAdd(begin, smin(grain, irbuilder.CreateSub(end, begin))), irbuilder.getInt32(1), wrapper, call_kernel);
+    };
+
     auto wrapper_lower = &*(++wrapper_args);
     auto wrapper_upper = &*(++wrapper_args);
-    create_loop(irbuilder, wrapper_lower, wrapper_upper, irbuilder.getInt32(1), wrapper, [&](llvm::Value* counter) {
-        // call kernel body
-        target_args[0] = counter; // loop index
-        auto par_type = llvm::FunctionType::get(irbuilder.getVoidTy(), llvm_ref(par_args), false);
-        auto kernel_par_func = (llvm::Function*)module_->getOrInsertFunction(kernel->unique_name(), par_type).getCallee()->stripPointerCasts();
-        irbuilder.CreateCall(kernel_par_func, target_args);
-    });
+    if (policy == ParallelSchedule::Static) {
+        // for (int i=lower; i<upper; ++i)
+        //   body(i, <closure_elems>);
+        create_loop(irbuilder, wrapper_lower, wrapper_upper, irbuilder.getInt32(1), wrapper, call_kernel);
+    } else {
+        auto sched_lower = irbuilder.CreateLoad(i32, irbuilder.CreateStructGEP(sched_type, wrapper_closure, 1));
+        auto sched_upper = irbuilder.CreateLoad(i32, irbuilder.CreateStructGEP(sched_type, wrapper_closure, 2));
+        auto num_threads = irbuilder.CreateLoad(i32, irbuilder.CreateStructGEP(sched_type, wrapper_closure, 3));
+        auto next = irbuilder.CreateStructGEP(sched_type, wrapper_closure, 4);
+        auto upper64 = irbuilder.CreateSExt(sched_upper, i64);
+        auto grain64 = irbuilder.CreateSExt(grain, i64);
+
+        if (policy == ParallelSchedule::Chunked) {
+            // for (int c=lower; c<upper; ++c)
+            //   for (int i=sched_lower+c*grain; i<min(sched_lower+(c+1)*grain, sched_upper); ++i)
+            //     body(i, <closure_elems>);
+            create_loop(irbuilder, wrapper_lower, wrapper_upper, irbuilder.getInt32(1), wrapper, [&] (llvm::Value* chunk) {
+                emit_chunk(irbuilder.CreateAdd(sched_lower, irbuilder.CreateMul(chunk, grain)), sched_upper);
+            });
+        } else {
+            // each call of the wrapper takes chunks until the range is exhausted - the calls just provide the threads
+            auto entry = irbuilder.GetInsertBlock();
+            auto grab = llvm::BasicBlock::Create(*context_, "grab", wrapper);
+            auto work = llvm::BasicBlock::Create(*context_, "work", wrapper);
+            auto done = llvm::BasicBlock::Create(*context_, "done", wrapper);
+
+            if (policy == ParallelSchedule::Dynamic) {
+                // chunk = next.fetch_add(grain)
+                irbuilder.CreateBr(grab);
+                irbuilder.SetInsertPoint(grab);
+                auto begin = irbuilder.CreateAtomicRMW(llvm::AtomicRMWInst::Add, next, grain64, llvm::MaybeAlign(), llvm::AtomicOrdering::Monotonic);
+                irbuilder.CreateCondBr(irbuilder.CreateICmpSLT(begin, upper64), work, done);
+                irbuilder.SetInsertPoint(work);
+                emit_chunk(irbuilder.CreateTrunc(begin, i32), sched_upper);
+                irbuilder.CreateBr(grab);
+            } else {
+                // chunk = max(grain, (upper - next) / (2 * threads)), claimed by compare-and-swap
+                // num_threads <= 0 leaves the choice to the runtime, which hands each thread a share of the chunks -
+                // so estimate the number of threads from the size of the share this call got
+                auto share = smax(irbuilder.CreateSub(wrapper_upper, wrapper_lower), irbuilder.getInt32(1));
+                auto estimate = div_up(irbuilder.getInt32(0), div_up(sched_lower, sched_upper, grain), share);
+                auto threads = irbuilder.CreateSelect(irbuilder.CreateICmpSGT(num_threads, irbuilder.getInt32(0)), num_threads, estimate);
+                auto divisor = irbuilder.CreateMul(smax(threads, irbuilder.getInt32(1)), irbuilder.getInt32(2));
+                auto load_next = [&] {
+                    auto load = irbuilder.CreateLoad(i64, next);
+                    load->setAtomic(llvm::AtomicOrdering::Monotonic);
+                    return load;
+                };
+                auto first = load_next();
+                irbuilder.CreateBr(grab);
+                irbuilder.SetInsertPoint(grab);
+                auto begin = irbuilder.CreatePHI(i64, 3, "guided_begin");
+                begin->addIncoming(first, entry);
+                auto claim = llvm::BasicBlock::Create(*context_, "claim", wrapper, work);
+                irbuilder.CreateCondBr(irbuilder.CreateICmpSLT(begin, upper64), claim, done);
+
+                irbuilder.SetInsertPoint(claim);
+                auto remaining = irbuilder.CreateSub(upper64, begin);
+                auto size = smin(smax(grain64, irbuilder.CreateSDiv(remaining, irbuilder.CreateSExt(divisor, i64))), remaining);
+                auto end = irbuilder.CreateAdd(begin, size);
+                auto cmpxchg = irbuilder.CreateAtomicCmpXchg(next, begin, end, llvm::MaybeAlign(), llvm::AtomicOrdering::Monotonic, llvm::AtomicOrdering::Monotonic);
+                begin->addIncoming(irbuilder.CreateExtractValue(cmpxchg, { 0u }), claim);
+                irbuilder.CreateCondBr(irbuilder.CreateExtractValue(cmpxchg, { 1u }), work, grab);
+
+                irbuilder.SetInsertPoint(work);
+                create_loop(irbuilder, irbuilder.CreateTrunc(begin, i32), irbuilder.CreateTrunc(end, i32), irbuilder.getInt32(1), wrapper, call_kernel);
+                begin->addIncoming(load_next(), irbuilder.GetInsertBlock());
+                irbuilder.CreateBr(grab);
+            }
+            irbuilder.SetInsertPoint(done);
+        }
+    }
     irbuilder.CreateRetVoid();
 
     // restore old insert point
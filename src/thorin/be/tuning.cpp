@@ -0,0 +1,207 @@
+#include "thorin/be/tuning.h"
+
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <sstream>
+
+#include "thorin/primop.h"
+#include "thorin/world.h"
+#include "thorin/analyses/fingerprint.h"
+#include "thorin/analyses/scope.h"
+#include "thorin/be/codegen.h"
+#include "thorin/transform/loop_opt.h"
+
+namespace thorin {
+
+std::vector<LaunchConfig> SearchSpace::configs() const {
+    std::vector<LaunchConfig> result;
+    for (auto block : blocks.empty() ? std::vector<std::tuple<int, int, int>> { {-1, -1, -1} } : blocks)
+        result.push_back(LaunchConfig { block, tune_block, {} });
+
+    for (auto& [name, values] : params) {
+        if (values.empty()) continue;
+        std::vector<LaunchConfig> product;
+        for (auto& config : result) {
+            for (auto value : values) {
+                product.push_back(config);
+                product.back().params[name] = value;
+            }
+        }
+        result = std::move(product);
+    }
+    return result;
+}
+
+//------------------------------------------------------------------------------
+
+TuningDB::TuningDB(std::string filename)
+    : filename_(std::move(filename))
+{
+    std::ifstream file(filename_);
+    std::string line;
+    while (std::getline(file, line)) {
+        if (line.empty() || line[0] == '#') continue;
+
+        std::istringstream is(line);
+        u64 key;
+        Entry entry;
+        auto& [x, y, z] = entry.config.block;
+        if (!(is >> std::hex >> key >> std::dec >> entry.seconds >> x >> y >> z))
+            continue;
+
+        bool valid = true;
+        for (std::string param; valid && is >> param;) {
+            if (param == "tune_block") {
+                entry.config.tune_block = true;
+                continue;
+            }
+            auto eq = param.find('=');
+            valid = eq != std::string::npos && eq != 0;
+            if (valid) {
+                std::istringstream value(param.substr(eq + 1));
+                valid = bool(value >> entry.config.params[param.substr(0, eq)]);
+            }
+        }
+        if (valid)
+            entries_[key] = std::move(entry);
+    }
+}
+
+const LaunchConfig* TuningDB::lookup(u64 key) const {
+    auto i = entries_.find(key);
+    return i != entries_.end() ? &i->second.config : nullptr;
+}
+
+void TuningDB::record(u64 key, const LaunchConfig& config, double seconds) {
+    auto [i, inserted] = entries_.emplace(key, Entry { config, seconds });
+    if (!inserted && seconds < i->second.seconds)
+        i->second = Entry { config, seconds };
+}
+
+bool TuningDB::save() const {
+    // write to a temporary first so that concurrent compilations never see half a database
+    auto tmp = filename_ + ".tmp";
+    {
+        std::ofstream file(tmp);
+        file << "# key seconds bx by bz [tune_block] name=value..." << std::endl;
+        for (auto& [key, entry] : entries_) {
+            auto [x, y, z] = entry.config.block;
+            file << std::hex << key << std::dec << ' ' << entry.seconds << ' ' << x << ' ' << y << ' ' << z;
+            if (entry.config.tune_block)
+                file << " tune_block";
+            for (auto& [name, value] : entry.config.params)
+                file << ' ' << name << '=' << value;
+            file << std::endl;
+        }
+        if (!file)
+            return false;
+    }
+    std::error_code error;
+    std::filesystem::rename(tmp, filename_, error);
+    return !error;
+}
+
+//------------------------------------------------------------------------------
+
+u64 kernel_key(Continuation* kernel) { return fingerprint(Scope(kernel)); }
+
+/// Replaces @p def by @p value unless it is a literal already or @p value does not denote a size.
+static const Def* specialize(const Def* def, int value) {
+    auto type = def->type()->isa<PrimType>();
+    if (value <= 0 || def->isa<PrimLit>() || !type || !is_type_i(type))
+        return def;
+    return def->world().literal(type->primtype_tag(), Box(s32(value)), def->debug());
+}
+
+/// Whether @p grid - the global size of a GPU launch - is a literal multiple of @p block in each dimension.
+static bool is_divisible(const Def* grid, std::tuple<int, int, int> block) {
+    auto tuple = grid->isa<Tuple>();
+    if (!tuple || tuple->num_ops() != 3) return false;
+    auto [x, y, z] = block;
+    int sizes[] = { x, y, z };
+    for (size_t i = 0; i != 3; ++i) {
+        if (sizes[i] <= 0) continue;
+        auto lit = tuple->op(i)->isa<PrimLit>();
+        if (!lit || !is_type_i(lit->type()) || primlit_value<s64>(lit) % sizes[i] != 0)
+            return false;
+    }
+    return true;
+}
+
+// argument positions of the launch intrinsics - see LaunchArgs and be/llvm/parallel.cpp
+enum { LaunchNumThreads = 1 };
+
+size_t specialize_launches(Continuation* kernel, const LaunchConfig& config) {
+    std::vector<Continuation*> launches;
+    visit_uses(kernel, [&] (Continuation* use) {
+        auto callee = use->body()->callee()->isa_nom<Continuation>();
+        if (callee && callee->is_accelerator())
+            launches.push_back(use);
+        return false;
+    }, true);
+
+    auto [x, y, z] = config.block;
+    size_t num = 0;
+    for (auto use : launches) {
+        auto body = use->body();
+        Array<const Def*> args(body->args());
+        switch (body->callee()->as_nom<Continuation>()->intrinsic()) {
+            case Intrinsic::CUDA:
+            case Intrinsic::NVVM:
+            case Intrinsic::OpenCL:
+            case Intrinsic::AMDGPU:
+                // the grid counts threads, so a block size that does not divide it would launch a different number of them
+                if (!config.tune_block || !is_divisible(args[LaunchArgs::Space], config.block)) continue;
+                if (auto tuple = args[LaunchArgs::Config]->isa<Tuple>(); tuple && tuple->num_ops() == 3)
+                    args[LaunchArgs::Config] = kernel->world().tuple({ specialize(tuple->op(0), x), specialize(tuple->op(1), y), specialize(tuple->op(2), z) }, tuple->debug());
+                break;
+            case Intrinsic::Parallel:
+            case Intrinsic::Fibers:
+                args[LaunchNumThreads] = specialize(args[LaunchNumThreads], x);
+                break;
+            default:
+                continue;
+        }
+
+        if (Defs(args) == body->args()) continue;
+        use->jump(body->callee(), args, body->debug());
+        ++num;
+    }
+    return num;
+}
+
+bool specialize_loops(Continuation* kernel, const LaunchConfig& config) {
+    auto unroll = config.params.find(LaunchConfig::Unroll);
+    if (unroll == config.params.end() || unroll->second <= 1)
+        return false;
+    loop_opt(kernel, unroll->second);
+    return true;
+}
+
+std::optional<LaunchConfig> autotune(TuningDB& db, u64 key, const SearchSpace& space, std::function<std::function<void()>(const LaunchConfig&)> build, int repetitions) {
+    std::optional<LaunchConfig> best;
+    auto best_seconds = std::numeric_limits<double>::infinity();
+
+    for (auto& config : space.configs()) {
+        auto run = build(config);
+        run();
+        auto seconds = std::numeric_limits<double>::infinity();
+        for (int i = 0; i < std::max(repetitions, 1); ++i) {
+            auto start = std::chrono::steady_clock::now();
+            run();
+            seconds = std::min(seconds, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+        }
+        if (!best || seconds < best_seconds) {
+            best = config;
+            best_seconds = seconds;
+        }
+    }
+
+    if (best)
+        db.record(key, *best, best_seconds);
+    return best;
+}
+
+}
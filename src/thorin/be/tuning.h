@@ -0,0 +1,103 @@
+#ifndef THORIN_BE_TUNING_H
+#define THORIN_BE_TUNING_H
+
+#include <functional>
+#include <map>
+#include <optional>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+#include "thorin/util/types.h"
+
+namespace thorin {
+
+class Continuation;
+
+/**
+ * Launch configuration of one kernel.
+ * @p block is the block size of a GPU launch or the number of threads of a @c parallel / @c fibers launch in its first entry;
+ * entries <tt><= 0</tt> leave the corresponding argument alone.
+ * The block size of a GPU launch is only replaced if @p tune_block is set:
+ * the kernel must neither index nor size shared memory by the block size it was written for.
+ * @p params holds additional knobs: @p thorin unrolls the loops of the kernel by @c unroll - see @p specialize_loops;
+ * all others - e.g. @c tile - are not interpreted but handed back to the front-end.
+ */
+struct LaunchConfig {
+    static constexpr const char* Unroll = "unroll";
+
+    std::tuple<int, int, int> block = {-1, -1, -1};
+    bool tune_block = false;
+    std::map<std::string, int> params;
+};
+
+/// Candidate @p LaunchConfig%s - the cartesian product of all @p blocks and all values of all @p params.
+struct SearchSpace {
+    std::vector<std::tuple<int, int, int>> blocks;
+    /// Opts the kernel in to block size tuning - see @p LaunchConfig::tune_block.
+    bool tune_block = false;
+    std::map<std::string, std::vector<int>> params;
+
+    std::vector<LaunchConfig> configs() const;
+};
+
+/**
+ * Best known @p LaunchConfig per kernel, keyed by @p kernel_key.
+ * The database is a text file with one line per kernel:
+ * <tt>key seconds bx by bz [tune_block] name=value...</tt>
+ */
+class TuningDB {
+public:
+    /// Reads @p filename if it exists; malformed lines are skipped.
+    explicit TuningDB(std::string filename);
+
+    /// Returns @c nullptr if nothing has been recorded for @p key yet.
+    const LaunchConfig* lookup(u64 key) const;
+    /// Records @p config for @p key unless a configuration that ran faster than @p seconds is already known.
+    void record(u64 key, const LaunchConfig& config, double seconds);
+    bool save() const;
+
+    const std::string& filename() const { return filename_; }
+    size_t size() const { return entries_.size(); }
+
+private:
+    struct Entry {
+        LaunchConfig config;
+        double seconds;
+    };
+
+    std::string filename_;
+    std::unordered_map<u64, Entry> entries_;
+};
+
+/// Key of @p kernel in a @p TuningDB - the @p fingerprint of its @p Scope, so it survives recompilation as long as the kernel does not change.
+u64 kernel_key(Continuation* kernel);
+
+/**
+ * Makes every launch of @p kernel use @p config as far as this does not change what the program computes:
+ *  - only arguments which are not literals already are replaced - a block size the program spells out is never overridden,
+ *  - @c parallel and @c fibers launches only get their number of threads replaced; the number of blocks and warps of @c fibers decides how often the body runs,
+ *  - the block size of a GPU launch is only replaced if @p LaunchConfig::tune_block is set and each dimension of the grid is a literal multiple of the new size.
+ * Returns the number of launch sites that have been changed.
+ */
+size_t specialize_launches(Continuation* kernel, const LaunchConfig& config);
+
+/**
+ * Unrolls the innermost counted loops of @p kernel by the @c unroll knob of @p config with @p loop_opt.
+ * Returns whether there was anything to unroll by; the caller cleans up the @p World.
+ */
+bool specialize_loops(Continuation* kernel, const LaunchConfig& config);
+
+/**
+ * Measures each configuration of @p space and records the fastest for @p key in @p db.
+ * @p build must build the variant for the given configuration - e.g. by @p specialize_launches and @p specialize_loops on a copy of the @p World
+ * and compiling it with the CPU backend - and return a function that executes it; only the latter is timed.
+ * Each variant runs once to warm up and then @p repetitions times; the fastest run counts.
+ * Returns the best configuration of this session or @c std::nullopt if @p space is empty.
+ */
+std::optional<LaunchConfig> autotune(TuningDB& db, u64 key, const SearchSpace& space, std::function<std::function<void()>(const LaunchConfig&)> build, int repetitions = 3);
+
+}
+
+#endif
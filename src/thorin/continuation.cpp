@@ -1,6 +1,7 @@
 #include "thorin/continuation.h"
 
 #include <iostream>
+#include <unordered_map>
 
 #include "thorin/type.h"
 #include "thorin/world.h"
@@ -53,6 +54,8 @@ Continuation::Continuation(const FnType* fn, const Attributes& attributes, Debug
     : Def(Node_Continuation, fn, 2, dbg)
     , attributes_(attributes)
 {
+    attributes_.channel |= dbg.name.find("channel") != std::string::npos;
+    attributes_.pipe    |= dbg.name.find("pipe")    != std::string::npos;
     params_.reserve(fn->num_ops());
     set_op(0, world().bottom(world().bottom_type()));
     set_op(1, world().filter({}, dbg));
@@ -135,69 +138,8 @@ const Param* Continuation::append_param(const Type* param_type, Debug dbg) {
     return param;
 }
 
-Continuations Continuation::preds() const {
-    std::vector<Continuation*> preds;
-    std::queue<Use> queue;
-    DefSet done;
-
-    auto enqueue = [&] (const Def* def) {
-        for (auto use : def->uses()) {
-            if (use->isa<Param>())
-                continue;
-            if (done.find(use) == done.end()) {
-                queue.push(use);
-                done.insert(use);
-            }
-        }
-    };
-
-    done.insert(this);
-    enqueue(this);
-
-    while (!queue.empty()) {
-        auto use = pop(queue);
-        if (auto continuation = use->isa_nom<Continuation>()) {
-            preds.push_back(continuation);
-            continue;
-        }
-
-        enqueue(use);
-    }
-
-    return preds;
-}
-
-Continuations Continuation::succs() const {
-    std::vector<Continuation*> succs;
-    std::queue<const Def*> queue;
-    DefSet done;
-
-    auto enqueue = [&] (const Def* def) {
-        if (done.find(def) == done.end()) {
-            queue.push(def);
-            done.insert(def);
-        }
-    };
-
-    done.insert(this);
-    if (has_body())
-        enqueue(body());
-
-    while (!queue.empty()) {
-        auto def = pop(queue);
-        if (auto continuation = def->isa_nom<Continuation>()) {
-            succs.push_back(continuation);
-            continue;
-        }
-
-        for (auto op : def->ops()) {
-            if (op->has_dep(Dep::Cont))
-                enqueue(op);
-        }
-    }
-
-    return succs;
-}
+Continuations Continuation::preds() const { return world().call_graph().preds(this); }
+Continuations Continuation::succs() const { return world().call_graph().succs(this); }
 
 void Continuation::destroy_filter() {
     set_filter(world().filter({}));
@@ -211,27 +153,33 @@ const Filter* Continuation::all_true_filter() const {
 
 bool Continuation::is_accelerator() const { return Intrinsic::AcceleratorBegin <= intrinsic() && intrinsic() < Intrinsic::AcceleratorEnd; }
 void Continuation::set_intrinsic() {
-    if      (name() == "cuda")           attributes().intrinsic = Intrinsic::CUDA;
-    else if (name() == "nvvm")           attributes().intrinsic = Intrinsic::NVVM;
-    else if (name() == "opencl")         attributes().intrinsic = Intrinsic::OpenCL;
-    else if (name() == "amdgpu")         attributes().intrinsic = Intrinsic::AMDGPU;
-    else if (name() == "hls")            attributes().intrinsic = Intrinsic::HLS;
-    else if (name() == "parallel")       attributes().intrinsic = Intrinsic::Parallel;
-    else if (name() == "fibers")         attributes().intrinsic = Intrinsic::Fibers;
-    else if (name() == "spawn")          attributes().intrinsic = Intrinsic::Spawn;
-    else if (name() == "sync")           attributes().intrinsic = Intrinsic::Sync;
-    else if (name() == "vectorize")      attributes().intrinsic = Intrinsic::Vectorize;
-    else if (name() == "pe_info")        attributes().intrinsic = Intrinsic::PeInfo;
-    else if (name() == "pipeline")       attributes().intrinsic = Intrinsic::Pipeline;
-    else if (name() == "reserve_shared") attributes().intrinsic = Intrinsic::Reserve;
-    else if (name() == "atomic")         attributes().intrinsic = Intrinsic::Atomic;
-    else if (name() == "atomic_load")    attributes().intrinsic = Intrinsic::AtomicLoad;
-    else if (name() == "atomic_store")   attributes().intrinsic = Intrinsic::AtomicStore;
-    else if (name() == "cmpxchg")        attributes().intrinsic = Intrinsic::CmpXchg;
-    else if (name() == "cmpxchg_weak")   attributes().intrinsic = Intrinsic::CmpXchgWeak;
-    else if (name() == "fence")          attributes().intrinsic = Intrinsic::Fence;
-    else if (name() == "undef")          attributes().intrinsic = Intrinsic::Undef;
-    else world().ELOG("unsupported thorin intrinsic '{}'", name());
+    static const std::unordered_map<std::string, Intrinsic> intrinsics = {
+        {"cuda",           Intrinsic::CUDA},
+        {"nvvm",           Intrinsic::NVVM},
+        {"opencl",         Intrinsic::OpenCL},
+        {"amdgpu",         Intrinsic::AMDGPU},
+        {"hls",            Intrinsic::HLS},
+        {"parallel",       Intrinsic::Parallel},
+        {"fibers",         Intrinsic::Fibers},
+        {"spawn",          Intrinsic::Spawn},
+        {"sync",           Intrinsic::Sync},
+        {"vectorize",      Intrinsic::Vectorize},
+        {"pe_info",        Intrinsic::PeInfo},
+        {"pipeline",       Intrinsic::Pipeline},
+        {"reserve_shared", Intrinsic::Reserve},
+        {"atomic",         Intrinsic::Atomic},
+        {"atomic_load",    Intrinsic::AtomicLoad},
+        {"atomic_store",   Intrinsic::AtomicStore},
+        {"cmpxchg",        Intrinsic::CmpXchg},
+        {"cmpxchg_weak",   Intrinsic::CmpXchgWeak},
+        {"fence",          Intrinsic::Fence},
+        {"undef",          Intrinsic::Undef},
+    };
+
+    if (auto i = intrinsics.find(name()); i != intrinsics.end())
+        attributes().intrinsic = i->second;
+    else
+        world().ELOG("unsupported thorin intrinsic '{}'", name());
 }
 
 bool Continuation::is_basicblock() const { return type()->is_basicblock(); }
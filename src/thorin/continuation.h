@@ -124,6 +124,8 @@ public:
     struct Attributes {
         Intrinsic intrinsic = Intrinsic::None;
         CC cc = CC::C;
+        bool channel = false;   ///< Channel read/write of the HLS/OpenCL backends - derived from the name on creation.
+        bool pipe = false;      ///< Pipe read/write of the OpenCL backend - derived from the name on creation.
 
         Attributes(Intrinsic intrinsic) : intrinsic(intrinsic) {}
         Attributes(CC cc = CC::C) : cc(cc) {}
@@ -138,8 +140,15 @@ public:
 
     Continuation* stub() const;
     const Param* append_param(const Type* type, Debug dbg = {});
+    /**
+     * @name direct predecessors/successors - looked up in the @p World's @p CallGraph
+     * Although @c const, these bring the lazily maintained @p CallGraph up to date, i.e. they modify state shared by the whole @p World:
+     * do not call them from several threads at once, nor while another thread changes the @p World.
+     */
+    //@{
     Continuations preds() const;
     Continuations succs() const;
+    //@}
     ArrayRef<const Param*> params() const { return params_; }
     Array<const Def*> params_as_defs() const;
     const Param* param(size_t i) const { assert(i < num_params()); return params_[i]; }
@@ -170,9 +179,8 @@ public:
     bool is_exported() const { return is_external() && has_body(); }
     ///@}
 
-    // TODO: probably should be moved to Attributes
-    bool is_channel() const { return name().find("channel") != std::string::npos; }
-    bool is_pipe() const { return name().find("pipe") != std::string::npos; }
+    bool is_channel() const { return attributes().channel; }
+    bool is_pipe() const { return attributes().pipe; }
     bool is_accelerator() const;
 
     const App* body() const { return op(0)->as<App>(); }
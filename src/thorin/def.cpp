@@ -62,6 +62,17 @@ void Def::set_op(size_t i, const Def* def) {
     assert(!def->uses_.contains(Use(i, this)));
     const auto& p = def->uses_.emplace(i, this);
     assert_unused(p.second);
+    invalidate_call_graph(i, def);
+}
+
+void Def::invalidate_call_graph(size_t i, const Def* op) const {
+    if (auto continuation = isa_nom<Continuation>()) {
+        if (i == 0)
+            world().call_graph().invalidate(continuation);
+    } else if (op->has_dep(Dep::Cont) && !uses_.empty() && !isa<Param>()) {
+        // new structural defs don't have uses yet - so this only fires when an existing def is rewired, e.g. by replace_uses
+        world().call_graph().invalidate_users(this);
+    }
 }
 
 void Def::unregister_uses() const {
@@ -80,6 +91,7 @@ void Def::unset_op(size_t i) {
     // Note: if replace() didn't touch the uses, we could assert for nominalness here !
     assert(ops_[i] && "must be set");
     unregister_use(i);
+    invalidate_call_graph(i, ops_[i]);
     ops_[i] = nullptr;
 }
 
@@ -228,6 +228,9 @@ public:
     static size_t gid_counter() { return gid_counter_; } // TODO move to World
 
 private:
+    /// Keeps the @p World's @p CallGraph up to date when @p op is set as or removed from the @p i^th op.
+    void invalidate_call_graph(size_t i, const Def* op) const;
+
     const NodeTag tag_;
     std::vector<const Def*> ops_;
     const Type* type_;
@@ -0,0 +1,580 @@
+#include "thorin/parser.h"
+
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <optional>
+#include <sstream>
+#include <string_view>
+#include <unordered_map>
+
+#include "thorin/primop.h"
+#include "thorin/world.h"
+
+namespace thorin {
+
+static const char* type_sep = "\xE2\x88\xB7"; // ∷
+
+class Parser {
+public:
+    Parser(std::string text, const std::string& filename)
+        : text_(std::move(text))
+        , filename_(filename)
+    {}
+
+    std::unique_ptr<World> run();
+
+private:
+    struct Error {
+        std::string msg;
+    };
+
+    template<class... Args>
+    [[noreturn]] void error(const char* fmt, Args&&... args) {
+        std::ostringstream os;
+        Stream(os).fmt(fmt, std::forward<Args&&>(args)...);
+        throw Error{os.str()};
+    }
+
+    /// @name scanning
+    //@{
+    bool eof() { skip(); return pos_ == text_.size(); }
+    void skip() {
+        while (pos_ != text_.size() && std::isspace((unsigned char) text_[pos_]))
+            ++pos_;
+    }
+    bool is_delim(size_t i) const {
+        return std::isspace((unsigned char) text_[i]) || std::strchr("()[]<>{},:=*'", text_[i])
+            || text_.compare(i, std::strlen(type_sep), type_sep) == 0;
+    }
+    bool peek(std::string_view tok) {
+        skip();
+        return text_.compare(pos_, tok.size(), tok) == 0;
+    }
+    bool accept(std::string_view tok) {
+        if (!peek(tok)) return false;
+        pos_ += tok.size();
+        return true;
+    }
+    void expect(std::string_view tok) {
+        if (!accept(tok)) error("expected '{}'", tok);
+    }
+    std::string word() {
+        skip();
+        auto begin = pos_;
+        while (pos_ != text_.size() && !is_delim(pos_))
+            ++pos_;
+        if (begin == pos_) error("expected identifier");
+        return text_.substr(begin, pos_ - begin);
+    }
+    bool accept_word(std::string_view w) {
+        skip();
+        auto end = pos_ + w.size();
+        if (text_.compare(pos_, w.size(), w) != 0 || (end != text_.size() && !is_delim(end))) return false;
+        pos_ = end;
+        return true;
+    }
+    bool peek_word(std::string_view w) {
+        auto save = pos_;
+        bool result = accept_word(w);
+        pos_ = save;
+        return result;
+    }
+    /// Skips up to and including the @c ']' matching an already consumed @c '[' and returns the number of top-level elements.
+    size_t skip_list();
+    //@}
+
+    PrimTypeTag prim_type_tag(const std::string&);
+    const Type* type();
+    const Type* ptr_suffix(const Type*);
+    void nominal(bool declare);
+    void continuation(bool declare);
+    void body(Continuation*);
+    const Def* expr();
+    const Def* op(const std::string& name, const Type* type, Debug dbg);
+    const Def* build(const std::string& name, Defs ops, std::optional<u64> index, const Type* type, Debug dbg);
+    const Def* literal(const std::string& value, const std::string& type);
+    const Def* lookup(const std::string& name);
+    void define(const std::string& name, const Def* def) {
+        if (!defs_.emplace(name, def).second) error("redefinition of '{}'", name);
+    }
+
+    World& world() { return *world_; }
+
+    std::string text_;
+    std::string filename_;
+    size_t pos_ = 0;
+    std::unique_ptr<World> world_;
+    std::unordered_map<std::string, const NominalType*> nominals_;
+    std::unordered_map<std::string, const Def*> defs_;
+};
+
+/// Strips the gid appended by @p Def::unique_name.
+static std::string debug_name(const std::string& unique_name) {
+    auto i = unique_name.rfind('_');
+    if (i == std::string::npos || i + 1 == unique_name.size()) return unique_name;
+    for (auto j = i + 1; j != unique_name.size(); ++j) {
+        if (!std::isdigit((unsigned char) unique_name[j])) return unique_name;
+    }
+    return unique_name.substr(0, i);
+}
+
+static bool is_index(const std::string& str) {
+    return std::all_of(str.begin(), str.end(), [] (char c) { return std::isdigit((unsigned char) c); });
+}
+
+size_t Parser::skip_list() {
+    size_t depth = 1, num = 0;
+    bool empty = true;
+    while (depth != 0) {
+        if (pos_ == text_.size()) error("unterminated list");
+        char c = text_[pos_++];
+        if (c == '[' || c == '<') ++depth;
+        else if (c == ']' || c == '>') --depth;
+        else if (c == ',' && depth == 1) ++num;
+        if (depth != 0 && !std::isspace((unsigned char) c)) empty = false;
+    }
+    return empty ? 0 : num + 1;
+}
+
+/*
+ * types
+ */
+
+PrimTypeTag Parser::prim_type_tag(const std::string& name) {
+    static const std::unordered_map<std::string, PrimTypeTag> prim_types = {
+#define THORIN_ALL_TYPE(T, M) { #T, PrimType_##T },
+#include "thorin/tables/primtypetable.h"
+    };
+    auto i = prim_types.find(name);
+    if (i == prim_types.end()) error("unknown type '{}'", name);
+    return i->second;
+}
+
+const Type* Parser::type() {
+    const Type* result;
+    if (accept("[")) {
+        skip();
+        if (pos_ != text_.size() && std::isdigit((unsigned char) text_[pos_])) {
+            auto dim = word();
+            if (!accept_word("x")) error("expected 'x' in array type");
+            auto elem = type();
+            expect("]");
+            result = world().definite_array_type(elem, std::strtoull(dim.c_str(), nullptr, 10));
+        } else {
+            std::vector<const Type*> ops;
+            while (!accept("]")) {
+                if (!ops.empty()) expect(",");
+                ops.push_back(type());
+            }
+            result = ops.size() == 1 ? world().indefinite_array_type(ops.front()) : world().tuple_type(ops);
+        }
+    } else if (accept("<")) {
+        auto length = word();
+        if (!is_index(length) || !accept_word("x")) error("malformed vector type");
+        auto elem = type();
+        expect(">");
+        auto n = std::strtoull(length.c_str(), nullptr, 10);
+        if (auto ptr = elem->isa<PtrType>())
+            return ptr_suffix(world().ptr_type(ptr->pointee(), n));
+        if (auto prim = elem->isa<PrimType>())
+            result = world().prim_type(prim->primtype_tag(), n);
+        else
+            error("vector of non-primitive type '{}'", elem);
+    } else {
+        auto w = word();
+        if (w == "!!") {
+            result = world().bottom_type();
+        } else if (w == "mem") {
+            result = world().mem_type();
+        } else if (w == "frame") {
+            result = world().frame_type();
+        } else if (w == "fn" || w == "closure") {
+            expect("[");
+            std::vector<const Type*> ops;
+            while (!accept("]")) {
+                if (!ops.empty()) expect(",");
+                ops.push_back(type());
+            }
+            result = w == "fn" ? (const Type*) world().fn_type(ops) : world().closure_type(ops);
+        } else if (w == "struct" || w == "variant") {
+            auto name = word();
+            auto i = nominals_.find(name);
+            if (i == nominals_.end() || (w == "struct") != (i->second->isa<StructType>() != nullptr))
+                error("unknown {} type '{}'", w, name);
+            result = i->second;
+        } else {
+            result = world().prim_type(prim_type_tag(w));
+        }
+    }
+
+    while (accept("*"))
+        result = ptr_suffix(world().ptr_type(result));
+    return result;
+}
+
+const Type* Parser::ptr_suffix(const Type* type) {
+    auto ptr = type->as<PtrType>();
+    auto device = ptr->device();
+    auto addr_space = ptr->addr_space();
+    while (peek("[")) {
+        auto save = pos_;
+        expect("[");
+        auto w = word();
+        if (!accept("]")) { pos_ = save; break; }
+        if      (is_index(w))      device     = std::atoi(w.c_str());
+        else if (w == "Global")    addr_space = AddrSpace::Global;
+        else if (w == "Tex")       addr_space = AddrSpace::Texture;
+        else if (w == "Shared")    addr_space = AddrSpace::Shared;
+        else if (w == "Constant")  addr_space = AddrSpace::Constant;
+        else { pos_ = save; break; }
+    }
+    return world().ptr_type(ptr->pointee(), ptr->length(), device, addr_space);
+}
+
+void Parser::nominal(bool declare) {
+    bool is_struct = accept_word("struct");
+    if (!is_struct && !accept_word("variant")) error("expected type declaration");
+    auto name = word();
+    expect("=");
+    expect("[");
+
+    if (declare) {
+        auto size = skip_list();
+        auto type = is_struct ? (const NominalType*) world().struct_type(name, size) : world().variant_type(name, size);
+        if (!nominals_.emplace(name, type).second) error("redefinition of type '{}'", name);
+        return;
+    }
+
+    auto nominal = nominals_[name];
+    for (size_t i = 0, e = nominal->num_ops(); i != e; ++i) {
+        if (i != 0) expect(",");
+        nominal->set_op_name(i, peek(":") ? std::string() : word());
+        expect(":");
+        nominal->set(i, type());
+    }
+    expect("]");
+}
+
+/*
+ * continuations
+ */
+
+void Parser::continuation(bool declare) {
+    bool external = accept_word("extern");
+    bool device   = accept_word("device");
+    auto name = word();
+    expect(":");
+    auto type = this->type();
+    expect("=");
+
+    auto fn_type = type->isa<FnType>();
+    if (!fn_type) error("continuation '{}' must be of function type but is '{}'", name, type);
+
+    std::vector<std::string> params;
+    bool has_body = !accept("{");
+    if (has_body) {
+        expect("(");
+        while (!accept(")")) {
+            if (!params.empty()) expect(",");
+            params.push_back(word());
+        }
+        expect("=>");
+        expect("{");
+    } else {
+        expect("<");
+        if (!accept_word("no") || !accept_word("body")) error("expected '<no body>'");
+        expect(">");
+        expect("}");
+    }
+
+    if (!declare) {
+        if (has_body) body(defs_[name]->as_nom<Continuation>());
+        return;
+    }
+
+    if (has_body) {
+        auto end = text_.find('}', pos_);
+        if (end == std::string::npos) error("unterminated body of '{}'", name);
+        pos_ = end + 1;
+        if (params.size() != fn_type->num_ops()) error("'{}' expects {} parameters", name, fn_type->num_ops());
+    }
+
+    auto dbg_name = debug_name(name);
+    bool intrinsic = !has_body && !external;
+    Continuation* cont;
+    if (intrinsic && dbg_name == "br") {
+        cont = world().branch();
+    } else if (intrinsic && dbg_name == "end_scope") {
+        cont = world().end_scope();
+    } else {
+        Continuation::Attributes attributes(device ? CC::Device : CC::C);
+        if (intrinsic && dbg_name == "match") attributes.intrinsic = Intrinsic::Match;
+        cont = world().continuation(fn_type, attributes, {dbg_name});
+        if (intrinsic && !cont->is_intrinsic())
+            cont->set_intrinsic();
+    }
+
+    if (cont->type() != fn_type) error("type mismatch for '{}': '{}' expected", name, cont->type());
+    if (external) world().make_external(cont);
+    define(name, cont);
+    for (size_t i = 0, e = params.size(); i != e; ++i) {
+        cont->param(i)->set_name(debug_name(params[i]));
+        define(params[i], cont->param(i));
+    }
+}
+
+void Parser::body(Continuation* cont) {
+    while (!accept("}")) {
+        auto name = word();
+        if (accept(":")) {
+            auto type = this->type();
+            expect("=");
+            auto def = op(word(), type, {debug_name(name)});
+            if (def->type() != type) error("type mismatch for '{}': '{}' expected but got '{}'", name, type, def->type());
+            define(name, def);
+        } else {
+            // the App is printed as both name and definition: "callee(args): !! = callee(args)"
+            auto args = [&] {
+                std::vector<const Def*> result;
+                expect("(");
+                while (!accept(")")) {
+                    if (!result.empty()) expect(",");
+                    result.push_back(expr());
+                }
+                return result;
+            };
+            args();
+            expect(":");
+            type();
+            expect("=");
+            auto callee = lookup(word());
+            cont->jump(callee, args());
+        }
+    }
+
+    if (!cont->has_body()) error("continuation '{}' has no body", cont->unique_name());
+}
+
+/*
+ * defs
+ */
+
+const Def* Parser::lookup(const std::string& name) {
+    // params are printed as "continuation.param"
+    auto dot = name.rfind('.');
+    auto key = dot == std::string::npos ? name : name.substr(dot + 1);
+    auto i = defs_.find(key);
+    if (i == defs_.end()) error("unknown name '{}'", name);
+    if (dot != std::string::npos && !i->second->isa<Param>()) error("'{}' is not a parameter", name);
+    return i->second;
+}
+
+const Def* Parser::expr() {
+    auto w = word();
+    if (accept(type_sep)) return literal(w, word());
+    if (peek("("))        return op(w, nullptr, {});
+    return lookup(w);
+}
+
+const Def* Parser::op(const std::string& name, const Type* type, Debug dbg) {
+    std::vector<const Def*> ops;
+    std::optional<u64> index;
+    expect("(");
+    for (bool first = true; !accept(")"); first = false) {
+        if (!first) expect(",");
+        auto save = pos_;
+        auto w = word();
+        if (is_index(w) && !peek(type_sep)) {
+            index = std::strtoull(w.c_str(), nullptr, 10);
+        } else {
+            pos_ = save;
+            ops.push_back(expr());
+        }
+    }
+    if (!type && accept(type_sep)) type = this->type();
+    return build(name, ops, index, type, dbg);
+}
+
+const Def* Parser::build(const std::string& name, Defs o, std::optional<u64> index, const Type* t, Debug dbg) {
+    static const std::unordered_map<std::string, int> tags = {
+#define THORIN_NODE(op, abbr) { #abbr, Node_##op },
+#include "thorin/tables/nodetable.h"
+#define THORIN_ARITHOP(op) { #op, ArithOp_##op },
+#include "thorin/tables/arithoptable.h"
+#define THORIN_CMP(op) { #op, Cmp_##op },
+#include "thorin/tables/cmptable.h"
+#define THORIN_MATHOP(op) { #op, MathOp_##op },
+#include "thorin/tables/mathoptable.h"
+    };
+
+    auto num = [&] (size_t n) {
+        if (o.size() != n) error("'{}' expects {} operands but got {}", name, n, o.size());
+    };
+    auto typed = [&] (auto type) {
+        if (type == nullptr) error("'{}' requires a type annotation of the proper kind", name);
+        return type;
+    };
+
+    if (name == "global_mutable" || name == "global_immutable") {
+        num(1);
+        return world().global(o[0], name == "global_mutable", dbg);
+    }
+
+    auto i = tags.find(name);
+    if (i == tags.end()) error("unknown operation '{}'", name);
+    auto tag = i->second;
+
+    if (tag == Node_Variant || tag == Node_VariantExtract) {
+        num(1);
+        if (!index) error("'{}' expects an index", name);
+        if (tag == Node_VariantExtract) return world().variant_extract(o[0], *index, dbg);
+        auto variant_type = typed(t ? t->isa<VariantType>() : nullptr);
+        if (*index >= variant_type->num_ops()) error("variant index {} out of range", *index);
+        return world().variant(variant_type, o[0], *index, dbg);
+    }
+    if (index) error("unexpected index in '{}'", name);
+
+    switch (tag) {
+        case Node_Filter:          return world().filter(o, dbg);
+        case Node_Bottom:          num(0); return world().bottom(typed(t), dbg);
+        case Node_Top:             num(0); return world().top(typed(t), dbg);
+        case Node_Bitcast:         num(1); return world().bitcast(typed(t), o[0], dbg);
+        case Node_Cast:            num(1); return world().cast(typed(t), o[0], dbg);
+        case Node_Enter:           num(1); return world().enter(o[0], dbg);
+        case Node_Extract:         num(2); return world().extract(o[0], o[1], dbg);
+        case Node_Insert:          num(3); return world().insert(o[0], o[1], o[2], dbg);
+        case Node_Hlt:             num(1); return world().hlt(o[0], dbg);
+        case Node_Known:           num(1); return world().known(o[0], dbg);
+        case Node_Run:             num(1); return world().run(o[0], dbg);
+        case Node_LEA:             num(2); return world().lea(o[0], o[1], dbg);
+        case Node_Load:            num(2); return world().load(o[0], o[1], dbg);
+        case Node_Store:           num(3); return world().store(o[0], o[1], o[2], dbg);
+        case Node_Select:          num(3); return world().select(o[0], o[1], o[2], dbg);
+        case Node_AlignOf:         num(1); return world().align_of(o[0]->type(), dbg);
+        case Node_SizeOf:          num(1); return world().size_of(o[0]->type(), dbg);
+        case Node_Slot:            num(1); return world().slot(typed(t ? t->isa<PtrType>() : nullptr)->pointee(), o[0], dbg);
+        case Node_Tuple:           return world().tuple(o, dbg);
+        case Node_Vector:          if (o.empty()) num(1); return world().vector(o, dbg);
+        case Node_VariantIndex:    num(1); return world().variant_index(o[0], dbg);
+        case Node_Closure:         num(2); return world().closure(typed(t ? t->isa<ClosureType>() : nullptr), o[0], o[1], dbg);
+        case Node_StructAgg:       return world().struct_agg(typed(t ? t->isa<StructType>() : nullptr), o, dbg);
+        case Node_IndefiniteArray: num(1); return world().indefinite_array(typed(t ? t->isa<IndefiniteArrayType>() : nullptr)->elem_type(), o[0], dbg);
+        case Node_DefiniteArray:
+            if (auto array = t ? t->isa<DefiniteArrayType>() : nullptr) return world().definite_array(array->elem_type(), o, dbg);
+            if (o.empty()) typed((const Type*) nullptr);
+            return world().definite_array(o, dbg);
+        case Node_Alloc: {
+            num(2);
+            auto tuple = t ? t->isa<TupleType>() : nullptr;
+            auto ptr = tuple && tuple->num_ops() == 2 ? tuple->op(1)->isa<PtrType>() : nullptr;
+            return world().alloc(typed(ptr)->pointee(), o[0], o[1], dbg);
+        }
+        case Node_Assembly:        error("inline assembly is not supported");
+        default:
+            if (is_arithop(tag)) { num(2); return world().arithop(ArithOpTag(tag), o[0], o[1], dbg); }
+            if (is_cmp(tag))     { num(2); return world().cmp(CmpTag(tag), o[0], o[1], dbg); }
+            if (is_mathop(tag))  return world().mathop(MathOpTag(tag), o, dbg);
+            error("'{}' cannot be used as an operation", name);
+    }
+}
+
+template<class T>
+static std::optional<T> parse_int(const std::string& str) {
+    T val;
+    auto [ptr, ec] = std::from_chars(str.data(), str.data() + str.size(), val);
+    if (ec != std::errc() || ptr != str.data() + str.size()) return {};
+    return val;
+}
+
+static std::optional<double> parse_float(const std::string& str) {
+    char* end;
+    double val = std::strtod(str.c_str(), &end);
+    if (str.empty() || end != str.c_str() + str.size()) return {};
+    return val;
+}
+
+const Def* Parser::literal(const std::string& value, const std::string& type) {
+    auto tag = prim_type_tag(type);
+    switch (tag) {
+        case PrimType_bool:
+            if (value == "1" || value == "true")  return world().literal_bool(true,  {});
+            if (value == "0" || value == "false") return world().literal_bool(false, {});
+            break;
+#define THORIN_I_TYPE(T, M) \
+        case PrimType_##T: \
+            if (auto val = parse_int<M>(value)) return world().literal(tag, Box(*val), {}); \
+            break;
+#define THORIN_F_TYPE(T, M) \
+        case PrimType_##T: \
+            if (auto val = parse_float(value)) return world().literal(tag, Box(M(*val)), {}); \
+            break;
+#include "thorin/tables/primtypetable.h"
+        default: THORIN_UNREACHABLE;
+    }
+    error("invalid literal '{}' of type '{}'", value, type);
+}
+
+/*
+ * driver
+ */
+
+std::unique_ptr<World> Parser::run() {
+    try {
+        expect("module");
+        expect("'");
+        auto end = text_.find('\'', pos_);
+        if (end == std::string::npos) error("unterminated module name");
+        world_ = std::make_unique<World>(text_.substr(pos_, end - pos_));
+        pos_ = end + 1;
+
+        // nominal types may refer to each other: first create all of them, then set their operands
+        skip();
+        auto types = pos_;
+        while (peek_word("struct") || peek_word("variant"))
+            nominal(true);
+        skip();
+        auto conts = pos_;
+        pos_ = types;
+        while (pos_ != conts) {
+            nominal(false);
+            skip();
+        }
+
+        // continuations may be used before they are printed: first create all of them, then fill in their bodies
+        while (!eof())
+            continuation(true);
+        pos_ = conts;
+        while (!eof())
+            continuation(false);
+    } catch (const Error& e) {
+        size_t row = 1, col = 1;
+        for (size_t i = 0; i != pos_ && i != text_.size(); ++i) {
+            if (text_[i] == '\n') ++row, col = 1;
+            else ++col;
+        }
+        errf("{}:{}:{}: error: {}", filename_, row, col, e.msg);
+        return nullptr;
+    }
+
+    return std::move(world_);
+}
+
+std::unique_ptr<World> parse(std::istream& stream, const std::string& filename) {
+    std::string text((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+    return Parser(std::move(text), filename).run();
+}
+
+std::unique_ptr<World> parse(const std::string& filename) {
+    std::ifstream stream(filename);
+    if (!stream) {
+        errf("{}: error: cannot open file", filename);
+        return nullptr;
+    }
+    return parse(stream, filename);
+}
+
+}
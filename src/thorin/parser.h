@@ -0,0 +1,28 @@
+#ifndef THORIN_PARSER_H
+#define THORIN_PARSER_H
+
+#include <istream>
+#include <memory>
+#include <string>
+
+namespace thorin {
+
+class World;
+
+/**
+ * @name textual format
+ * Reads back what @p World::stream writes, e.g. a <tt>.thorin</tt> file dumped from a failing or slow compilation.
+ * The rebuilt @p World contains all @p Continuation%s, @p Param%s, primops, types, externals, and the calling convention of each @p Continuation.
+ * Intrinsics are recovered from the names of body-less, internal @p Continuation%s just like the front-end does.
+ *
+ * Not supported are inline assembly, debug locations, and custom @p Filter%s - all @p Continuation%s get the default filter.
+ * On error, a message is printed to @c std::cerr and @c nullptr is returned.
+ */
+//@{
+std::unique_ptr<World> parse(std::istream&, const std::string& filename = "<stdin>");
+std::unique_ptr<World> parse(const std::string& filename);
+//@}
+
+}
+
+#endif
@@ -1,3 +1,7 @@
+#include <algorithm>
+#include <limits>
+#include <sstream>
+
 #include "thorin/continuation.h"
 #include "thorin/primop.h"
 #include "thorin/world.h"
@@ -23,7 +27,12 @@ public:
 };
 
 void RecStreamer::run(const Def* def) {
-    if (def->no_dep() || !defs.emplace(def).second) return;
+    if (def->no_dep()) return;
+    if (!defs.emplace(def).second) {
+        // an App may be shared by several continuations but each body needs its own line
+        if (def->isa<App>()) def->stream_let(s);
+        return;
+    }
 
     for (auto op : def->ops()) { // for now, don't include debug info and type
         if (auto cont = op->isa_nom<Continuation>()) {
@@ -50,6 +59,8 @@ void RecStreamer::run() {
 
         if (cont->world().is_external(cont))
             s.fmt("extern ");
+        if (cont->cc() == CC::Device)
+            s.fmt("device ");
 
         if (cont->has_body()) {
             std::vector<std::string> param_names;
@@ -70,8 +81,38 @@ void Def::dump(size_t max) const { Stream s(std::cout); stream(s, max).endl(); }
 
 void Type::dump() const { Stream s(std::cout); stream(s).endl(); }
 
+/// Nodes whose type does not follow from their operands are annotated when streamed inline.
+static bool needs_type(const Def* def) {
+    switch (def->tag()) {
+        case Node_Top:
+        case Node_Bottom:
+        case Node_Cast:
+        case Node_Bitcast:
+        case Node_Variant:
+        case Node_StructAgg:
+        case Node_DefiniteArray:
+        case Node_IndefiniteArray:
+            return true;
+        default:
+            return false;
+    }
+}
+
+/// Prints enough digits to read back the very same value.
+template<class T>
+static std::string float_string(T val) {
+    std::ostringstream os;
+    os.precision(std::numeric_limits<T>::max_digits10);
+    os << val;
+    return os.str();
+}
+
 Stream& Def::stream(Stream& s) const {
-    if (isa<Param>() || isa<App>() || no_dep()) return stream1(s);
+    if (isa<Param>() || isa<App>()) return stream1(s);
+    if (no_dep()) {
+        stream1(s);
+        return needs_type(this) ? s.fmt("∷{}", type()) : s;
+    }
     return s << unique_name();
 }
 
@@ -111,6 +152,8 @@ Stream& Def::stream1(Stream& s) const {
             case PrimType_ps8: return s.fmt("{}∷ps8", (int)      lit->ps8_value());
             case PrimType_qu8: return s.fmt("{}∷qu8", (unsigned) lit->qu8_value());
             case PrimType_pu8: return s.fmt("{}∷pu8", (unsigned) lit->pu8_value());
+#define THORIN_F_TYPE(T, M) case PrimType_##T: return s.fmt("{}∷{}", float_string(lit->value().get_##M()), #T);
+#include "thorin/tables/primtypetable.h"
             default:
                 switch (lit->tag()) {
 #define THORIN_ALL_TYPE(T, M) case PrimType_##T: return s.fmt("{}∷{}", lit->value().get_##M(), #T);
@@ -118,6 +161,10 @@ Stream& Def::stream1(Stream& s) const {
                     default: THORIN_UNREACHABLE;
                 }
         }
+    } else if (auto variant = isa<Variant>()) {
+        return s.fmt("variant({}, {})", variant->value(), variant->index());
+    } else if (auto extract = isa<VariantExtract>()) {
+        return s.fmt("variant_extract({}, {})", extract->value(), extract->index());
     } else if (auto ass = isa<Assembly>()) {
         s.fmt("{} {} = asm \"{}\"\t\n", ass->type(), ass->unique_name(), ass->asm_template());
         s.fmt(": ({, })\n", ass->output_constraints());
@@ -127,7 +174,7 @@ Stream& Def::stream1(Stream& s) const {
         return s;
     }
 
-    return s.fmt("{}({, }))", op_name(), ops());
+    return s.fmt("{}({, })", op_name(), ops());
 }
 
 Stream& Def::stream_let(Stream& s) const {
@@ -138,6 +185,20 @@ Stream& World::stream(Stream& s) const {
     RecStreamer rec(s, std::numeric_limits<size_t>::max());
     s << "module '" << name() << "'";
 
+    std::vector<const NominalType*> nominals;
+    for (auto type : types()) {
+        if (auto nominal = type->isa<NominalType>())
+            nominals.push_back(nominal);
+    }
+    std::sort(nominals.begin(), nominals.end(), GIDLt<const NominalType*>());
+    if (!nominals.empty()) s.endl();
+    for (auto nominal : nominals) {
+        s.fmt("\n{} {} = [", nominal->isa<StructType>() ? "struct" : "variant", nominal->name());
+        for (size_t i = 0, e = nominal->num_ops(); i != e; ++i)
+            s.fmt("{}{}: {}", i == 0 ? "" : ", ", nominal->op_name(i), nominal->op(i));
+        s.fmt("]");
+    }
+
     for (auto&& [_, cont] : externals()) {
         rec.conts.push(cont);
         rec.run();
@@ -0,0 +1,577 @@
+#include "thorin/serialize.h"
+
+#include <cstring>
+#include <fstream>
+#include <string_view>
+#include <unordered_map>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "thorin/primop.h"
+#include "thorin/world.h"
+#include "thorin/util/cast.h"
+
+namespace thorin {
+
+static const char magic[8] = { 'T', 'H', 'O', 'R', 'I', 'N', 'B', 'F' };
+static const u32 version = 1;
+
+/*
+ * BinaryWriter
+ */
+
+class Buffer {
+public:
+    void put_u32(u32 val) {
+        for (int i = 0; i != 4; ++i)
+            data_.push_back(char(val >> (8*i)));
+    }
+    void put_u64(u64 val) {
+        put_u32(u32(val));
+        put_u32(u32(val >> 32_u64));
+    }
+    void bytes(const std::string& str) { data_ += str; }
+
+    const std::string& data() const { return data_; }
+
+private:
+    std::string data_;
+};
+
+class BinaryWriter {
+public:
+    BinaryWriter(const World& world)
+        : world_(world)
+    {}
+
+    void run(std::ostream&);
+
+private:
+    u32 string(const std::string&);
+    u32 type(const Type*);
+    u32 def(const Def*);
+    void continuation(const Continuation*);
+    void record(const Def*);
+    void debug(const Def*);
+
+    const World& world_;
+    std::unordered_map<std::string, u32> string_index_;
+    TypeMap<u32> type_index_;
+    DefMap<u32> def_index_;
+    std::vector<const NominalType*> nominals_;
+    std::vector<const Continuation*> continuations_;
+    u32 num_strings_ = 0, num_types_ = 0, num_defs_ = 0;
+    Buffer strings_, types_, defs_;
+};
+
+u32 BinaryWriter::string(const std::string& str) {
+    auto [i, inserted] = string_index_.emplace(str, num_strings_);
+    if (inserted) {
+        ++num_strings_;
+        strings_.put_u32(str.size());
+        strings_.bytes(str);
+    }
+    return i->second;
+}
+
+u32 BinaryWriter::type(const Type* type) {
+    if (auto i = type_index_.lookup(type)) return *i;
+
+    if (auto nominal = type->isa<NominalType>()) {
+        // operands may refer back to this type, so they are set after all types have been created
+        auto i = type_index_[type] = num_types_++;
+        types_.put_u32(type->tag());
+        types_.put_u32(string(nominal->name().str()));
+        types_.put_u32(type->num_ops());
+        for (auto name : nominal->op_names())
+            types_.put_u32(string(name.str()));
+        nominals_.push_back(nominal);
+        for (auto op : type->ops())
+            this->type(op);
+        return i;
+    }
+
+    Array<u32> ops(type->num_ops());
+    for (size_t i = 0, e = ops.size(); i != e; ++i)
+        ops[i] = this->type(type->op(i));
+
+    auto i = type_index_[type] = num_types_++;
+    types_.put_u32(type->tag());
+    if (auto ptr = type->isa<PtrType>()) {
+        types_.put_u32(ptr->length());
+        types_.put_u32(ptr->device());
+        types_.put_u32(u32(ptr->addr_space()));
+    } else if (auto prim = type->isa<PrimType>()) {
+        types_.put_u32(prim->length());
+    } else if (auto array = type->isa<DefiniteArrayType>()) {
+        types_.put_u64(array->dim());
+    }
+    types_.put_u32(ops.size());
+    for (auto op : ops)
+        types_.put_u32(op);
+    return i;
+}
+
+void BinaryWriter::debug(const Def* def) {
+    auto loc = def->loc();
+    defs_.put_u32(string(def->name()));
+    defs_.put_u32(string(loc.file));
+    defs_.put_u32(loc.begin.row);
+    defs_.put_u32(loc.begin.col);
+    defs_.put_u32(loc.finis.row);
+    defs_.put_u32(loc.finis.col);
+}
+
+void BinaryWriter::continuation(const Continuation* cont) {
+    def_index_[cont] = num_defs_++;
+    defs_.put_u32(Node_Continuation);
+    defs_.put_u32(type(cont->type()));
+    debug(cont);
+    defs_.put_u32(u32(cont->intrinsic()));
+    defs_.put_u32(u32(cont->cc()));
+    defs_.put_u32(cont->is_external());
+    defs_.put_u32(cont->num_params());
+    for (auto param : cont->params())
+        defs_.put_u32(string(param->name()));
+    if (cont != world_.branch() && cont != world_.end_scope())
+        continuations_.push_back(cont);
+}
+
+void BinaryWriter::record(const Def* def) {
+    def_index_[def] = num_defs_++;
+    defs_.put_u32(def->tag());
+    defs_.put_u32(type(def->type()));
+    debug(def);
+    defs_.put_u32(def->num_ops());
+    for (auto op : def->ops())
+        defs_.put_u32(def_index_[op]);
+
+    if (auto param = def->isa<Param>()) {
+        defs_.put_u32(param->index());
+    } else if (auto lit = def->isa<PrimLit>()) {
+        defs_.put_u64(bitcast<u64, Box>(lit->value()));
+    } else if (auto variant = def->isa<Variant>()) {
+        defs_.put_u64(variant->index());
+    } else if (auto extract = def->isa<VariantExtract>()) {
+        defs_.put_u64(extract->index());
+    } else if (auto global = def->isa<Global>()) {
+        defs_.put_u32(global->is_mutable());
+    } else if (auto assembly = def->isa<Assembly>()) {
+        defs_.put_u32(string(assembly->asm_template()));
+        for (auto strs : { assembly->output_constraints(), assembly->input_constraints(), assembly->clobbers() }) {
+            defs_.put_u32(strs.size());
+            for (auto& str : strs)
+                defs_.put_u32(string(str));
+        }
+        defs_.put_u32(assembly->flags());
+    }
+}
+
+u32 BinaryWriter::def(const Def* root) {
+    // operands are recorded before their users; iteratively, as mem chains can get very long
+    std::vector<std::pair<const Def*, bool>> stack;
+    stack.emplace_back(root, false);
+    while (!stack.empty()) {
+        auto [def, expanded] = stack.back();
+        if (def_index_.contains(def)) {
+            stack.pop_back();
+        } else if (auto cont = def->isa_nom<Continuation>()) {
+            stack.pop_back();
+            continuation(cont);
+        } else if (!expanded) {
+            stack.back().second = true;
+            for (size_t i = def->num_ops(); i-- != 0;) {
+                if (!def_index_.contains(def->op(i)))
+                    stack.emplace_back(def->op(i), false);
+            }
+        } else {
+            stack.pop_back();
+            record(def);
+        }
+    }
+    return def_index_[root];
+}
+
+void BinaryWriter::run(std::ostream& stream) {
+    auto name = string(world_.name());
+    for (auto [_, cont] : world_.externals())
+        def(cont);
+
+    // bodies and filters - this may discover more continuations
+    Buffer bodies;
+    for (size_t i = 0; i != continuations_.size(); ++i) {
+        auto cont = continuations_[i];
+        auto body = def(cont->op(0)), filter = def(cont->op(1));
+        bodies.put_u32(def_index_[cont]);
+        bodies.put_u32(body);
+        bodies.put_u32(filter);
+    }
+
+    Buffer nominals;
+    for (auto nominal : nominals_) {
+        nominals.put_u32(type_index_[nominal]);
+        for (auto op : nominal->ops())
+            nominals.put_u32(type_index_[op]);
+    }
+
+    Buffer header;
+    header.bytes(std::string(magic, sizeof(magic)));
+    header.put_u32(version);
+    header.put_u32(name);
+    header.put_u32(world_.is_pe_done());
+    header.put_u32(num_strings_);
+    stream << header.data() << strings_.data();
+
+    Buffer counts;
+    counts.put_u32(num_types_);
+    stream << counts.data() << types_.data();
+    counts = {};
+    counts.put_u32(nominals_.size());
+    stream << counts.data() << nominals.data();
+    counts = {};
+    counts.put_u32(num_defs_);
+    stream << counts.data() << defs_.data();
+    counts = {};
+    counts.put_u32(continuations_.size());
+    stream << counts.data() << bodies.data();
+}
+
+void save(const World& world, std::ostream& stream) { BinaryWriter(world).run(stream); }
+
+bool save(const World& world, const std::string& filename) {
+    std::ofstream stream(filename, std::ios::binary);
+    save(world, stream);
+    return bool(stream);
+}
+
+/*
+ * BinaryReader
+ */
+
+class BinaryReader {
+public:
+    BinaryReader(const char* data, size_t size)
+        : cur_(data)
+        , end_(data + size)
+    {}
+
+    std::unique_ptr<World> run();
+
+private:
+    bool ok() const { return ok_; }
+    u32 get_u32() {
+        if (end_ - cur_ < 4) return fail();
+        u32 val = 0;
+        for (int i = 0; i != 4; ++i)
+            val |= u32(u8(cur_[i])) << (8*i);
+        cur_ += 4;
+        return val;
+    }
+    u64 get_u64() {
+        auto lo = get_u32(), hi = get_u32();
+        return u64(hi) << 32_u64 | lo;
+    }
+    std::string_view bytes(size_t size) {
+        if (size_t(end_ - cur_) < size) return fail(), std::string_view();
+        std::string_view result(cur_, size);
+        cur_ += size;
+        return result;
+    }
+    std::string string() {
+        auto i = get_u32();
+        if (i >= strings_.size()) return fail(), std::string();
+        return std::string(strings_[i]);
+    }
+    const Type* type() {
+        auto i = get_u32();
+        if (i >= types_.size()) return fail(), nullptr;
+        return types_[i];
+    }
+    const Def* def() {
+        auto i = get_u32();
+        if (i >= defs_.size()) return fail(), nullptr;
+        return defs_[i];
+    }
+    u32 fail() { ok_ = false; cur_ = end_; return 0; }
+
+    Debug debug();
+    const Type* read_type(World&);
+    const Def* read_def(World&);
+
+    const char* cur_;
+    const char* end_;
+    bool ok_ = true;
+    std::vector<std::string_view> strings_;
+    std::vector<const Type*> types_;
+    std::vector<const Def*> defs_;
+};
+
+Debug BinaryReader::debug() {
+    auto name = string();
+    Loc loc;
+    loc.file = string();
+    loc.begin.row = get_u32();
+    loc.begin.col = get_u32();
+    loc.finis.row = get_u32();
+    loc.finis.col = get_u32();
+    return {name, loc};
+}
+
+const Type* BinaryReader::read_type(World& world) {
+    auto tag = int(get_u32());
+    if (tag == Node_StructType || tag == Node_VariantType) {
+        auto name = string();
+        auto size = get_u32();
+        const NominalType* nominal;
+        if (tag == Node_StructType)
+            nominal = world.struct_type(name, size);
+        else
+            nominal = world.variant_type(name, size);
+        for (size_t i = 0; i != size && ok(); ++i)
+            nominal->set_op_name(i, string());
+        return nominal;
+    }
+
+    u32 length = 1, device = 0, addr_space = 0;
+    u64 dim = 0;
+    if (tag == Node_PtrType) {
+        length     = get_u32();
+        device     = get_u32();
+        addr_space = get_u32();
+    } else if (is_primtype(tag)) {
+        length = get_u32();
+    } else if (tag == Node_DefiniteArrayType) {
+        dim = get_u64();
+    }
+
+    auto num_ops = get_u32();
+    if (num_ops > size_t(end_ - cur_)) return fail(), nullptr;
+    Array<const Type*> ops(num_ops);
+    for (auto& op : ops)
+        op = type();
+    if (!ok()) return nullptr;
+
+    auto num = [&] (size_t n) { return ops.size() == n ? true : (fail(), false); };
+    switch (tag) {
+        case Node_PtrType:             return num(1) ? world.ptr_type(ops[0], length, device, AddrSpace(addr_space)) : nullptr;
+        case Node_DefiniteArrayType:   return num(1) ? world.definite_array_type(ops[0], dim) : nullptr;
+        case Node_IndefiniteArrayType: return num(1) ? world.indefinite_array_type(ops[0]) : nullptr;
+        case Node_FnType:              return world.fn_type(ops);
+        case Node_ClosureType:         return world.closure_type(ops);
+        case Node_TupleType:           return world.tuple_type(ops);
+        case Node_MemType:             return world.mem_type();
+        case Node_FrameType:           return world.frame_type();
+        case Node_BotType:             return world.bottom_type();
+        default:
+            if (is_primtype(tag)) return world.prim_type(PrimTypeTag(tag), length);
+            return fail(), nullptr;
+    }
+}
+
+const Def* BinaryReader::read_def(World& w) {
+    auto tag = int(get_u32());
+    auto t = type();
+    auto dbg = debug();
+    if (!ok()) return nullptr;
+
+    if (tag == Node_Continuation) {
+        auto intrinsic = Intrinsic(get_u32());
+        auto cc = CC(get_u32());
+        bool external = get_u32();
+        auto num_params = get_u32();
+        if (!ok() || !t->isa<FnType>() || num_params != t->num_ops()) return fail(), nullptr;
+        Array<std::string> names(num_params);
+        for (auto& name : names)
+            name = string();
+
+        if (intrinsic == Intrinsic::Branch)   return w.branch();
+        if (intrinsic == Intrinsic::EndScope) return w.end_scope();
+
+        Continuation::Attributes attributes(cc);
+        attributes.intrinsic = intrinsic;
+        auto cont = w.continuation(t->as<FnType>(), attributes, dbg);
+        for (size_t i = 0; i != num_params; ++i)
+            cont->param(i)->set_name(names[i]);
+        if (external)
+            w.make_external(cont);
+        return cont;
+    }
+
+    auto num_ops = get_u32();
+    if (num_ops > size_t(end_ - cur_)) return fail(), nullptr;
+    Array<const Def*> ops(num_ops);
+    for (auto& op : ops)
+        op = def();
+    if (!ok()) return nullptr;
+
+    auto num = [&] (size_t n) { return ops.size() == n ? true : (fail(), false); };
+    Defs o = ops;
+    switch (tag) {
+        case Node_Param: {
+            auto index = get_u32();
+            auto cont = num(1) ? o[0]->isa_nom<Continuation>() : nullptr;
+            if (!cont || index >= cont->num_params()) return fail(), nullptr;
+            cont->param(index)->set_name(dbg.name);
+            return cont->param(index);
+        }
+        case Node_Variant: {
+            auto index = get_u64();
+            auto variant_type = t->isa<VariantType>();
+            return variant_type && num(1) ? w.variant(variant_type, o[0], index, dbg) : (fail(), nullptr);
+        }
+        case Node_VariantExtract: {
+            auto index = get_u64();
+            return num(1) ? w.variant_extract(o[0], index, dbg) : nullptr;
+        }
+        case Node_Global: {
+            bool is_mutable = get_u32();
+            return num(1) ? w.global(o[0], is_mutable, dbg) : nullptr;
+        }
+        case Node_Assembly: {
+            auto asm_template = string();
+            Array<std::string> constraints[3];
+            for (auto& strs : constraints) {
+                auto size = get_u32();
+                if (size > size_t(end_ - cur_)) return fail(), nullptr;
+                strs = Array<std::string>(size);
+                for (auto& str : strs)
+                    str = string();
+            }
+            auto flags = Assembly::Flags(get_u32());
+            if (!ok() || o.empty()) return fail(), nullptr;
+            return w.assembly(t, o, asm_template, constraints[0], constraints[1], constraints[2], flags, dbg);
+        }
+        case Node_App:             return !o.empty() ? w.app(o[0], o.skip_front(), dbg) : (fail(), nullptr);
+        case Node_Filter:          return w.filter(o, dbg);
+        case Node_Bottom:          return w.bottom(t, dbg);
+        case Node_Top:             return w.top(t, dbg);
+        case Node_Bitcast:         return num(1) ? w.bitcast(t, o[0], dbg) : nullptr;
+        case Node_Cast:            return num(1) ? w.cast(t, o[0], dbg) : nullptr;
+        case Node_Enter:           return num(1) ? w.enter(o[0], dbg) : nullptr;
+        case Node_Extract:         return num(2) ? w.extract(o[0], o[1], dbg) : nullptr;
+        case Node_Insert:          return num(3) ? w.insert(o[0], o[1], o[2], dbg) : nullptr;
+        case Node_Hlt:             return num(1) ? w.hlt(o[0], dbg) : nullptr;
+        case Node_Known:           return num(1) ? w.known(o[0], dbg) : nullptr;
+        case Node_Run:             return num(1) ? w.run(o[0], dbg) : nullptr;
+        case Node_LEA:             return num(2) ? w.lea(o[0], o[1], dbg) : nullptr;
+        case Node_Load:            return num(2) ? w.load(o[0], o[1], dbg) : nullptr;
+        case Node_Store:           return num(3) ? w.store(o[0], o[1], o[2], dbg) : nullptr;
+        case Node_Select:          return num(3) ? w.select(o[0], o[1], o[2], dbg) : nullptr;
+        case Node_AlignOf:         return num(1) ? w.align_of(o[0]->type(), dbg) : nullptr;
+        case Node_SizeOf:          return num(1) ? w.size_of(o[0]->type(), dbg) : nullptr;
+        case Node_Slot:            return num(1) && t->isa<PtrType>() ? w.slot(t->as<PtrType>()->pointee(), o[0], dbg) : (fail(), nullptr);
+        case Node_Tuple:           return w.tuple(o, dbg);
+        case Node_Vector:          return !o.empty() ? w.vector(o, dbg) : (fail(), nullptr);
+        case Node_VariantIndex:    return num(1) ? w.variant_index(o[0], dbg) : nullptr;
+        case Node_Closure:         return num(2) && t->isa<ClosureType>() ? w.closure(t->as<ClosureType>(), o[0], o[1], dbg) : (fail(), nullptr);
+        case Node_StructAgg:       return t->isa<StructType>() ? w.struct_agg(t->as<StructType>(), o, dbg) : (fail(), nullptr);
+        case Node_DefiniteArray:   return t->isa<DefiniteArrayType>() ? w.definite_array(t->as<DefiniteArrayType>()->elem_type(), o, dbg) : (fail(), nullptr);
+        case Node_IndefiniteArray: return num(1) && t->isa<IndefiniteArrayType>() ? w.indefinite_array(t->as<IndefiniteArrayType>()->elem_type(), o[0], dbg) : (fail(), nullptr);
+        case Node_Alloc: {
+            auto tuple = t->isa<TupleType>();
+            auto ptr = tuple && tuple->num_ops() == 2 ? tuple->op(1)->isa<PtrType>() : nullptr;
+            return num(2) && ptr ? w.alloc(ptr->pointee(), o[0], o[1], dbg) : (fail(), nullptr);
+        }
+        default:
+            if (is_primtype(tag)) {
+                auto box = bitcast<Box, u64>(get_u64());
+                return w.literal(PrimTypeTag(tag), box, dbg);
+            }
+            if (is_arithop(tag)) return num(2) ? w.arithop(ArithOpTag(tag), o[0], o[1], dbg) : nullptr;
+            if (is_cmp(tag))     return num(2) ? w.cmp(CmpTag(tag), o[0], o[1], dbg) : nullptr;
+            if (is_mathop(tag))  return w.mathop(MathOpTag(tag), o, dbg);
+            return fail(), nullptr;
+    }
+}
+
+std::unique_ptr<World> BinaryReader::run() {
+    if (bytes(sizeof(magic)) != std::string_view(magic, sizeof(magic)) || get_u32() != version)
+        return nullptr;
+
+    auto name = get_u32();
+    bool pe_done = get_u32();
+    auto num_strings = get_u32();
+    for (size_t i = 0; i != num_strings && ok(); ++i)
+        strings_.push_back(bytes(get_u32()));
+    if (!ok() || name >= strings_.size())
+        return nullptr;
+
+    auto world = std::make_unique<World>(std::string(strings_[name]));
+    world->mark_pe_done(pe_done);
+
+    auto num_types = get_u32();
+    for (size_t i = 0; i != num_types && ok(); ++i)
+        types_.push_back(read_type(*world));
+
+    auto num_nominals = get_u32();
+    for (size_t i = 0; i != num_nominals && ok(); ++i) {
+        auto index = get_u32();
+        auto nominal = index < types_.size() && types_[index] ? types_[index]->isa<NominalType>() : nullptr;
+        if (!nominal)
+            return nullptr;
+        for (size_t j = 0, e = nominal->num_ops(); j != e; ++j) {
+            auto op = type();
+            if (!ok())
+                return nullptr;
+            nominal->set(j, op);
+        }
+    }
+    if (!ok())
+        return nullptr;
+
+    auto num_defs = get_u32();
+    for (size_t i = 0; i != num_defs && ok(); ++i)
+        defs_.push_back(read_def(*world));
+
+    auto num_bodies = get_u32();
+    for (size_t i = 0; i != num_bodies && ok(); ++i) {
+        auto cont = def(), body = def(), filter = def();
+        if (!ok() || !cont->isa_nom<Continuation>() || !filter->isa<Filter>())
+            return nullptr;
+        auto ncont = cont->as_nom<Continuation>();
+        if (auto app = body->isa<App>())
+            ncont->set_body(app);
+        ncont->set_filter(filter->as<Filter>());
+    }
+
+    if (!ok())
+        return nullptr;
+    return world;
+}
+
+std::unique_ptr<World> load(const char* data, size_t size) { return BinaryReader(data, size).run(); }
+
+std::unique_ptr<World> load(const std::string& filename) {
+#ifdef _WIN32
+    std::ifstream stream(filename, std::ios::binary);
+    if (!stream)
+        return nullptr;
+    std::string data((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+    return load(data.data(), data.size());
+#else
+    // map the file - strings are read directly out of the mapping
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+        return nullptr;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        return nullptr;
+    }
+    auto size = size_t(st.st_size);
+    auto data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+        return nullptr;
+    auto world = load(static_cast<const char*>(data), size);
+    munmap(data, size);
+    return world;
+#endif
+}
+
+}
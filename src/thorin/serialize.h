@@ -0,0 +1,35 @@
+#ifndef THORIN_SERIALIZE_H
+#define THORIN_SERIALIZE_H
+
+#include <memory>
+#include <ostream>
+#include <string>
+
+namespace thorin {
+
+class World;
+
+/**
+ * @name binary format
+ * Compact binary representation of a @p World - e.g. to hand an optimized program from the front-end process to a back-end process.
+ * A file consists of
+ *  - a string pool with all names, file names, and inline assembly strings,
+ *  - a type table; each type refers to its operands by index,
+ *  - a node table in which each node refers to its type and its operands by index,
+ *  - the bodies and filters of all @p Continuation%s.
+ *
+ * Only what is reachable from the externals of the @p World is saved.
+ * All numbers are stored little-endian.
+ */
+//@{
+void save(const World&, std::ostream&);
+bool save(const World&, const std::string& filename);
+/// Returns @c nullptr if @p filename is not a file written by @p save with the current format version.
+std::unique_ptr<World> load(const std::string& filename);
+/// As above but reads from memory.
+std::unique_ptr<World> load(const char* data, size_t size);
+//@}
+
+}
+
+#endif
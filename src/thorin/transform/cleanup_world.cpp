@@ -24,8 +24,6 @@ public:
     void eta_conversion();
     void eliminate_params();
     void rebuild();
-    void verify_closedness();
-    void within(const Def*);
     void clean_pe_infos();
 
 private:
@@ -248,30 +246,6 @@ void Cleaner::rebuild() {
     todo_ |= importer.todo();
 }
 
-void Cleaner::verify_closedness() {
-    auto check = [&](const Def* def) {
-        size_t i = 0;
-        for (auto op : def->ops()) {
-            within(op);
-            assert_unused(op->uses().contains(Use(i++, def)) && "can't find def in op's uses");
-        }
-
-        for (const auto& use : def->uses()) {
-            within(use);
-            assert(use->op(use.index()) == def && "use doesn't point to def");
-        }
-    };
-
-    for (auto def : world().defs())
-        check(def);
-}
-
-void Cleaner::within(const Def* def) {
-    if (def->isa<Param>()) return; // TODO remove once Params are within World's sea of nodes
-    assert(world().types().contains(def->type()));
-    assert_unused(world().defs().contains(def));
-}
-
 void Cleaner::clean_pe_info(std::queue<Continuation*> queue, Continuation* cur) {
     assert(cur->has_body());
     auto body = cur->body();
@@ -351,10 +325,7 @@ void Cleaner::cleanup() {
     }
 
     world_.VLOG("end cleanup");
-#if THORIN_ENABLE_CHECKS
-    verify_closedness();
     debug_verify(world());
-#endif
 }
 
 void cleanup_world(World& world) { Cleaner(world).cleanup(); }
@@ -10,11 +10,18 @@ namespace thorin {
 
 class ClosureConversion {
 public:
+    /// A higher-order param that only ever receives up to this many distinct closed continuations is specialized once for each of them.
+    static constexpr size_t MaxCallees = 4;
+
     ClosureConversion(World& world)
         : world_(world)
     {}
 
     void run() {
+        if (defunctionalize())
+            world_.cleanup();
+        find_non_escaping();
+
         // create a new continuation for every continuation taking a function as parameter
         std::vector<std::pair<Continuation*, Continuation*>> converted;
         for (auto continuation : world_.copy_continuations()) {
@@ -31,6 +38,7 @@ public:
                     new_continuation->set_intrinsic();
 
                 new_defs_[continuation] = new_continuation;
+                originals_[new_continuation] = continuation;
                 if (continuation->has_body()) {
                     auto body = continuation->body();
                     for (size_t i = 0, e = continuation->num_params(); i != e; ++i)
@@ -57,6 +65,199 @@ public:
         }
     }
 
+    /**
+     * Specializes each continuation whose call sites are all known for the closed continuations it receives through a higher-order param.
+     * The specialized copies call them directly, so these arguments never become closures.
+     * Returns whether anything changed.
+     */
+    bool defunctionalize() {
+        bool result = false;
+        for (bool todo = true; todo;) {
+            todo = false;
+            for (auto continuation : world_.copy_continuations()) {
+                if (!continuation->has_body() || continuation->is_intrinsic() || continuation->is_external())
+                    continue;
+
+                std::vector<const App*> calls;
+                if (!find_calls(continuation, calls))
+                    continue;
+
+                for (size_t i = 0, e = continuation->num_params(); i != e; ++i) {
+                    if (continuation->param(i)->order() > 1 && specialize(continuation, i, calls)) {
+                        todo = result = true;
+                        break;
+                    }
+                }
+            }
+        }
+        return result;
+    }
+
+    /// Collects all calls of @p continuation; returns @c false if it is also used in any other way.
+    static bool find_calls(Continuation* continuation, std::vector<const App*>& calls) {
+        for (auto use : continuation->uses()) {
+            if (use->isa<Param>()) continue;
+            auto app = use->isa<App>();
+            if (app == nullptr || use.index() != 0)
+                return false;
+            if (!app->using_continuations().empty())
+                calls.push_back(app);
+        }
+        return !calls.empty();
+    }
+
+    /// A continuation that can be called from anywhere without an environment.
+    bool is_closed(Continuation* continuation) {
+        if (continuation->is_intrinsic()) return false;
+        if (!continuation->has_body()) return true;
+        auto i = closed_.find(continuation);
+        if (i != closed_.end()) return i->second;
+        return closed_[continuation] = !Scope(continuation).has_free_params();
+    }
+
+    /// Recursive calls that pass the param on unchanged are left alone; their specialized copies call the specialized version.
+    bool specialize(Continuation* continuation, size_t index, const std::vector<const App*>& calls) {
+        auto param = continuation->param(index);
+        std::vector<Continuation*> callees;
+        for (auto call : calls) {
+            if (call->arg(index) == param) continue;
+            auto callee = call->arg(index)->isa_nom<Continuation>();
+            if (callee == nullptr || !is_closed(callee))
+                return false;
+            if (std::find(callees.begin(), callees.end(), callee) == callees.end())
+                callees.push_back(callee);
+        }
+        if (callees.empty() || callees.size() > MaxCallees)
+            return false;
+
+        for (auto call : calls) {
+            if (call->arg(index) == param) continue;
+            auto callee = call->arg(index)->as_nom<Continuation>();
+            auto& specialized = specialized_[{ continuation, index, callee }];
+            if (specialized == nullptr) {
+                Array<const Def*> args(continuation->num_params());
+                args[index] = callee;
+                specialized = drop(Scope(continuation), args);
+                world_.VLOG("defunctionalized '{}': calling '{}' directly in '{}'", continuation, callee, specialized);
+            }
+
+            Array<const Def*> new_args(call->num_args() - 1);
+            for (size_t i = 0, j = 0, e = call->num_args(); i != e; ++i) {
+                if (i != index)
+                    new_args[j++] = call->arg(i);
+            }
+            for (auto caller : call->using_continuations())
+                caller->jump(specialized, new_args, call->debug());
+        }
+        return true;
+    }
+
+    /**
+     * Finds the higher-order params that are only ever called or passed on to other such params.
+     * A closure passed for one of them cannot outlive the call it is passed to.
+     *
+     * Calling a param from a continuation nested in its scope does not count as a call, though, if that continuation escapes:
+     * its closure captures the param and may be called after the param's continuation has returned.
+     * A continuation escapes if it is used other than as a callee or as an argument for a non-escaping param,
+     * or if it is captured by an escaping continuation - then everything it captures escapes, too.
+     */
+    void find_non_escaping() {
+        std::vector<const Param*> escaping_params;
+        std::vector<Continuation*> escaping_continuations;
+        ParamMap<std::vector<const Param*>> passed_from;
+        ParamMap<std::vector<Continuation*>> continuations_passed_to;
+        auto is_known = [] (Continuation* continuation) { return continuation && continuation->has_body() && !continuation->is_intrinsic(); };
+
+        for (auto continuation : world_.copy_continuations()) {
+            if (!is_known(continuation))
+                continue;
+
+            if (continuation->order() > 1) {
+                for (auto use : continuation->uses()) {
+                    if (use->isa<Param>())
+                        continue;
+                    auto app = use->isa<App>();
+                    if (app != nullptr && use.index() == 0)
+                        continue; // a call
+                    auto callee = app != nullptr ? app->callee()->isa_nom<Continuation>() : nullptr;
+                    if (!is_known(callee)) {
+                        escaping_continuations.push_back(continuation);
+                        break;
+                    }
+                    continuations_passed_to[callee->param(use.index() - 1)].push_back(continuation);
+                }
+            }
+
+            for (auto param : continuation->params()) {
+                if (param->order() <= 1)
+                    continue;
+                non_escaping_.emplace(param);
+
+                for (auto use : param->uses()) {
+                    auto app = use->isa<App>();
+                    if (app != nullptr && use.index() == 0)
+                        continue; // a call - unless made from an escaping continuation, see below
+                    auto callee = app != nullptr ? app->callee()->isa_nom<Continuation>() : nullptr;
+                    if (!is_known(callee)) {
+                        escaping_params.push_back(param);
+                        break;
+                    }
+                    passed_from[callee->param(use.index() - 1)].push_back(param);
+                }
+            }
+        }
+
+        ContinuationSet escaping;
+        while (!escaping_params.empty() || !escaping_continuations.empty()) {
+            if (!escaping_params.empty()) {
+                auto param = escaping_params.back();
+                escaping_params.pop_back();
+                if (non_escaping_.erase(param) == 0)
+                    continue;
+                if (auto i = passed_from.find(param); i != passed_from.end())
+                    escaping_params.insert(escaping_params.end(), i->second.begin(), i->second.end());
+                if (auto i = continuations_passed_to.find(param); i != continuations_passed_to.end())
+                    escaping_continuations.insert(escaping_continuations.end(), i->second.begin(), i->second.end());
+                continue;
+            }
+
+            auto continuation = escaping_continuations.back();
+            escaping_continuations.pop_back();
+            if (!escaping.emplace(continuation).second)
+                continue;
+
+            // everything the closure of continuation captures
+            Scope scope(continuation);
+            for (auto param : scope.free_params())
+                escaping_params.push_back(param);
+            unique_queue<DefSet> queue;
+            for (auto def : scope.free())
+                queue.push(def);
+            while (!queue.empty()) {
+                auto def = queue.pop();
+                if (auto free = def->isa_nom<Continuation>()) {
+                    if (is_known(free))
+                        escaping_continuations.push_back(free);
+                } else if (!def->isa<Param>()) {
+                    for (auto op : def->ops())
+                        queue.push(op);
+                }
+            }
+        }
+    }
+
+    /// Whether the closure passed as @p index'th argument to @p callee may keep its environment on the caller's frame.
+    bool is_stack_env(const Def* callee, size_t index) {
+        auto continuation = callee->isa_nom<Continuation>();
+        if (continuation == nullptr)
+            return false;
+        auto i = originals_.find(continuation);
+        if (i != originals_.end())
+            continuation = i->second;
+        // the caller must not continue before the callee has returned
+        return continuation->is_returning() && index < continuation->num_params() && non_escaping_.contains(continuation->param(index));
+    }
+
     void convert_jump(Continuation* continuation) {
         assert(continuation->has_body());
         auto body = continuation->body();
@@ -65,8 +266,25 @@ public:
         if (callee == continuation) return;
         if (!callee || !callee->is_intrinsic()) {
             Array<const Def*> new_args(body->num_args());
-            for (size_t i = 0, e = body->num_args(); i != e; ++i)
-                new_args[i] = convert(body->arg(i));
+            size_t mem_index = body->num_args();
+            for (size_t i = 0, e = body->num_args(); i != e; ++i) {
+                if (is_mem(body->arg(i))) {
+                    mem_index = i;
+                    new_args[i] = convert(body->arg(i));
+                }
+            }
+
+            for (size_t i = 0, e = body->num_args(); i != e; ++i) {
+                if (i == mem_index) continue;
+                auto arg = body->arg(i);
+                auto lambda = (new_defs_.count(arg) ? new_defs_[arg] : arg)->isa_nom<Continuation>();
+                if (mem_index != e && lambda && lambda->has_body() && lambda->order() > 1 && is_stack_env(body->callee(), i)) {
+                    convert_jump(lambda);
+                    new_args[i] = closure(lambda, &new_args[mem_index]);
+                } else {
+                    new_args[i] = convert(arg);
+                }
+            }
             continuation->jump(convert(body->callee(), true), new_args, continuation->debug());
         }
     }
@@ -83,70 +301,7 @@ public:
             if (as_callee)
                 return continuation;
 
-            world_.WLOG("slow: closure generated for '{}'", continuation);
-
-            // lift the continuation from its scope
-            Scope scope(continuation);
-            auto def_set = free_defs(scope, false);
-            Array<const Def*> free_vars(def_set.begin(), def_set.end());
-            auto filtered_out = std::remove_if(free_vars.begin(), free_vars.end(), [] (const Def* def) {
-                assert(!is_mem(def));
-                auto continuation = def->isa_nom<Continuation>();
-                return continuation && (!continuation->has_body() || continuation->is_intrinsic());
-            });
-            free_vars.shrink(filtered_out - free_vars.begin());
-            auto lifted = lift(scope, free_vars);
-
-            // get the environment type
-            const Type* env_type = nullptr;
-            bool thin_env = free_vars.size() == 1 && is_thin(free_vars[0]->type());
-            if (thin_env) {
-                // optimization: if the environment fits within a pointer or
-                // primitive type, pass it by value.
-                env_type = free_vars[0]->type();
-            } else {
-                Array<const Type*> env_ops(free_vars.size());
-                for (size_t i = 0, e = free_vars.size(); i != e; ++i)
-                    env_ops[i] = free_vars[i]->type();
-                env_type = world_.tuple_type(env_ops);
-            }
-
-            // create a wrapper that takes a pointer to the environment
-            size_t env_param_index = continuation->num_params();
-            Array<const Type*> wrapper_param_types(env_param_index + 1);
-            for (size_t i = 0, e = continuation->num_params(); i != e; ++i)
-                wrapper_param_types[i] = continuation->param(i)->type();
-            wrapper_param_types.back() = Closure::environment_type(world_);
-            auto wrapper_type = world_.fn_type(wrapper_param_types);
-            auto wrapper = world_.continuation(wrapper_type, continuation->debug());
-
-            Array<const Def*> wrapper_args(lifted->num_params());
-            const Def* new_mem = wrapper->mem_param();
-            if (thin_env) {
-                wrapper_args[env_param_index] = world_.cast(free_vars[0]->type(), wrapper->param(env_param_index));
-            } else {
-                // make the wrapper load the pointer and pass each
-                // variable of the environment to the lifted continuation
-                auto env_ptr = world_.cast(Closure::environment_ptr_type(world_), wrapper->param(env_param_index));
-                auto loaded_env = world_.load(wrapper->mem_param(), world_.bitcast(world_.ptr_type(env_type), env_ptr));
-                auto env = world_.extract(loaded_env, 1_u32);
-                new_mem = world_.extract(loaded_env, 0_u32);
-                for (size_t i = 0, e = free_vars.size(); i != e; ++i)
-                    wrapper_args[env_param_index + i] = world_.extract(env, i);
-            }
-            for (size_t i = 0, e = continuation->num_params(); i != e; ++i) {
-                auto param = wrapper->param(i);
-                if (param->type()->isa<MemType>()) {
-                    // use the mem obtained after the load
-                    wrapper_args[i] = new_mem;
-                } else {
-                    wrapper_args[i] = wrapper->param(i);
-                }
-            }
-            wrapper->jump(lifted, wrapper_args);
-
-            auto closure_type = convert(continuation->type());
-            return world_.closure(closure_type->as<ClosureType>(), wrapper, thin_env ? free_vars[0] : world_.tuple(free_vars), continuation->debug());
+            return closure(continuation);
         } else {
             // TODO need to consider Params?
             Array<const Def*> ops(def->ops());
@@ -156,6 +311,91 @@ public:
         THORIN_UNREACHABLE;
     }
 
+    /**
+     * Lifts @p continuation from its scope and packs its free variables into a @p Closure.
+     * If @p mem is given, an environment that does not fit into a pointer is stored in a @p Slot of the current frame and @p mem is advanced past that store.
+     * Otherwise the backend has to put it onto the heap.
+     */
+    const Def* closure(Continuation* continuation, const Def** mem = nullptr) {
+        world_.WLOG("slow: closure generated for '{}'", continuation);
+
+        // lift the continuation from its scope
+        Scope scope(continuation);
+        auto def_set = free_defs(scope, false);
+        Array<const Def*> free_vars(def_set.begin(), def_set.end());
+        auto filtered_out = std::remove_if(free_vars.begin(), free_vars.end(), [] (const Def* def) {
+            assert(!is_mem(def));
+            auto continuation = def->isa_nom<Continuation>();
+            return continuation && (!continuation->has_body() || continuation->is_intrinsic());
+        });
+        free_vars.shrink(filtered_out - free_vars.begin());
+        auto lifted = lift(scope, free_vars);
+
+        // get the environment type
+        const Type* env_type = nullptr;
+        bool thin_env = free_vars.size() == 1 && is_thin(free_vars[0]->type());
+        if (thin_env) {
+            // optimization: if the environment fits within a pointer or
+            // primitive type, pass it by value.
+            env_type = free_vars[0]->type();
+        } else {
+            Array<const Type*> env_ops(free_vars.size());
+            for (size_t i = 0, e = free_vars.size(); i != e; ++i)
+                env_ops[i] = free_vars[i]->type();
+            env_type = world_.tuple_type(env_ops);
+        }
+
+        // create a wrapper that takes a pointer to the environment
+        size_t env_param_index = continuation->num_params();
+        Array<const Type*> wrapper_param_types(env_param_index + 1);
+        for (size_t i = 0, e = continuation->num_params(); i != e; ++i)
+            wrapper_param_types[i] = continuation->param(i)->type();
+        wrapper_param_types.back() = Closure::environment_type(world_);
+        auto wrapper_type = world_.fn_type(wrapper_param_types);
+        auto wrapper = world_.continuation(wrapper_type, continuation->debug());
+
+        Array<const Def*> wrapper_args(lifted->num_params());
+        const Def* new_mem = wrapper->mem_param();
+        if (thin_env) {
+            wrapper_args[env_param_index] = world_.cast(free_vars[0]->type(), wrapper->param(env_param_index));
+        } else {
+            // make the wrapper load the pointer and pass each
+            // variable of the environment to the lifted continuation
+            auto env_ptr = world_.cast(Closure::environment_ptr_type(world_), wrapper->param(env_param_index));
+            auto loaded_env = world_.load(wrapper->mem_param(), world_.bitcast(world_.ptr_type(env_type), env_ptr));
+            auto env = world_.extract(loaded_env, 1_u32);
+            new_mem = world_.extract(loaded_env, 0_u32);
+            for (size_t i = 0, e = free_vars.size(); i != e; ++i)
+                wrapper_args[env_param_index + i] = world_.extract(env, i);
+        }
+        for (size_t i = 0, e = continuation->num_params(); i != e; ++i) {
+            auto param = wrapper->param(i);
+            if (param->type()->isa<MemType>()) {
+                // use the mem obtained after the load
+                wrapper_args[i] = new_mem;
+            } else {
+                wrapper_args[i] = wrapper->param(i);
+            }
+        }
+        wrapper->jump(lifted, wrapper_args);
+
+        auto closure_type = convert(continuation->type());
+        const Def* env = nullptr;
+        if (thin_env) {
+            env = free_vars[0];
+        } else if (mem != nullptr && !is_thin(env_type)) {
+            // the environment outlives neither the caller's frame nor the call
+            auto enter = world_.enter(*mem)->as<Enter>();
+            auto slot = world_.slot(env_type, enter->out_frame(), continuation->debug());
+            *mem = world_.store(enter->out_mem(), slot, world_.tuple(free_vars));
+            env = slot;
+            world_.VLOG("environment of '{}' allocated on the stack", continuation);
+        } else {
+            env = world_.tuple(free_vars);
+        }
+        return world_.closure(closure_type->as<ClosureType>(), wrapper, env, continuation->debug());
+    }
+
     // convert functions to function pointers
     // - fn (A, B, fn(C), fn(D)) => closure(fn (A, B, fn(convert(C)), closure(fn(convert(D)))))
     // - struct S { fn (X, fn(Y)) } => struct T { closure(fn (X, fn(Y))) }
@@ -198,9 +438,29 @@ public:
     }
 
 private:
+    struct Specialization {
+        Continuation* continuation;
+        size_t index;
+        Continuation* callee;
+
+        bool operator==(const Specialization& other) const {
+            return continuation == other.continuation && index == other.index && callee == other.callee;
+        }
+    };
+
+    struct SpecializationHash {
+        static hash_t hash(const Specialization& s) { return hash_combine(hash_begin(s.continuation->gid()), u64(s.index), s.callee->gid()); }
+        static bool eq(const Specialization& s1, const Specialization& s2) { return s1 == s2; }
+        static Specialization sentinel() { return { nullptr, size_t(-1), nullptr }; }
+    };
+
     World& world_;
     Def2Def new_defs_;
     Type2Type new_types_;
+    Continuation2Continuation originals_;
+    ContinuationMap<bool> closed_;
+    ParamSet non_escaping_;
+    HashMap<Specialization, Continuation*, SpecializationHash> specialized_;
 };
 
 
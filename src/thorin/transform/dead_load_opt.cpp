@@ -1,11 +1,12 @@
 #include "thorin/primop.h"
 #include "thorin/world.h"
+#include "thorin/analyses/alias.h"
 #include "thorin/analyses/cfg.h"
 #include "thorin/analyses/scope.h"
 
 namespace thorin {
 
-static void dead_load_opt(const Scope& scope) {
+static void dead_load_opt(const Scope& scope, AliasAnalysis& alias) {
     auto& world = scope.world();
     for (auto n : scope.f_cfg().post_order()) {
         auto continuation = n->continuation();
@@ -26,6 +27,13 @@ static void dead_load_opt(const Scope& scope) {
                         if (memop->out(1)->num_uses() == 0)
                             memop->replace_uses(world.tuple({ memop->mem(), world.bottom(memop->out(1)->type()) }));
                     }
+                    if (auto load = memop->isa<Load>()) {
+                        // forward the value of a store to exactly this location if nothing in between may overwrite it
+                        if (auto store = alias.clobber(load)->isa<Store>()) {
+                            if (store->val()->type() == load->out_val_type() && alias.alias(store->ptr(), load->ptr()) == AliasResult::Must)
+                                load->replace_uses(world.tuple({ load->mem(), store->val() }));
+                        }
+                    }
                     mem = memop->mem();
                 } else if (auto extract = mem->isa<Extract>()) {
                     mem = extract->agg();
@@ -37,7 +45,8 @@ static void dead_load_opt(const Scope& scope) {
 }
 
 void dead_load_opt(World& world) {
-    Scope::for_each(world, [&] (const Scope& scope) { dead_load_opt(scope); });
+    AliasAnalysis alias;
+    Scope::for_each(world, [&] (const Scope& scope) { dead_load_opt(scope, alias); });
 }
 
 }
@@ -0,0 +1,32 @@
+#ifndef THORIN_TRANSFORM_FLATTEN_OPTIONS_H
+#define THORIN_TRANSFORM_FLATTEN_OPTIONS_H
+
+#include <cstddef>
+
+namespace thorin {
+
+/// How far @p flatten_tuples unpacks the tuple params of the functions of one kind of target.
+struct FlattenLimits {
+    /// Larger tuples are always passed as a whole - even to basic blocks.
+    size_t max_tuple_size;
+    /// Params a continuation that is not a basic block may have after flattening - roughly the argument registers of its calling convention.
+    /// Tuples that would exceed this are passed as a whole, i.e. as a struct.
+    size_t max_params;
+};
+
+/**
+ * @p FlattenLimits of each kind of target.
+ * A continuation belongs to a device if it is reachable from a continuation passed to that device's intrinsic; all others belong to the CPU.
+ */
+struct FlattenOptions {
+    /// x86-64 passes up to 6 integer and 8 floating-point arguments in registers, AArch64 8 of each.
+    FlattenLimits cpu = { 16, 8 };
+    /// CUDA, NVVM, OpenCL and AMDGPU - device functions have many registers at their disposal and are mostly inlined anyway.
+    FlattenLimits gpu = { 16, 32 };
+    /// Each scalar param becomes a port of its own, which HLS tools handle better than aggregates.
+    FlattenLimits hls = { 64, 128 };
+};
+
+}
+
+#endif
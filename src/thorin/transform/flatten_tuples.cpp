@@ -1,229 +1,282 @@
+#include "thorin/transform/flatten_tuples.h"
+
+#include <algorithm>
+#include <array>
+#include <vector>
+
 #include "thorin/continuation.h"
 #include "thorin/world.h"
-#include "thorin/transform/mangle.h"
 #include "thorin/analyses/verify.h"
 
-#include <limits>
-
 namespace thorin {
 
-static Continuation*   wrap_def(Def2Def&, Def2Def&, const Def*, const FnType*, size_t);
-static Continuation* unwrap_def(Def2Def&, Def2Def&, const Def*, const FnType*, size_t);
-
-// Computes the type of the wrapped function
-static const Type* wrapped_type(const FnType* fn_type, size_t max_tuple_size) {
-    std::vector<const Type*> nops;
-    for (auto op : fn_type->ops()) {
-        if (auto tuple_type = op->isa<TupleType>()) {
-            if (tuple_type->num_ops() <= max_tuple_size) {
-                for (auto arg : tuple_type->ops())
-                    nops.push_back(arg);
-            } else
-                nops.push_back(op);
-        } else if (auto op_fn_type = op->isa<FnType>()) {
-            nops.push_back(wrapped_type(op_fn_type, max_tuple_size));
-        } else {
-            nops.push_back(op);
-        }
-    }
-    return fn_type->table().fn_type(nops);
+static bool is_flattenable(const Type* type, size_t max_tuple_size) {
+    auto tuple_type = type->isa<TupleType>();
+    return tuple_type && tuple_type->num_ops() <= max_tuple_size;
 }
 
-static Continuation* jump(Continuation* cont, Array<const Def*>& args) {
-    cont->jump(args[0], args.skip_front(), args[0]->debug());
-    return cont;
+/// Registers a param of type @p type occupies in a call - neither the mem nor the return continuation are passed in one.
+static size_t num_registers(const Type* type) {
+    return type->isa<MemType>() || type->isa<FrameType>() || type->order() == 1 ? 0 : 1;
 }
 
-static Continuation* try_inline(Continuation* cont, Array<const Def*>& args) {
-    if (args[0]->isa_nom<Continuation>()) {
-        auto dropped = drop(args.front(), args.skip_front());
-        assert(dropped->has_body());
-        auto dapp = dropped->body();
-        cont->jump(dapp->callee(), dapp->args(), args[0]->debug());
+// Appends the types a value of @p type is passed as, unpacking nested tuples as well
+static void flatten_type(const Type* type, size_t max_tuple_size, std::vector<const Type*>& types) {
+    if (is_flattenable(type, max_tuple_size)) {
+        for (auto op : type->ops())
+            flatten_type(op, max_tuple_size, types);
     } else {
-        jump(cont, args);
+        types.push_back(type);
     }
-    return cont;
 }
 
-static void inline_calls(Continuation* cont) {
-    for (auto use : cont->copy_uses()) {
-        auto app = use->isa<App>();
-        if (!app || use.index() != 0) continue;
+// Appends the args @p def is passed as (dual of unflatten_param)
+static void flatten_arg(const Def* def, size_t max_tuple_size, std::vector<const Def*>& args) {
+    if (is_flattenable(def->type(), max_tuple_size)) {
+        for (size_t i = 0, e = def->type()->num_ops(); i != e; ++i)
+            flatten_arg(def->world().extract(def, i), max_tuple_size, args);
+    } else {
+        args.push_back(def);
+    }
+}
 
-        for (auto ucont : app->using_continuations()) {
-            assert(ucont->has_body());
+// Rebuilds a value of @p type from the params of @p cont, starting at param @p j (dual of flatten_arg)
+static const Def* unflatten_param(Continuation* cont, const Type* type, size_t max_tuple_size, size_t& j) {
+    if (is_flattenable(type, max_tuple_size)) {
+        Array<const Def*> ops(type->num_ops());
+        for (size_t i = 0, e = ops.size(); i != e; ++i)
+            ops[i] = unflatten_param(cont, type->op(i), max_tuple_size, j);
+        return cont->world().tuple(ops);
+    }
+    return cont->param(j++);
+}
 
-            Array<const Def*> args(app->num_args() + 1);
-            for (size_t i = 0, e = app->num_args(); i != e; ++i) args[i + 1] = app->arg(i);
-            args[0] = app->callee();
-            try_inline(ucont, args);
+// Collects all calls of @p cont; returns false if it is also used in any other way
+static bool find_calls(Continuation* cont, std::vector<const App*>& calls) {
+    for (auto use : cont->uses()) {
+        if (use->isa<Param>()) continue;
+        auto app = use->isa<App>();
+        if (!app || use.index() != 0)
+            return false;
+        calls.push_back(app);
+    }
+    return true;
+}
+
+/// Decides for each param of @p fn_type whether it is passed element-wise; tuples are flattened left to right as long as the params fit into @p max_params.
+static std::vector<bool> plan(const FnType* fn_type, size_t max_tuple_size, size_t max_params) {
+    // a tuple passed as a whole counts as a single param
+    size_t num_params = 0;
+    for (auto op : fn_type->ops())
+        num_params += is_flattenable(op, max_tuple_size) ? 1 : num_registers(op);
+
+    std::vector<bool> flatten(fn_type->num_ops(), false);
+    for (size_t i = 0, e = fn_type->num_ops(); i != e; ++i) {
+        auto type = fn_type->op(i);
+        if (!is_flattenable(type, max_tuple_size)) continue;
+
+        std::vector<const Type*> types;
+        flatten_type(type, max_tuple_size, types);
+        size_t num = 0;
+        for (auto t : types)
+            num += num_registers(t);
+        if (num_params - 1 + num <= max_params) {
+            num_params = num_params - 1 + num;
+            flatten[i] = true;
         }
     }
+    return flatten;
 }
 
-// Wraps around a def, flattening tuples passed as parameters (dual of unwrap)
-static Continuation* wrap_def(Def2Def& wrapped, Def2Def& unwrapped, const Def* old_def, const FnType* new_type, size_t max_tuple_size) {
-    // Transform:
-    //
-    // old_def(a: T, b: (U, V), c: fn (W, (X, Y))):
-    //     ...
-    //
-    // into:
-    //
-    // new_cont(a: T, b: U, c: V, d: fn (W, X, Y)):
-    //     old_def(a, (b, c), unwrap_d)
-    //
-    //     unwrap_d(a: W, b: (X, Y)):
-    //         e = extract(b, 0)
-    //         f = extract(b, 1)
-    //         d(a, (e, f))
-
-    if (wrapped.contains(old_def)) return (*wrapped[old_def]).as_nom<Continuation>();
-
-    auto& world = old_def->world();
-    auto old_type = old_def->type()->as<FnType>();
-    auto new_cont = world.continuation(new_type, old_def->debug());
-    Array<const Def*> call_args(old_type->num_ops() + 1);
-
-    wrapped.emplace(old_def, new_cont);
-
-    for (size_t i = 0, j = 0, e = old_type->num_ops(); i != e; ++i) {
-        auto op = old_type->op(i);
-        if (auto tuple_type = op->isa<TupleType>()) {
-            if (tuple_type->num_ops() <= max_tuple_size) {
-                Array<const Def*> tuple_args(tuple_type->num_ops());
-                for (size_t k = 0, e = tuple_type->num_ops(); k != e; ++k)
-                    tuple_args[k] = new_cont->param(j++);
-                call_args[i + 1] = world.tuple(tuple_args);
-            } else
-                call_args[i + 1] = new_cont->param(j++);
-        } else if (auto fn_type = op->isa<FnType>()) {
-            auto fn_param = new_cont->param(j++);
-            // no need to unwrap if the types are identical
-            if (fn_param->type() != op)
-                call_args[i + 1] = unwrap_def(wrapped, unwrapped, fn_param, fn_type, max_tuple_size);
-            else
-                call_args[i + 1] = fn_param;
-        } else {
-            call_args[i + 1] = new_cont->param(j++);
+static bool any(const std::vector<bool>& flags) { return std::find(flags.begin(), flags.end(), true) != flags.end(); }
+
+/// Which params of a continuation are passed element-wise.
+struct Flattening {
+    /// Its tuple params.
+    std::vector<bool> flat;
+    /// The params of its order-1 continuation params, i.e. what the return continuations it takes are passed; empty for all other params.
+    std::vector<std::vector<bool>> flat_ret;
+};
+
+static Flattening plan(Continuation* cont, const FlattenLimits& limits) {
+    // basic blocks become phis - there is no calling convention to respect
+    auto max_params = cont->is_basicblock() ? size_t(-1) : limits.max_params;
+
+    Flattening flattening { plan(cont->type(), limits.max_tuple_size, max_params), std::vector<std::vector<bool>>(cont->num_params()) };
+    for (size_t i = 0, e = cont->num_params(); i != e; ++i) {
+        auto fn_type = cont->param(i)->type()->isa<FnType>();
+        if (fn_type && fn_type->order() == 1) {
+            auto flat_ret = plan(fn_type, limits.max_tuple_size, limits.max_params);
+            if (any(flat_ret))
+                flattening.flat_ret[i] = std::move(flat_ret);
         }
     }
+    return flattening;
+}
+
+static const FnType* flatten_fn_type(World& world, const FnType* fn_type, const std::vector<bool>& flat, size_t max_tuple_size) {
+    std::vector<const Type*> types;
+    for (size_t i = 0, e = fn_type->num_ops(); i != e; ++i) {
+        if (flat[i])
+            flatten_type(fn_type->op(i), max_tuple_size, types);
+        else
+            types.push_back(fn_type->op(i));
+    }
+    return world.fn_type(types);
+}
+
+static std::vector<const Def*> flatten_args(Defs defs, const std::vector<bool>& flat, size_t max_tuple_size) {
+    std::vector<const Def*> args;
+    for (size_t i = 0, e = defs.size(); i != e; ++i) {
+        if (flat[i])
+            flatten_arg(defs[i], max_tuple_size, args);
+        else
+            args.push_back(defs[i]);
+    }
+    return args;
+}
+
+// Continuation of type @p new_type that passes its params on to @p def packed into tuples again (dual of unflatten_cont)
+static Continuation* flatten_cont(const Def* def, const FnType* new_type, const std::vector<bool>& flat, size_t max_tuple_size) {
+    auto cont = def->world().continuation(new_type, def->debug());
+    std::vector<const Def*> args;
+    for (size_t i = 0, j = 0, e = flat.size(); i != e; ++i)
+        args.push_back(flat[i] ? unflatten_param(cont, def->type()->op(i), max_tuple_size, j) : cont->param(j++));
+    cont->jump(def, args, def->debug());
+    return cont;
+}
 
-    call_args[0] = old_def;
-    // inline the call, so that the old continuation is eliminated
-    return try_inline(new_cont, call_args);
+// Continuation of type @p old_type that passes its tuple params on to @p def element-wise (dual of flatten_cont)
+static Continuation* unflatten_cont(const Def* def, const FnType* old_type, const std::vector<bool>& flat, size_t max_tuple_size) {
+    auto cont = def->world().continuation(old_type, def->debug());
+    cont->jump(def, flatten_args(cont->params_as_defs(), flat, max_tuple_size), def->debug());
+    return cont;
 }
 
-// Unwrap a def, flattening tuples passed as arguments (dual of wrap)
-static Continuation* unwrap_def(Def2Def& wrapped, Def2Def& unwrapped, const Def* new_def, const FnType* old_type, size_t max_tuple_size) {
+static void flatten(World& world, Continuation* cont, const Flattening& flattening, size_t max_tuple_size) {
     // Transform:
     //
-    // new_def(a: T, b: U, c: V, d: fn (W, X, Y)):
-    //     ...
+    // cont(a: T, b: (U, V), ret: fn(W, (X, Y))):
+    //     ... ret(w, x) ...
     //
     // into:
     //
-    // old_cont(a: T, b: (U, V), d: fn (W, (X, Y))):
-    //     e = extract(b, 0)
-    //     f = extract(b, 1)
-    //     new_def(a, e, f, wrap_d)
+    // new_cont(a: T, b: U, c: V, ret: fn(W, X, Y)):
+    //     ... with b replaced by (b, c) and ret(w, extract(x, 0), extract(x, 1))
     //
-    //     wrap_d(a: W, b: X, c: Y):
-    //         d(a, (b, c))
-
-    if (unwrapped.contains(new_def)) return (*unwrapped[new_def]).as_nom<Continuation>();
-
-    auto& world = new_def->world();
-    auto new_type = new_def->type()->as<FnType>();
-    auto old_cont = world.continuation(old_type, new_def->debug());
-    Array<const Def*> call_args(new_type->num_ops() + 1);
-
-    unwrapped.emplace(new_def, old_cont);
-
-    for (size_t i = 0, j = 1, e = old_cont->num_params(); i != e; ++i) {
-        auto param = old_cont->param(i);
-        if (auto tuple_type = param->type()->isa<TupleType>()) {
-            if (tuple_type->num_ops() <= max_tuple_size) {
-                for (size_t k = 0, e = tuple_type->num_ops(); k != e; ++k)
-                    call_args[j++] = world.extract(param, k);
-            } else
-                call_args[j++] = param;
-        } else if (auto fn_type = param->type()->isa<FnType>()) {
-            auto new_fn_type = new_type->op(j - 1)->as<FnType>();
-            // no need to wrap if the types are identical
-            if (fn_type != new_fn_type)
-                call_args[j++] = wrap_def(wrapped, unwrapped, param, new_fn_type, max_tuple_size);
-            else
-                call_args[j++] = param;
-        } else {
-            call_args[j++] = param;
-        }
+    // and rewrite each call cont(x, y, k) into new_cont(x, extract(y, 0), extract(y, 1), k') with k'(w, x, y) = k(w, (x, y))
+    const auto& [flat, flat_ret] = flattening;
+
+    std::vector<const Type*> types;
+    for (size_t i = 0, e = cont->num_params(); i != e; ++i) {
+        auto type = cont->param(i)->type();
+        if (flat[i])
+            flatten_type(type, max_tuple_size, types);
+        else if (!flat_ret[i].empty())
+            types.push_back(flatten_fn_type(world, type->as<FnType>(), flat_ret[i], max_tuple_size));
+        else
+            types.push_back(type);
     }
+    auto new_cont = world.continuation(world.fn_type(types), cont->attributes(), cont->debug());
 
-    call_args[0] = new_def;
-    // we do not inline the call, so that we keep the flattened version around
-    return jump(old_cont, call_args);
-}
-
-static void flatten_tuples(World& world, size_t max_tuple_size) {
-    // flatten tuples passed as arguments to functions
-    bool todo = true;
-    Def2Def wrapped, unwrapped;
-    DefSet unwrapped_codom;
-
-    while (todo) {
-        todo = false;
-
-        for (auto pair : unwrapped) unwrapped_codom.emplace(pair.second);
-
-        for (auto cont : world.copy_continuations()) {
-            // do not change the signature of intrinsic/external functions
-            if (!cont->has_body() ||
-                cont->is_intrinsic() ||
-                world.is_external(cont) ||
-                is_passed_to_accelerator(cont))
-                continue;
-
-            auto new_type = wrapped_type(cont->type(), max_tuple_size)->as<FnType>();
-            if (new_type == cont->type()) continue;
-
-            // do not transform continuations multiple times
-            if (wrapped.contains(cont) || unwrapped_codom.contains(cont)) continue;
-
-            // generate a version of that continuation that operates without tuples
-            wrap_def(wrapped, unwrapped, cont, new_type, max_tuple_size);
-
-            todo = true;
+    for (size_t i = 0, j = 0, e = cont->num_params(); i != e; ++i) {
+        auto param = cont->param(i);
+        if (flat[i]) {
+            param->replace_uses(unflatten_param(new_cont, param->type(), max_tuple_size, j));
+            continue;
+        }
 
-            world.DLOG("flattened {}", cont);
+        auto new_param = new_cont->param(j++);
+        new_param->set_name(param->name());
+        if (!flat_ret[i].empty()) {
+            for (auto use : param->copy_uses()) {
+                auto app = use->isa<App>();
+                if (!app || use.index() != 0) continue;
+                auto args = flatten_args(app->args(), flat_ret[i], max_tuple_size);
+                for (auto ucont : app->using_continuations())
+                    ucont->jump(new_param, args, app->debug());
+            }
+            // what remains passes the return continuation on as a whole
+            if (!param->uses().empty())
+                param->replace_uses(unflatten_cont(new_param, param->type()->as<FnType>(), flat_ret[i], max_tuple_size));
+        } else {
+            param->replace_uses(new_param);
         }
+    }
 
-        // remove original versions of wrapped functions
-        auto wrapped_copy = wrapped;
-        for (auto wrap_pair : wrapped_copy) {
-            auto def = wrap_pair.first;
-            auto old_cont = def->isa_nom<Continuation>();
-            if (old_cont && !old_cont->has_body()) continue;
+    auto body = cont->body();
+    new_cont->jump(body->callee(), body->args(), body->debug());
+    cont->destroy("flatten_tuples");
+
+    // calls in the moved body itself - recursive ones - are among these
+    std::vector<const App*> calls;
+    find_calls(cont, calls);
+    for (auto app : calls) {
+        std::vector<const Def*> args;
+        for (size_t i = 0, e = app->num_args(); i != e; ++i) {
+            if (flat[i])
+                flatten_arg(app->arg(i), max_tuple_size, args);
+            else if (!flat_ret[i].empty())
+                args.push_back(flatten_cont(app->arg(i), new_cont->param(args.size())->type()->as<FnType>(), flat_ret[i], max_tuple_size));
+            else
+                args.push_back(app->arg(i));
+        }
+        for (auto ucont : app->using_continuations())
+            ucont->jump(new_cont, args, app->debug());
+    }
 
-            auto new_cont = wrap_pair.second->as_nom<Continuation>();
-            auto wrapped_cont = unwrap_def(wrapped, unwrapped, new_cont, def->type()->as<FnType>(), max_tuple_size);
+    world.DLOG("flattened {} into {}", cont, new_cont);
+}
 
-            def->replace_uses(wrapped_cont);
-            if (old_cont)
-                old_cont->destroy("flatten_tuples");
+// Continuations reachable from a kernel are compiled for that kernel's device
+static ContinuationMap<const FlattenLimits*> find_devices(World& world) {
+    const auto& options = world.flatten_options();
+    static const auto device_intrinsics = std::array {
+        std::pair { Intrinsic::CUDA,   &FlattenOptions::gpu },
+        std::pair { Intrinsic::NVVM,   &FlattenOptions::gpu },
+        std::pair { Intrinsic::OpenCL, &FlattenOptions::gpu },
+        std::pair { Intrinsic::AMDGPU, &FlattenOptions::gpu },
+        std::pair { Intrinsic::HLS,    &FlattenOptions::hls }
+    };
+
+    ContinuationMap<const FlattenLimits*> devices;
+    for (auto cont : world.copy_continuations()) {
+        if (!cont->has_body() || !is_passed_to_accelerator(cont)) continue;
+        for (auto [intrinsic, limits] : device_intrinsics) {
+            if (is_passed_to_intrinsic(cont, intrinsic)) {
+                for (auto reached : world.call_graph().reachable(cont))
+                    devices.emplace(reached, &(options.*limits));
+                break;
+            }
         }
     }
+    return devices;
+}
 
-    for (auto unwrap_pair : unwrapped)
-        inline_calls(unwrap_pair.second->as_nom<Continuation>());
+void flatten_tuples(World& world) {
+    auto devices = find_devices(world);
+
+    // new continuations never need flattening again, so a single pass over the old ones suffices
+    for (auto cont : world.copy_continuations()) {
+        // do not change the signature of intrinsic/external functions or of continuations whose calls are not all known
+        std::vector<const App*> calls;
+        if (!cont->has_body() ||
+            cont->is_intrinsic() ||
+            world.is_external(cont) ||
+            !find_calls(cont, calls))
+            continue;
+
+        auto i = devices.find(cont);
+        const auto& limits = i != devices.end() ? *i->second : world.flatten_options().cpu;
+        auto flattening = plan(cont, limits);
+        if (!any(flattening.flat) && std::all_of(flattening.flat_ret.begin(), flattening.flat_ret.end(), [] (const auto& flat) { return flat.empty(); }))
+            continue;
+
+        flatten(world, cont, flattening, limits.max_tuple_size);
+    }
 
     world.cleanup();
     debug_verify(world);
 }
 
-void flatten_tuples(World& world) {
-    flatten_tuples(world, std::numeric_limits<size_t>::max());
-}
-
 }
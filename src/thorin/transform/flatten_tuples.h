@@ -1,7 +1,18 @@
-#include "thorin/world.h"
+#ifndef THORIN_TRANSFORM_FLATTEN_TUPLES_H
+#define THORIN_TRANSFORM_FLATTEN_TUPLES_H
+
+#include "thorin/transform/flatten_options.h"
 
 namespace thorin {
 
-void flatten_tuples(World& world);
+class World;
+
+/**
+ * Passes tuple params of continuations that are only ever called directly element-wise, as far as the @p World::flatten_options of their target allow.
+ * The same goes for the tuples such a continuation passes to its return continuations, i.e. to its order-1 continuation params.
+ */
+void flatten_tuples(World&);
 
 }
+
+#endif
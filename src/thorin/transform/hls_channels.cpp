@@ -43,10 +43,8 @@ static void extract_kernel_channels(const Schedule& schedule, Def2Mode& def2mode
 
 bool is_channel_type(const Type* type) {
     if (auto ptr_type = type->isa<PtrType>()) {
-        if (auto struct_type = ptr_type->pointee()->isa<StructType>()) {
-            if (struct_type->name().str().find("channel") != std::string::npos)
-                return true;
-        }
+        if (auto struct_type = ptr_type->pointee()->isa<StructType>())
+            return struct_type->is_channel();
     }
     return false;
 }
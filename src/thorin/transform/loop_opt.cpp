@@ -0,0 +1,385 @@
+#include "thorin/transform/loop_opt.h"
+
+#include <optional>
+
+#include "thorin/primop.h"
+#include "thorin/world.h"
+#include "thorin/analyses/alias.h"
+#include "thorin/analyses/cfg.h"
+#include "thorin/analyses/looptree.h"
+#include "thorin/analyses/scope.h"
+#include "thorin/transform/mangle.h"
+
+namespace thorin {
+
+/// Unrolling copies the whole @p Scope of the loop header; give up if the copies would exceed this many @p Def%s.
+static const size_t max_unrolled_size = 4096;
+
+struct Loop {
+    Continuation* header;
+    ContinuationSet continuations; ///< all @p Continuation%s of the loop including the @p header
+};
+
+struct CountedLoop {
+    Continuation* header;
+    Continuation* preheader;
+    std::vector<Continuation*> latches;
+    size_t index;           ///< of the induction variable in @p header's @p Param%s
+    const Def* init;
+    const Def* step;
+    const Def* bound;
+    CmpTag cmp;             ///< the loop runs as long as @c induction_variable @p cmp @p bound holds
+    bool body_on_true;      ///< does the loop continue on the true branch?
+};
+
+/// Collects all innermost loops with a single header.
+static void collect_loops(const LoopTree<true>::Base* node, std::vector<Loop>& loops) {
+    auto head = node->template isa<LoopTree<true>::Head>();
+    if (head == nullptr)
+        return;
+
+    bool innermost = true;
+    for (const auto& child : head->children()) {
+        if (child->template isa<LoopTree<true>::Head>()) {
+            innermost = false;
+            collect_loops(child.get(), loops);
+        }
+    }
+
+    if (!head->is_root() && innermost && head->num_cf_nodes() == 1) {
+        Loop loop { head->cf_nodes().front()->continuation(), {} };
+        loop.continuations.emplace(loop.header);
+        for (const auto& child : head->children())
+            loop.continuations.emplace(child->cf_nodes().front()->continuation());
+        loops.emplace_back(std::move(loop));
+    }
+}
+
+/// @c a tag b is equivalent to @c b swap(tag) a
+static CmpTag swap(CmpTag tag) {
+    switch (tag) {
+        case Cmp_gt: return Cmp_lt;
+        case Cmp_ge: return Cmp_le;
+        case Cmp_lt: return Cmp_gt;
+        case Cmp_le: return Cmp_ge;
+        default:     return tag;
+    }
+}
+
+static std::optional<CountedLoop> analyze(const Scope& scope, const Loop& loop) {
+    auto header = loop.header;
+    auto& world = header->world();
+    if (!header->has_body() || header->is_external() || header->body()->callee() != world.branch())
+        return std::nullopt;
+
+    auto body = header->body();
+    auto cond = body->arg(0)->isa<Cmp>();
+    auto t = body->arg(1)->isa_nom<Continuation>();
+    auto f = body->arg(2)->isa_nom<Continuation>();
+    if (!cond || !t || !f || loop.continuations.contains(t) == loop.continuations.contains(f))
+        return std::nullopt;
+
+    for (auto continuation : loop.continuations) {
+        if (!scope.contains(continuation))
+            return std::nullopt;
+    }
+
+    CountedLoop result;
+    result.header = header;
+    result.preheader = nullptr;
+    result.body_on_true = loop.continuations.contains(t);
+
+    for (auto use : header->uses()) {
+        if (use->isa<Param>())
+            continue;
+        auto app = use->isa<App>();
+        if (!app || use.index() != 0)
+            return std::nullopt; // header escapes
+        for (auto caller : app->using_continuations()) {
+            if (loop.continuations.contains(caller))
+                result.latches.push_back(caller);
+            else if (result.preheader != nullptr)
+                return std::nullopt;
+            else
+                result.preheader = caller;
+        }
+    }
+    if (result.preheader == nullptr || result.latches.empty())
+        return std::nullopt;
+
+    const Param* induction = nullptr;
+    for (size_t side = 0; side != 2; ++side) {
+        auto param = cond->op(side)->isa<Param>();
+        if (param && param->continuation() == header && !scope.contains(cond->op(1 - side))) {
+            induction = param;
+            result.bound = cond->op(1 - side);
+            result.cmp = side == 0 ? cond->cmp_tag() : swap(cond->cmp_tag());
+            break;
+        }
+    }
+    if (induction == nullptr)
+        return std::nullopt;
+    if (!result.body_on_true)
+        result.cmp = negate(result.cmp);
+    result.index = induction->index();
+
+    result.step = nullptr;
+    for (auto latch : result.latches) {
+        auto add = latch->body()->arg(result.index)->isa<ArithOp>();
+        if (!add || add->arithop_tag() != ArithOp_add)
+            return std::nullopt;
+        auto step = add->lhs() == induction ? add->rhs() : add->rhs() == induction ? add->lhs() : nullptr;
+        if (!step || !step->isa<PrimLit>() || (result.step && result.step != step))
+            return std::nullopt;
+        result.step = step;
+    }
+
+    result.init = result.preheader->body()->arg(result.index);
+    return result;
+}
+
+/// The range of values of the integer type @p tag in which @p trip_count computes without overflow.
+static std::pair<s64, s64> safe_range(PrimTypeTag tag) {
+    auto bits = std::min(num_bits(tag), 62);
+    if (is_type_s(tag))
+        return { -(s64(1) << (bits - 1)), (s64(1) << (bits - 1)) - 1 };
+    return { 0, (s64(1) << bits) - 1 };
+}
+
+/// Number of times the body of @p loop runs if it is a compile-time constant.
+static std::optional<u64> trip_count(const CountedLoop& loop) {
+    if (!loop.init->isa<PrimLit>() || !loop.bound->isa<PrimLit>())
+        return std::nullopt;
+
+    auto tag = loop.init->type()->as<PrimType>()->primtype_tag();
+    if (!is_type_i(tag))
+        return std::nullopt;
+
+    auto [lo, hi] = safe_range(tag);
+    auto value = [&] (const Def* def) -> std::optional<s64> {
+        if (is_type_u(tag)) {
+            auto u = primlit_value<u64>(def);
+            if (u > u64(hi)) return std::nullopt;
+            return s64(u);
+        }
+        auto s = primlit_value<s64>(def);
+        if (s < lo || s > hi) return std::nullopt;
+        return s;
+    };
+
+    auto init = value(loop.init), bound = value(loop.bound), step = value(loop.step);
+    if (!init || !bound || !step || *step == 0)
+        return std::nullopt;
+
+    s64 n;
+    switch (loop.cmp) {
+        case Cmp_lt: if (*step < 0) return std::nullopt; n = *init < *bound ? (*bound - *init + *step - 1) / *step : 0; break;
+        case Cmp_le: if (*step < 0) return std::nullopt; n = *init <= *bound ? (*bound - *init) / *step + 1 : 0; break;
+        case Cmp_gt: if (*step > 0) return std::nullopt; n = *init > *bound ? (*init - *bound - *step - 1) / -*step : 0; break;
+        case Cmp_ge: if (*step > 0) return std::nullopt; n = *init >= *bound ? (*init - *bound) / -*step + 1 : 0; break;
+        case Cmp_ne:
+            if ((*bound - *init) % *step != 0 || (*bound - *init) / *step < 0) return std::nullopt;
+            n = (*bound - *init) / *step;
+            break;
+        default: return std::nullopt;
+    }
+
+    // the induction variable must not wrap around before the loop exits
+    auto last = *init + n * *step;
+    if (last < lo || last > hi)
+        return std::nullopt;
+    return u64(n);
+}
+
+/// Does a memory operation of the loop in @p scope possibly write to the memory @p ptr points to?
+static bool may_write(AliasAnalysis& alias, const Scope& scope, const Loop& loop, const Def* ptr) {
+    for (auto def : scope.defs()) {
+        if (auto store = def->isa<Store>()) {
+            if (!alias.no_alias(store->ptr(), ptr))
+                return true;
+        } else if (def->isa<Assembly>()) {
+            return true;
+        } else if (auto app = def->isa<App>()) {
+            if (auto callee = app->callee()->isa_nom<Continuation>()) {
+                if (callee == loop.header || scope.contains(callee)
+                        || callee->intrinsic() == Intrinsic::Branch || callee->intrinsic() == Intrinsic::Match)
+                    continue;
+            }
+            // an unknown call can only write to objects whose address it does not know
+            auto base = alias.location(ptr).base;
+            for (auto arg : app->args()) {
+                if (arg->type()->isa<MemType>() && (!AliasAnalysis::is_identified_object(base) || alias.escapes(base)))
+                    return true;
+            }
+        }
+    }
+    return false;
+}
+
+/// Hoists loop-invariant @p Load%s at the start of the header into the preheader.
+static bool hoist_loads(AliasAnalysis& alias, const Scope& scope, const Loop& loop, const CountedLoop& counted) {
+    auto& world = scope.world();
+    auto header = counted.header;
+    auto mem_param = header->mem_param();
+    if (mem_param == nullptr)
+        return false;
+
+    // the loop may not run at all: only hoist loads that cannot trap
+    auto trips = trip_count(counted);
+    bool runs = trips && *trips != 0;
+
+    std::vector<const Load*> loads;
+    for (const Def* mem = mem_param; mem != nullptr;) {
+        const Load* next = nullptr;
+        for (auto use : mem->uses()) {
+            if (auto load = use->isa<Load>())
+                loads.push_back(next = load);
+        }
+        mem = next ? next->out_mem() : nullptr;
+    }
+
+    bool todo = false;
+    for (auto load : loads) {
+        auto ptr = load->ptr();
+        if (scope.contains(ptr))
+            continue;
+
+        auto loc = alias.location(ptr);
+        bool safe = runs || (AliasAnalysis::is_identified_object(loc.base)
+            && std::all_of(loc.path.begin(), loc.path.end(), [] (const Def* index) { return index->isa<PrimLit>(); }));
+        if (!safe || may_write(alias, scope, loop, ptr))
+            continue;
+
+        auto preheader = counted.preheader;
+        auto pre_body = preheader->body();
+        auto hoisted = world.load(pre_body->arg(mem_param->index()), ptr, load->debug());
+        Array<const Def*> args(pre_body->args());
+        args[mem_param->index()] = world.extract(hoisted, 0_u32);
+        preheader->jump(header, args, pre_body->debug());
+        load->replace_uses(world.tuple({ load->mem(), world.extract(hoisted, 1_u32) }, load->debug()));
+        world.DLOG("hoisted {} out of loop {}", load, header);
+        todo = true;
+    }
+
+    return todo;
+}
+
+/// Replaces the loop by @p trips copies of its body with the induction variable replaced by a constant.
+static void full_unroll(const Scope& scope, const CountedLoop& loop, u64 trips) {
+    auto& world = scope.world();
+    auto header = loop.header;
+    std::vector<Continuation*> sites = { loop.preheader };
+    auto i = loop.init;
+
+    // the last copy only evaluates the exit test which folds to the exit
+    for (u64 n = 0; n <= trips; ++n) {
+        Array<const Def*> args(header->num_params());
+        args[loop.index] = i;
+        auto dropped = drop(scope, args);
+
+        for (auto site : sites)
+            site->jump(dropped, site->body()->args().cut({loop.index}), site->body()->debug());
+
+        sites.clear();
+        Scope dropped_scope(dropped);
+        for (auto def : dropped_scope.defs()) {
+            if (auto continuation = def->isa_nom<Continuation>(); continuation && continuation->has_body() && continuation->body()->callee() == header)
+                sites.push_back(continuation);
+        }
+
+        i = world.arithop_add(loop.step, i);
+    }
+
+    world.DLOG("fully unrolled loop {} with {} iterations", header, trips);
+}
+
+/// Chains @p factor copies of the loop body; the copies only test for the exit if @p trips is unknown or not divisible by @p factor.
+static void partial_unroll(const Scope& scope, const CountedLoop& loop, size_t factor, std::optional<u64> trips) {
+    auto header = loop.header;
+    bool keep_exits = !trips || *trips % factor != 0;
+
+    std::vector<Continuation*> copies;
+    for (size_t j = 1; j != factor; ++j)
+        copies.push_back(clone(scope));
+
+    auto redirect = [&] (Continuation* site, Continuation* to) {
+        site->jump(to, site->body()->args(), site->body()->debug());
+    };
+
+    for (auto latch : loop.latches)
+        redirect(latch, copies.front());
+
+    for (size_t j = 0, e = copies.size(); j != e; ++j) {
+        auto copy = copies[j];
+        Scope copy_scope(copy);
+        for (auto def : copy_scope.defs()) {
+            // clone turns the back edges into calls of the copy itself
+            if (auto continuation = def->isa_nom<Continuation>(); continuation && continuation->has_body() && continuation->body()->callee() == copy)
+                redirect(continuation, j + 1 != e ? copies[j + 1] : header);
+        }
+
+        if (!keep_exits) {
+            auto body = copy->body();
+            copy->jump(body->arg(loop.body_on_true ? 1 : 2), {}, body->debug());
+        }
+    }
+
+    header->world().DLOG("unrolled loop {} {} times", header, factor);
+}
+
+/// Appends the innermost loops of @p scope - later loops first: unrolling copies them along with the loop they follow which is already done then.
+static void collect_loops(Scope& scope, std::vector<Loop>& loops) {
+    std::vector<Loop> scope_loops;
+    collect_loops(scope.f_cfg().looptree().root(), scope_loops);
+
+    ContinuationMap<size_t> header2loop;
+    for (size_t i = 0, e = scope_loops.size(); i != e; ++i)
+        header2loop[scope_loops[i].header] = i;
+    for (auto n : scope.f_cfg().post_order()) {
+        if (auto i = header2loop.find(n->continuation()); i != header2loop.end())
+            loops.emplace_back(std::move(scope_loops[i->second]));
+    }
+}
+
+static void optimize_loops(const std::vector<Loop>& loops, size_t unroll_factor, size_t max_full_unroll) {
+    AliasAnalysis alias;
+    for (const auto& loop : loops) {
+        Scope scope(loop.header);
+        auto counted = analyze(scope, loop);
+        if (!counted)
+            continue;
+
+        if (hoist_loads(alias, scope, loop, *counted))
+            scope.update();
+
+        auto trips = trip_count(*counted);
+        auto size = scope.defs().size();
+        if (trips && *trips <= max_full_unroll && size * (*trips + 1) <= max_unrolled_size)
+            full_unroll(scope, *counted, *trips);
+        else if (unroll_factor > 1 && size * unroll_factor <= max_unrolled_size)
+            partial_unroll(scope, *counted, unroll_factor, trips);
+    }
+}
+
+void loop_opt(World& world, size_t unroll_factor, size_t max_full_unroll) {
+    world.VLOG("start loop_opt");
+
+    // collect the loops of all scopes first as transforming one loop invalidates the looptree of its scope
+    std::vector<Loop> loops;
+    Scope::for_each(world, [&] (Scope& scope) { collect_loops(scope, loops); });
+    optimize_loops(loops, unroll_factor, max_full_unroll);
+
+    world.cleanup();
+    world.VLOG("end loop_opt");
+}
+
+void loop_opt(Continuation* entry, size_t unroll_factor, size_t max_full_unroll) {
+    std::vector<Loop> loops;
+    {
+        Scope scope(entry);
+        collect_loops(scope, loops);
+    }
+    optimize_loops(loops, unroll_factor, max_full_unroll);
+}
+
+}
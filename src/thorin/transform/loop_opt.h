@@ -0,0 +1,27 @@
+#ifndef THORIN_TRANSFORM_LOOP_OPT_H
+#define THORIN_TRANSFORM_LOOP_OPT_H
+
+#include <cstddef>
+
+namespace thorin {
+
+class Continuation;
+class World;
+
+/**
+ * Optimizes innermost counted loops.
+ * A counted loop is a header @p Continuation that branches on a comparison of one of its @p Param%s (the induction variable) against a loop-invariant bound.
+ * It is entered from exactly one continuation outside of the loop (the preheader) and each back edge increments the induction variable by the same constant.
+ *  - Loads in the header from loop-invariant addresses that no memory operation in the loop may write to are hoisted into the preheader.
+ *  - Loops with a constant trip count of at most @p max_full_unroll iterations are unrolled completely.
+ *  - Other loops are unrolled by @p unroll_factor; the exit tests of the copies are removed if the trip count is a known multiple of @p unroll_factor.
+ *
+ * An @p unroll_factor of 1 and a @p max_full_unroll of 0 only hoist loads.
+ */
+void loop_opt(World&, size_t unroll_factor = 1, size_t max_full_unroll = 0);
+/// As above but only for the loops in the @p Scope of @p entry - e.g. to unroll a single kernel; leaves the @p World to clean up to the caller.
+void loop_opt(Continuation* entry, size_t unroll_factor, size_t max_full_unroll = 0);
+
+}
+
+#endif
@@ -4,6 +4,45 @@
 
 namespace thorin {
 
+/**
+ * Contents of the slots/immutable globals known along the current memory chain.
+ * Instead of copying the whole map at every split of a memory chain, every modification is recorded in an undo log.
+ * A branch of the memory tree is entered with @p checkpoint and left again with @p rollback.
+ */
+class SlotContents {
+public:
+    size_t checkpoint() const { return log_.size(); }
+
+    void rollback(size_t checkpoint) {
+        assert(checkpoint <= log_.size());
+        while (log_.size() != checkpoint) {
+            auto [alloc, old] = log_.back();
+            log_.pop_back();
+            if (old)
+                map_[alloc] = old;
+            else
+                map_.erase(alloc);
+        }
+    }
+
+    const Def* lookup(const Def* alloc) const { return map_.lookup(alloc).value_or(nullptr); }
+
+    const Def* set(const Def* alloc, const Def* value) {
+        auto& entry = map_[alloc];
+        log_.emplace_back(alloc, entry);
+        return entry = value;
+    }
+
+    void clear() {
+        map_.clear();
+        log_.clear();
+    }
+
+private:
+    Def2Def map_;
+    std::vector<std::pair<const Def*, const Def*>> log_; ///< (alloc, previous value or @c nullptr if there was none)
+};
+
 class ResolveLoads {
 public:
     ResolveLoads(World& world)
@@ -12,47 +51,59 @@ public:
 
     bool resolve_loads() {
         todo_ = false;
-        for (auto continuation : world_.copy_continuations()) {
-            for (auto param : continuation->params()) {
-                if (param->type()->isa<MemType>()) {
-                    Def2Def mapping;
-                    resolve_loads(param, mapping);
+
+        // collect the roots first: process_use creates new nodes and would invalidate the iterator of World::defs()
+        std::vector<const Param*> mem_params;
+        for (auto def : world_.defs()) {
+            if (auto continuation = def->isa_nom<Continuation>()) {
+                for (auto param : continuation->params()) {
+                    if (is_mem(param))
+                        mem_params.push_back(param);
                 }
             }
         }
+
+        for (auto param : mem_params) {
+            contents_.clear();
+            resolve_loads(param);
+        }
         return todo_;
     }
 
-    void resolve_loads(const Def* mem, Def2Def& mapping) {
-        // Traverse the tree of memory objects and
-        // incrementally build the contents of each
-        // safe slot/immutable global
-        while (mem) {
-            // This loop iterates through all uses, and processes them recursively.
-            // The last use is treated separately to be able to re-use the mapping.
-            auto uses = mem->copy_uses();
-            size_t i = 0, n = uses.size();
-            for (auto it = uses.begin(); i < n; ++i, ++it) {
-                if (i == n - 1) {
-                    mem = process_use(*it, mapping);
-                } else {
-                    Def2Def split_mapping = mapping;
-                    auto next_mem = process_use(*it, split_mapping);
-                    resolve_loads(next_mem, split_mapping);
-                }
-            }
-            if (n == 0)
-                break;
+    void resolve_loads(const Def* mem) {
+        // Traverse the tree of memory objects depth-first and
+        // incrementally build the contents of each safe slot/immutable global.
+        // Each use of a memory object starts with the contents known at that memory object,
+        // which is restored by rolling back to the checkpoint taken when the use was pushed.
+        struct Item {
+            const Def* use;
+            size_t checkpoint;
+        };
+        std::vector<Item> stack;
+
+        auto push_uses = [&] (const Def* mem) {
+            auto checkpoint = contents_.checkpoint();
+            for (auto use : mem->copy_uses())
+                stack.push_back({ use.def(), checkpoint });
+        };
+
+        push_uses(mem);
+        while (!stack.empty()) {
+            auto [use, checkpoint] = stack.back();
+            stack.pop_back();
+            contents_.rollback(checkpoint);
+            if (auto next_mem = process_use(use))
+                push_uses(next_mem);
         }
     }
 
-    const Def* process_use(const Def* mem_use, Def2Def& mapping) {
+    const Def* process_use(const Def* mem_use) {
         if (auto load = mem_use->isa<Load>()) {
             // Try to find the slot corresponding to this load
             auto slot = find_slot(load->ptr());
             if (slot) {
                 // If the slot has been found and is safe, try to find a value for it
-                auto slot_value = get_value(slot, mapping);
+                auto slot_value = get_value(slot);
                 auto load_value = extract_from_slot(load->ptr(), slot_value, load->debug());
                 // If the loaded value is completely specified, replace the load
                 if (!contains_top(load_value)) {
@@ -69,9 +120,9 @@ public:
                     store->replace_uses(store->mem());
                 } else {
                     // If the slot has been found and is safe, try to find a value for it
-                    auto slot_value = get_value(slot, mapping);
+                    auto slot_value = get_value(slot);
                     auto stored_value = insert_to_slot(store->ptr(), slot_value, store->val(), store->debug());
-                    mapping[slot] = stored_value;
+                    contents_.set(slot, stored_value);
                 }
             }
             return store->out_mem();
@@ -81,7 +132,7 @@ public:
             for (auto use : frame->uses()) {
                 // All the slots allocated at that point contain bottom
                 assert(use->isa<Slot>());
-                mapping[use.def()] = world_.bottom(use->type()->as<PtrType>()->pointee());
+                contents_.set(use.def(), world_.bottom(use->type()->as<PtrType>()->pointee()));
             }
             return enter->out_mem();
         } else {
@@ -89,17 +140,16 @@ public:
         }
     }
 
-    const Def* get_value(const Def* alloc, Def2Def& mapping) {
-        auto it = mapping.find(alloc);
-        if (it != mapping.end())
-            return it->second;
+    const Def* get_value(const Def* alloc) {
+        if (auto value = contents_.lookup(alloc))
+            return value;
         if (auto global = alloc->isa<Global>()) {
             // Immutable globals will remain set to their initial value
             if (!global->is_mutable())
-                return mapping[alloc] = global->init();
+                return contents_.set(alloc, global->init());
         }
         // Nothing is known about this allocation yet
-        return mapping[alloc] = world_.top(alloc->type()->as<PtrType>()->pointee(), alloc->debug());
+        return contents_.set(alloc, world_.top(alloc->type()->as<PtrType>()->pointee(), alloc->debug()));
     }
 
     const Def* extract_from_slot(const Def* ptr, const Def* slot_value, Debug dbg) {
@@ -256,6 +306,7 @@ public: \
 private:
     bool todo_;
     World& world_;
+    SlotContents contents_;
 };
 
 bool resolve_loads(World& world) {
@@ -1,66 +1,100 @@
 #include "thorin/primop.h"
 #include "thorin/world.h"
 #include "thorin/analyses/scope.h"
-#include "thorin/analyses/schedule.h"
 #include "thorin/analyses/verify.h"
 #include "thorin/transform/split_slots.h"
 
 namespace thorin {
 
 struct IndexHash {
-    static hash_t hash(u32 u) { return u; } // TODO bad hash function
+    static hash_t hash(u32 u) { return murmur3(u); }
     static bool eq(u32 a, u32 b) { return a == b; }
     static u32 sentinel() { return 0xFFFFFFFF; }
 };
 
+/// Number of elements of an aggregate type that can be split into separate @p Slot%s, or @c 0 if it cannot be split.
+static size_t num_elems(const Type* type) {
+    if (auto array_type = type->isa<DefiniteArrayType>())
+        return array_type->dim();
+    if (type->isa<StructType>() || type->isa<TupleType>())
+        return type->num_ops();
+    return 0;
+}
+
+static const Type* elem_type(const Type* type, size_t i) {
+    if (auto array_type = type->isa<DefiniteArrayType>())
+        return array_type->elem_type();
+    return type->op(i);
+}
+
+/// Whole-aggregate @p Load%s and @p Store%s of larger aggregates are not scalarized to keep code size in check.
+static const size_t max_scalarized_size = 64;
+
+static const Def* aggregate(World& world, const Type* type, Defs elems, Debug dbg) {
+    if (auto array_type = type->isa<DefiniteArrayType>())
+        return world.definite_array(array_type->elem_type(), elems, dbg);
+    if (auto struct_type = type->isa<StructType>())
+        return world.struct_agg(struct_type, elems, dbg);
+    return world.tuple(elems, dbg);
+}
+
+/**
+ * Replaces @p slot by one @p Slot per element.
+ * @p LEA%s are redirected to the corresponding element @p Slot while whole-aggregate @p Load%s and @p Store%s are scalarized.
+ * The element @p Slot%s are again candidates for splitting, so nested aggregates are split level by level.
+ */
 static void split(const Slot* slot) {
-    auto array_type = slot->alloced_type()->as<DefiniteArrayType>();
-    auto dim = array_type->dim();
-    auto elem_type = array_type->elem_type();
+    auto type = slot->alloced_type();
+    auto dim = num_elems(type);
 
     HashMap<u32, const Def*, IndexHash> new_slots;
     auto& world = slot->world();
 
     auto elem_slot = [&] (u32 index) {
         if (!new_slots.contains(index))
-            new_slots[index] = world.slot(elem_type, slot->frame(), slot->debug());
+            new_slots[index] = world.slot(elem_type(type, index), slot->frame(), slot->debug());
         return new_slots[index];
     };
 
     for (auto use : slot->copy_uses()) {
         if (auto lea = use->isa<LEA>()) {
-            lea->replace_uses(elem_slot(lea->index()->as<PrimLit>()->value().get_u32()));
+            lea->replace_uses(elem_slot(primlit_value<u32>(lea->index())));
         } else if (auto store = use->isa<Store>()) {
-            auto in_mem = store->op(0);
+            auto in_mem = store->mem();
             for (size_t i = 0, e = dim; i != e; ++i) {
-                auto elem = world.extract(store->op(2), i, store->debug());
+                auto elem = world.extract(store->val(), i, store->debug());
                 in_mem = world.store(in_mem, elem_slot(i), elem, store->debug());
             }
             store->replace_uses(in_mem);
         } else if (auto load = use->isa<Load>()) {
-            auto in_mem = load->op(0);
-            auto array = world.bottom(array_type, load->debug());
+            auto in_mem = load->mem();
+            Array<const Def*> elems(dim);
             for (size_t i = 0, e = dim; i != e; ++i) {
                 auto tuple = world.load(in_mem, elem_slot(i), load->debug());
-                auto elem = world.extract(tuple, 1_u32, load->debug());
+                elems[i] = world.extract(tuple, 1_u32, load->debug());
                 in_mem = world.extract(tuple, 0_u32, load->debug());
-                array = world.insert(array, i, elem, load->debug());
             }
-            load->replace_uses(world.tuple({ in_mem, array }, load->debug()));
+            load->replace_uses(world.tuple({ in_mem, aggregate(world, type, elems, load->debug()) }, load->debug()));
         }
     }
 }
 
 static bool can_split(const Slot* slot) {
-    if (!slot->alloced_type()->isa<DefiniteArrayType>())
+    auto dim = num_elems(slot->alloced_type());
+    if (dim == 0 || slot->num_uses() == 0)
         return false;
 
-    // only accept LEAs with constant indices and loads and stores
+    // only accept LEAs with in-bounds constant indices and loads and stores through the slot
+    // a single dynamic index may address any element, so such a slot stays in one piece;
+    // its statically indexed sub-aggregates are still split once they have been split off the enclosing slot
     for (auto use : slot->uses()) {
         if (auto lea = use->isa<LEA>()) {
-            if (!lea->index()->no_dep())
+            if (!lea->index()->isa<PrimLit>() || primlit_value<u64>(lea->index()) >= dim)
                 return false;
-        } else if (!use->isa<Store>() && !use->isa<Load>()) {
+        } else if (use->isa<Store>()) {
+            if (use.index() != 1 || dim > max_scalarized_size)
+                return false; // the slot escapes or the store would explode
+        } else if (!use->isa<Load>() || dim > max_scalarized_size) {
             return false;
         }
     }
@@ -70,19 +104,20 @@ static bool can_split(const Slot* slot) {
 
 static bool split_slots(const Scope& scope) {
     bool todo = false;
-    // TODO
-#if 0
-    for (const auto& block : schedule(scope, Schedule::Late)) {
-        for (auto primop : block) {
-            if (auto slot = primop->isa<Slot>()) {
-                if (can_split(slot)) {
-                    split(slot);
-                    todo = true;
-                }
-            }
+
+    std::vector<const Slot*> slots;
+    for (auto def : scope.defs()) {
+        if (auto slot = def->isa<Slot>())
+            slots.push_back(slot);
+    }
+
+    for (auto slot : slots) {
+        if (can_split(slot)) {
+            split(slot);
+            todo = true;
         }
     }
-#endif
+
     return todo;
 }
 
@@ -91,6 +126,7 @@ void split_slots(World& world) {
     while (todo) {
         todo = false;
         Scope::for_each(world, [&] (const Scope& scope) { todo |= split_slots(scope); });
+        // cleanup removes the dead slots and runs resolve_loads which promotes the scalar element slots
         world.cleanup();
     }
 }
@@ -6,7 +6,10 @@ namespace thorin {
 class World;
 
 /**
- * Tries to split @p Slot%s that are accessed through constant @p LEA%s.
+ * Scalar replacement of aggregates:
+ * Tries to split @p Slot%s of definite array, struct and tuple type that are accessed through constant @p LEA%s.
+ * Nested aggregates are split level by level; sub-aggregates only indexed dynamically keep their @p Slot.
+ * The resulting scalar @p Slot%s are promoted by @p resolve_loads during the subsequent cleanup.
  */
 void split_slots(World&);
 
@@ -0,0 +1,509 @@
+#include "thorin/transform/vectorize.h"
+
+#include <functional>
+
+#include "thorin/primop.h"
+#include "thorin/world.h"
+#include "thorin/analyses/domtree.h"
+#include "thorin/analyses/looptree.h"
+#include "thorin/analyses/schedule.h"
+#include "thorin/analyses/scope.h"
+
+namespace thorin {
+
+struct VectorizeArgs {
+    enum {
+        Mem = 0,
+        Length,
+        Body,
+        Return,
+        Num
+    };
+};
+
+/// Parameters of the body: <tt>body(mem, index, return, args...)</tt>.
+struct BodyParams {
+    enum {
+        Mem = 0,
+        Index,
+        Return,
+        Num
+    };
+};
+
+class Vectorizer {
+public:
+    Vectorizer(const Scope& scope, size_t length)
+        : world_(scope.world())
+        , scope_(scope)
+        , length_(length)
+    {}
+
+    /// Builds the vectorized body <tt>fn(mem, args..., return)</tt> or returns @c nullptr if the body cannot be vectorized.
+    Continuation* run();
+
+private:
+    Continuation* body() const { return scope_.entry(); }
+    bool is_vectorizable() const;
+    std::vector<const Def*> schedule(Continuation* block, const std::vector<const Def*>& defs, const DefMap<Continuation*>& def2block) const;
+
+    /// @name values
+    //@{
+    bool is_varying(const Def* def) const { return vectors_.contains(def) || lanes_.contains(def); }
+    const Def* scalar(const Def* def) const;
+    const Def* vector(const Def* def);
+    const Def* lane(const Def* def, size_t l);
+    void set_lanes(const Def* def, const Type* type, Array<const Def*>&& lanes);
+    const Def* index_vector(const PrimType* type);
+    //@}
+
+    /// @name control flow
+    //@{
+    const Def* mask_and(const Def* mask, const Def* cond) { return mask ? world_.arithop_and(mask, cond) : cond; }
+    const Def* mask_or (const Def* mask, const Def* cond) { return mask && cond ? world_.arithop_or(mask, cond) : nullptr; }
+    const Def* edge_mask(Continuation* pred, Continuation* block);
+    const Def* any(const Def* mask);
+    void enter(Continuation* block);
+    const Def* guard(const Def* cond, const Type* type, std::function<const Def*()> emit);
+    //@}
+
+    /// @name emit
+    //@{
+    void emit(const Def* def);
+    void emit_load(const Load* load);
+    void emit_store(const Store* store);
+    //@}
+
+    World& world_;
+    const Scope& scope_;
+    size_t length_;
+    Def2Def scalars_;                    ///< values that are the same in all lanes
+    Def2Def vectors_;                    ///< @p PrimType values that differ between lanes
+    DefMap<Array<const Def*>> lanes_;    ///< other values that differ between lanes - one scalar per lane
+    ContinuationMap<const Def*> masks_;  ///< active lanes of each block; @c nullptr if all lanes are active
+    Continuation* cur_ = nullptr;        ///< the continuation of the vectorized body that is currently built
+    const Def* mem_ = nullptr;           ///< memory operations of all blocks are linearized into this single @c mem chain
+    const Def* mask_ = nullptr;          ///< mask of the block that is currently vectorized
+};
+
+//------------------------------------------------------------------------------
+
+bool Vectorizer::is_vectorizable() const {
+    if (body()->num_params() < BodyParams::Num || !body()->param(BodyParams::Mem)->type()->isa<MemType>())
+        return false;
+
+    auto index_type = body()->param(BodyParams::Index)->type()->isa<PrimType>();
+    if (!index_type || index_type->is_vector() || !is_type_i(index_type))
+        return false;
+
+    auto ret = body()->param(BodyParams::Return);
+    auto ret_type = ret->type()->isa<FnType>();
+    if (!ret_type || ret_type->num_ops() != 1 || !ret_type->op(0)->isa<MemType>())
+        return false;
+
+    // if-conversion needs an acyclic CFG
+    for (const auto& child : scope_.f_cfg().looptree().root()->children()) {
+        if (child->isa<LoopTree<true>::Head>())
+            return false;
+    }
+
+    for (auto def : scope_.defs()) {
+        if (auto continuation = def->isa_nom<Continuation>()) {
+            if (continuation == scope_.exit())
+                continue;
+            if (!continuation->has_body() || (continuation != body() && !continuation->is_basicblock()))
+                return false;
+
+            auto app = continuation->body();
+            auto callee = app->callee();
+            if (callee == world_.branch()) {
+                for (size_t i = 1; i != 3; ++i) {
+                    if (!scope_.contains(app->arg(i)) || !app->arg(i)->isa_nom<Continuation>())
+                        return false;
+                }
+            } else if (callee != ret && (!scope_.contains(callee) || !callee->isa_nom<Continuation>() || callee == body())) {
+                return false; // calls cannot be vectorized
+            }
+            continue;
+        }
+
+        if (def->isa<Param>() || def->isa<App>() || def->isa<Filter>())
+            continue;
+        if (auto vector_type = def->type()->isa<VectorType>(); vector_type && vector_type->is_vector())
+            return false;
+        if (!def->isa<ArithOp>() && !def->isa<Cmp>() && !def->isa<Select>() && !def->isa<Cast>() && !def->isa<Bitcast>()
+                && !def->isa<LEA>() && !def->isa<Load>() && !def->isa<Store>() && !def->isa<Extract>() && !def->isa<Insert>()
+                && !def->isa<Tuple>() && !def->isa<StructAgg>() && !def->isa<DefiniteArray>())
+            return false;
+    }
+
+    return true;
+}
+
+/// Orders the @p defs scheduled into @p block such that operands come first.
+std::vector<const Def*> Vectorizer::schedule(Continuation* block, const std::vector<const Def*>& defs, const DefMap<Continuation*>& def2block) const {
+    std::vector<const Def*> result;
+    DefSet done;
+
+    auto in_block = [&] (const Def* def) {
+        auto i = def2block.find(def);
+        return i != def2block.end() && i->second == block;
+    };
+
+    std::function<void(const Def*)> visit = [&] (const Def* def) {
+        if (!done.emplace(def).second)
+            return;
+        // a store must not overwrite memory before all loads that observe the memory in front of it
+        if (auto store = def->isa<Store>()) {
+            for (auto use : store->mem()->uses()) {
+                if (use->isa<Load>() && in_block(use))
+                    visit(use);
+            }
+        }
+        for (auto op : def->ops()) {
+            if (in_block(op))
+                visit(op);
+        }
+        result.push_back(def);
+    };
+
+    for (auto def : defs)
+        visit(def);
+    return result;
+}
+
+//------------------------------------------------------------------------------
+
+const Def* Vectorizer::scalar(const Def* def) const {
+    assert(!is_varying(def));
+    if (auto res = scalars_.lookup(def))
+        return *res;
+    assert(!scope_.contains(def) || def->isa_nom<Continuation>());
+    return def;
+}
+
+const Def* Vectorizer::vector(const Def* def) {
+    if (auto res = vectors_.lookup(def))
+        return *res;
+    if (auto i = lanes_.find(def); i != lanes_.end())
+        return world_.vector(i->second);
+    return world_.splat(scalar(def), length_);
+}
+
+const Def* Vectorizer::lane(const Def* def, size_t l) {
+    if (auto res = vectors_.lookup(def))
+        return world_.extract(*res, u32(l));
+    if (auto i = lanes_.find(def); i != lanes_.end())
+        return i->second[l];
+    return scalar(def);
+}
+
+void Vectorizer::set_lanes(const Def* def, const Type* type, Array<const Def*>&& lanes) {
+    if (type->isa<PrimType>())
+        vectors_[def] = world_.vector(lanes);
+    else
+        lanes_[def] = std::move(lanes);
+}
+
+const Def* Vectorizer::index_vector(const PrimType* type) {
+    Array<const Def*> indices(length_, [&] (size_t l) { return world_.cast(type, world_.literal_pu64(l, {})); });
+    return world_.vector(indices);
+}
+
+//------------------------------------------------------------------------------
+
+const Def* Vectorizer::edge_mask(Continuation* pred, Continuation* block) {
+    auto mask = masks_[pred];
+    auto app = pred->body();
+    if (app->callee() != world_.branch() || app->arg(1) == app->arg(2))
+        return mask;
+
+    auto cond = vector(app->arg(0));
+    return mask_and(mask, app->arg(1) == block ? cond : world_.arithop_not(cond));
+}
+
+const Def* Vectorizer::any(const Def* mask) {
+    auto result = world_.extract(mask, 0_u32);
+    for (size_t l = 1; l != length_; ++l)
+        result = world_.arithop_or(result, world_.extract(mask, u32(l)));
+    return result;
+}
+
+void Vectorizer::enter(Continuation* block) {
+    auto& cfg = scope_.f_cfg();
+    auto n = cfg[block];
+
+    if (block == body()) {
+        mask_ = masks_[block] = nullptr;
+        return;
+    }
+
+    // all lanes that reach the immediate dominator also reach this block if it post-dominates the immediate dominator
+    auto idom = cfg.domtree().idom(n);
+    if (scope_.b_cfg().domtree().least_common_ancestor(n, idom) == n) {
+        mask_ = masks_[block] = masks_[idom->continuation()];
+    } else {
+        const Def* mask = world_.literal_bool(false, {}, length_);
+        for (auto pred : cfg.preds(n))
+            mask = mask_or(mask, edge_mask(pred->continuation(), block));
+        mask_ = masks_[block] = mask;
+    }
+
+    // block parameters become selects of the incoming values
+    for (size_t i = 0, e = block->num_params(); i != e; ++i) {
+        auto param = block->param(i);
+        if (param->type()->isa<MemType>())
+            continue; // memory is linearized
+
+        std::vector<std::pair<const Def*, const Def*>> incoming; // (edge mask, value)
+        for (auto pred : cfg.preds(n))
+            incoming.emplace_back(edge_mask(pred->continuation(), block), pred->continuation()->body()->arg(i));
+
+        if (std::all_of(incoming.begin(), incoming.end(), [&] (const auto& p) { return p.second == incoming.front().second; })) {
+            auto value = incoming.front().second;
+            if (auto res = vectors_.lookup(value))
+                vectors_[param] = *res;
+            else if (auto j = lanes_.find(value); j != lanes_.end())
+                lanes_[param] = j->second;
+            else
+                scalars_[param] = scalar(value);
+            continue;
+        }
+
+        if (param->type()->isa<PrimType>()) {
+            auto result = vector(incoming.front().second);
+            for (auto [mask, value] : ArrayRef<std::pair<const Def*, const Def*>>(incoming).skip_front())
+                result = mask ? world_.select(mask, vector(value), result) : vector(value);
+            vectors_[param] = result;
+        } else {
+            Array<const Def*> lanes(length_, [&] (size_t l) {
+                auto result = lane(incoming.front().second, l);
+                for (auto [mask, value] : ArrayRef<std::pair<const Def*, const Def*>>(incoming).skip_front())
+                    result = mask ? world_.select(world_.extract(mask, u32(l)), lane(value, l), result) : lane(value, l);
+                return result;
+            });
+            lanes_[param] = std::move(lanes);
+        }
+    }
+}
+
+/// Emits @p emit into a new block that only runs if @p cond holds and returns the value of type @p type it produced.
+const Def* Vectorizer::guard(const Def* cond, const Type* type, std::function<const Def*()> emit) {
+    auto then_block = world_.continuation(world_.fn_type(), {"vectorize_then"});
+    auto else_block = world_.continuation(world_.fn_type(), {"vectorize_else"});
+    auto next = world_.continuation(type ? world_.fn_type({ world_.mem_type(), type }) : world_.fn_type({ world_.mem_type() }), {"vectorize_next"});
+    cur_->branch(cond, then_block, else_block);
+
+    auto mem = mem_;
+    cur_ = then_block;
+    auto value = emit();
+    if (type) {
+        then_block->jump(next, { mem_, value });
+        else_block->jump(next, { mem, world_.bottom(type) });
+    } else {
+        then_block->jump(next, { mem_ });
+        else_block->jump(next, { mem });
+    }
+
+    cur_ = next;
+    mem_ = next->param(0);
+    return type ? next->param(1) : nullptr;
+}
+
+//------------------------------------------------------------------------------
+
+void Vectorizer::emit(const Def* def) {
+    if (auto load = def->isa<Load>())
+        return emit_load(load);
+    if (auto store = def->isa<Store>())
+        return emit_store(store);
+    if (def->type()->isa<MemType>())
+        return; // memory is linearized
+
+    if (auto extract = def->isa<Extract>(); extract && extract->agg()->isa<Load>()) {
+        auto load = extract->agg();
+        if (auto res = vectors_.lookup(load))
+            vectors_[def] = *res;
+        else if (auto i = lanes_.find(load); i != lanes_.end())
+            lanes_[def] = i->second;
+        else
+            scalars_[def] = scalars_[load];
+        return;
+    }
+
+    auto ops = def->ops();
+    if (std::none_of(ops.begin(), ops.end(), [&] (const Def* op) { return is_varying(op); })) {
+        Array<const Def*> nops(ops.size(), [&] (size_t i) { return scalar(ops[i]); });
+        scalars_[def] = def->rebuild(world_, def->type(), nops);
+        return;
+    }
+
+    auto prim_type = def->type()->isa<PrimType>();
+    bool prim_ops = std::all_of(ops.begin(), ops.end(), [&] (const Def* op) { return op->type()->isa<PrimType>(); });
+    if (prim_type && prim_ops && (def->isa<ArithOp>() || def->isa<Cmp>() || def->isa<Select>() || def->isa<Cast>() || def->isa<Bitcast>())) {
+        Array<const Def*> nops(ops.size(), [&] (size_t i) { return vector(ops[i]); });
+        // inactive lanes must not trap
+        if (auto arithop = def->isa<ArithOp>(); arithop && mask_ && is_type_i(prim_type)
+                && (arithop->arithop_tag() == ArithOp_div || arithop->arithop_tag() == ArithOp_rem))
+            nops[1] = world_.select(mask_, nops[1], world_.one(prim_type->primtype_tag(), {}, length_));
+        vectors_[def] = def->rebuild(world_, world_.prim_type(prim_type->primtype_tag(), length_), nops);
+        return;
+    }
+
+    // everything else is done lane by lane
+    Array<const Def*> lanes(length_, [&] (size_t l) {
+        Array<const Def*> nops(ops.size(), [&] (size_t i) { return lane(ops[i], l); });
+        return def->rebuild(world_, def->type(), nops);
+    });
+    set_lanes(def, def->type(), std::move(lanes));
+}
+
+void Vectorizer::emit_load(const Load* load) {
+    auto type = load->out_val_type();
+    auto ptr = load->ptr();
+    auto emit_lane = [&] (const Def* ptr) {
+        auto tuple = world_.load(mem_, ptr, load->debug());
+        mem_ = world_.extract(tuple, 0_u32);
+        return world_.extract(tuple, 1_u32);
+    };
+
+    if (!is_varying(ptr)) {
+        if (mask_)
+            scalars_[load] = guard(any(mask_), type, [&] { return emit_lane(scalar(ptr)); });
+        else
+            scalars_[load] = emit_lane(scalar(ptr));
+        return;
+    }
+
+    // gather
+    Array<const Def*> lanes(length_);
+    for (size_t l = 0; l != length_; ++l) {
+        if (mask_)
+            lanes[l] = guard(world_.extract(mask_, u32(l)), type, [&] { return emit_lane(lane(ptr, l)); });
+        else
+            lanes[l] = emit_lane(lane(ptr, l));
+    }
+    set_lanes(load, type, std::move(lanes));
+}
+
+void Vectorizer::emit_store(const Store* store) {
+    auto emit_lane = [&] (const Def* ptr, const Def* val) {
+        mem_ = world_.store(mem_, ptr, val, store->debug());
+        return nullptr;
+    };
+
+    if (!is_varying(store->ptr()) && !is_varying(store->val())) {
+        auto ptr = scalar(store->ptr()), val = scalar(store->val());
+        if (mask_)
+            guard(any(mask_), nullptr, [&] { return emit_lane(ptr, val); });
+        else
+            emit_lane(ptr, val);
+        return;
+    }
+
+    // scatter - lanes store in order, so the last active lane wins
+    for (size_t l = 0; l != length_; ++l) {
+        auto ptr = lane(store->ptr(), l), val = lane(store->val(), l);
+        if (mask_)
+            guard(world_.extract(mask_, u32(l)), nullptr, [&] { return emit_lane(ptr, val); });
+        else
+            emit_lane(ptr, val);
+    }
+}
+
+//------------------------------------------------------------------------------
+
+Continuation* Vectorizer::run() {
+    if (!is_vectorizable())
+        return nullptr;
+
+    // signature: fn(mem, args..., return)
+    std::vector<const Type*> types = { world_.mem_type() };
+    for (size_t i = BodyParams::Num, e = body()->num_params(); i != e; ++i)
+        types.push_back(body()->param(i)->type());
+    types.push_back(body()->param(BodyParams::Return)->type());
+
+    auto vectorized = world_.continuation(world_.fn_type(types), {body()->name() + "_vectorized"});
+    for (size_t i = BodyParams::Num, e = body()->num_params(); i != e; ++i)
+        scalars_[body()->param(i)] = vectorized->param(i - BodyParams::Num + 1);
+    scalars_[body()->param(BodyParams::Return)] = vectorized->params().back();
+    vectors_[body()->param(BodyParams::Index)] = index_vector(body()->param(BodyParams::Index)->type()->as<PrimType>());
+    cur_ = vectorized;
+    mem_ = vectorized->param(0);
+
+    Scheduler scheduler(scope_);
+    DefMap<Continuation*> def2block;
+    ContinuationMap<std::vector<const Def*>> block2defs;
+    for (auto def : scope_.defs()) {
+        if (def->isa_nom<Continuation>() || def->isa<Param>() || def->isa<App>() || def->isa<Filter>())
+            continue;
+        auto block = scheduler.smart(def);
+        def2block[def] = block;
+        block2defs[block].push_back(def);
+    }
+
+    // blocks in reverse post-order: all dominators and - since there are no loops - all predecessors come first
+    auto& cfg = scope_.f_cfg();
+    Debug ret_dbg;
+    for (auto n : cfg.reverse_post_order()) {
+        auto block = n->continuation();
+        if (n == cfg.exit())
+            continue;
+
+        enter(block);
+        auto& defs = block2defs[block];
+        std::sort(defs.begin(), defs.end(), [] (const Def* a, const Def* b) { return a->gid() < b->gid(); });
+        for (auto def : schedule(block, defs, def2block))
+            emit(def);
+
+        if (block->body()->callee() == body()->param(BodyParams::Return))
+            ret_dbg = block->body()->debug();
+    }
+
+    // all blocks are linearized into one path, so each return block ends up in this single return
+    cur_->jump(vectorized->params().back(), { mem_ }, ret_dbg);
+    return vectorized;
+}
+
+//------------------------------------------------------------------------------
+
+void vectorize(World& world) {
+    world.VLOG("start vectorize");
+
+    for (auto continuation : world.copy_continuations()) {
+        if (!continuation->has_body())
+            continue;
+
+        auto app = continuation->body();
+        auto callee = app->callee()->isa_nom<Continuation>();
+        if (!callee || callee->intrinsic() != Intrinsic::Vectorize || app->num_args() < VectorizeArgs::Num)
+            continue;
+
+        auto length = app->arg(VectorizeArgs::Length)->isa<PrimLit>();
+        auto global = app->arg(VectorizeArgs::Body)->isa<Global>();
+        auto body = global ? global->init()->isa_nom<Continuation>() : nullptr;
+        size_t num_args = app->num_args() - VectorizeArgs::Num;
+        if (!length || primlit_value<u64>(length) == 0 || !body || !body->has_body() || body->num_params() != BodyParams::Num + num_args)
+            continue;
+
+        Scope scope(body);
+        auto vectorized = Vectorizer(scope, primlit_value<u64>(length)).run();
+        if (vectorized == nullptr) {
+            world.WLOG("cannot vectorize {} at {}", body, continuation->loc());
+            continue;
+        }
+
+        Array<const Def*> args(num_args + 2);
+        args.front() = app->arg(VectorizeArgs::Mem);
+        for (size_t i = 0; i != num_args; ++i)
+            args[i + 1] = app->arg(VectorizeArgs::Num + i);
+        args.back() = app->arg(VectorizeArgs::Return);
+        continuation->jump(vectorized, args, app->debug());
+        world.DLOG("vectorized {} with {} lanes", body, primlit_value<u64>(length));
+    }
+
+    world.cleanup();
+    world.VLOG("end vectorize");
+}
+
+}
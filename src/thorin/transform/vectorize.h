@@ -0,0 +1,22 @@
+#ifndef THORIN_TRANSFORM_VECTORIZE_H
+#define THORIN_TRANSFORM_VECTORIZE_H
+
+namespace thorin {
+
+class World;
+
+/**
+ * Vectorizes the bodies passed to @c vectorize on the Thorin level - independent of the backend.
+ * Each call <tt>vectorize(mem, length, body, return, args...)</tt> with a constant @c length is replaced by a call to a new function
+ * that runs all @c length lanes of @c body at once:
+ *  - operations on @p PrimType%s are widened to vectors of @c length elements,
+ *  - branches are if-converted: every block runs under a mask of active lanes and block parameters become @p Select%s,
+ *  - memory accesses are scalarized into one access per lane (gather/scatter); masked accesses are guarded per lane.
+ *
+ * Bodies with loops, calls, or memory operations other than @p Load and @p Store are left alone.
+ */
+void vectorize(World&);
+
+}
+
+#endif
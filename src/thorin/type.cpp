@@ -156,7 +156,7 @@ Stream& Type::stream(Stream& s) const {
     } else if (auto t = isa<TupleType>()) {
         return s.fmt("[{, }]", t->ops());
     } else if (auto t = isa<PtrType>()) {
-        if (t->is_vector()) s.fmt("<{} x", t->length());
+        if (t->is_vector()) s.fmt("<{} x ", t->length());
         s.fmt("{}*", t->pointee());
         if (t->is_vector()) s.fmt(">");
         if (t->device() != -1) s.fmt("[{}]", t->device());
@@ -170,7 +170,7 @@ Stream& Type::stream(Stream& s) const {
         }
         return s;
     } else if (auto t = isa<PrimType>()) {
-        if (t->is_vector()) s.fmt("<{} x", t->length());
+        if (t->is_vector()) s.fmt("<{} x ", t->length());
 
         switch (t->primtype_tag()) {
 #define THORIN_ALL_TYPE(T, M) case Node_PrimType_##T: s.fmt(#T); break;
@@ -114,11 +114,18 @@ class StructType : public NominalType {
 private:
     StructType(TypeTable& table, Symbol name, size_t size, size_t gid)
         : NominalType(table, Node_StructType, name, size, gid)
+        , channel_(name.str().find("channel") != std::string::npos)
     {}
 
 public:
     const NominalType* stub(TypeTable&) const override;
 
+    /// Channels of the HLS/OpenCL backends are structs whose name contains @c channel - decided once, when the type is created.
+    bool is_channel() const { return channel_; }
+
+private:
+    bool channel_;
+
     friend class TypeTable;
 };
 
@@ -359,6 +366,7 @@ bool use_lea(const Type*);
 class TypeTable {
 private:
     struct TypeHash {
+        static constexpr bool cache_hash = true;
         static hash_t hash(const Type* t) { return t->hash(); }
         static bool eq(const Type* t1, const Type* t2) { return t2->equal(t1); }
         static const Type* sentinel() { return (const Type*)(1); }
@@ -2,6 +2,16 @@
 
 #include "thorin/util/stream.h"
 
+#if THORIN_ENABLE_PROFILING
+#include <cstdlib>
+#include <iomanip>
+#include <mutex>
+#include <vector>
+#if defined(__GNUC__) || defined(__clang__)
+#include <cxxabi.h>
+#endif
+#endif
+
 namespace thorin {
 
 hash_t hash(const char* s) {
@@ -15,4 +25,73 @@ void debug_hash() {
     errf("debug with: break {}:{}", __FILE__, __LINE__);
 }
 
+#if THORIN_ENABLE_PROFILING
+
+static std::mutex hash_stats_mutex;
+static std::vector<HashStats*> all_hash_stats;
+
+static std::string type_name(const std::type_info& info) {
+    std::string name = info.name();
+#if defined(__GNUC__) || defined(__clang__)
+    int status;
+    if (auto demangled = abi::__cxa_demangle(name.c_str(), nullptr, nullptr, &status)) {
+        name = demangled;
+        std::free(demangled);
+    }
+#endif
+    auto replace_all = [&] (const std::string& from, const std::string& to) {
+        for (size_t i; (i = name.find(from)) != std::string::npos;)
+            name.replace(i, from.size(), to);
+    };
+    replace_all("std::__cxx11::basic_string<char, std::char_traits<char>, std::allocator<char> >", "std::string");
+    replace_all("thorin::", "");
+    return name;
+}
+
+HashStats::HashStats(const std::type_info& key, const std::type_info& value, const std::type_info& hash) {
+    name = value == typeid(void)
+        ? "HashSet<" + type_name(key) + ", " + type_name(hash) + ">"
+        : "HashMap<" + type_name(key) + ", " + type_name(value) + ", " + type_name(hash) + ">";
+    std::lock_guard<std::mutex> guard(hash_stats_mutex);
+    all_hash_stats.push_back(this);
+}
+
+void hash_stats_report(std::ostream& os) {
+    std::lock_guard<std::mutex> guard(hash_stats_mutex);
+    auto stats = all_hash_stats;
+    auto ops = [] (const HashStats* s) { return s->inserts + s->lookups; };
+    std::stable_sort(stats.begin(), stats.end(), [&] (auto s1, auto s2) { return ops(s1) > ops(s2); });
+
+    os << "hash table statistics" << std::endl;
+    os << std::setw(10) << "tables" << std::setw(8) << "heap %" << std::setw(12) << "inserts" << std::setw(12) << "lookups"
+       << std::setw(8) << "probe" << std::setw(8) << "max" << std::setw(10) << "rehashes" << std::setw(12) << "moved"
+       << std::setw(10) << "max cap" << std::setw(8) << "load %" << "  kind" << std::endl;
+    for (auto s : stats) {
+        if (s->tables == 0) continue;
+        auto avg_probe = s->lookups == 0 ? 0.0 : double(s->probes) / double(s->lookups);
+        os << std::setw(10) << s->tables
+           << std::setw(8) << std::fixed << std::setprecision(1) << 100.0 * double(s->promotions) / double(s->tables)
+           << std::setw(12) << s->inserts
+           << std::setw(12) << s->lookups
+           << std::setw(8) << std::setprecision(2) << avg_probe
+           << std::setw(8) << s->max_probe
+           << std::setw(10) << s->rehashes
+           << std::setw(12) << s->rehashed
+           << std::setw(10) << s->max_capacity
+           << std::setw(8) << std::setprecision(1) << double(s->peak_load) / 10.0
+           << "  " << s->name << std::endl;
+    }
+}
+
+void hash_stats_reset() {
+    std::lock_guard<std::mutex> guard(hash_stats_mutex);
+    for (auto s : all_hash_stats) {
+        for (auto counter : { &s->tables, &s->promotions, &s->inserts, &s->lookups, &s->probes, &s->max_probe,
+                              &s->rehashes, &s->rehashed, &s->max_capacity, &s->peak_load })
+            counter->store(0, std::memory_order_relaxed);
+    }
+}
+
+#endif
+
 }
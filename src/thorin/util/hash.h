@@ -3,6 +3,7 @@
 
 #include <algorithm>
 #include <array>
+#include <atomic>
 #include <cassert>
 #include <cinttypes>
 #include <cstdint>
@@ -10,13 +11,22 @@
 #include <iostream>
 #include <memory>
 #include <optional>
+#include <string>
 #include <type_traits>
+#include <typeinfo>
 #include <utility>
 
 #include "thorin/config.h"
 #include "thorin/util/stream.h"
 #include "thorin/util/utility.h"
 
+#if defined(__SSE2__) || defined(_M_X64)
+#define THORIN_SSE2 1
+#include <emmintrin.h>
+#else
+#define THORIN_SSE2 0
+#endif
+
 namespace thorin {
 
 using hash_t = uint32_t;
@@ -120,6 +130,7 @@ inline hash_t hash_begin() { return FNV1::offset; }
 hash_t hash(const char* s);
 
 struct StrHash {
+    static constexpr bool cache_hash = true;
     static hash_t hash(const char* s) { return thorin::hash(s); }
     static bool eq(const char* s1, const char* s2) { return std::strcmp(s1, s2) == 0; }
     static const char* sentinel() { return (const char*)(1); }
@@ -127,6 +138,51 @@ struct StrHash {
 
 //------------------------------------------------------------------------------
 
+#if THORIN_ENABLE_PROFILING
+/**
+ * Counters shared by all @p HashSet%s or @p HashMap%s with the same key, value, and hash function - e.g. all @p World::Sea%s.
+ * Only available with the CMake option @c THORIN_PROFILE.
+ * @p hash_stats_report prints them when the last @p World is destroyed.
+ */
+struct HashStats {
+    HashStats(const std::type_info& key, const std::type_info& value, const std::type_info& hash);
+
+    void probe(uint64_t length) { probes.fetch_add(length, std::memory_order_relaxed); max(max_probe, length); }
+    static void inc(std::atomic<uint64_t>& counter, uint64_t n = 1) { counter.fetch_add(n, std::memory_order_relaxed); }
+    static void max(std::atomic<uint64_t>& counter, uint64_t val) {
+        for (auto cur = counter.load(std::memory_order_relaxed); cur < val && !counter.compare_exchange_weak(cur, val, std::memory_order_relaxed);) {}
+    }
+
+    std::string name;
+    std::atomic<uint64_t> tables     = 0; ///< Number of tables created.
+    std::atomic<uint64_t> promotions = 0; ///< Number of tables that outgrew their stack array.
+    std::atomic<uint64_t> inserts    = 0; ///< Insertions of new elements.
+    std::atomic<uint64_t> lookups    = 0; ///< Searches for a key - as part of an insertion or not.
+    std::atomic<uint64_t> probes     = 0; ///< Slots compared by all lookups.
+    std::atomic<uint64_t> max_probe  = 0;
+    std::atomic<uint64_t> rehashes   = 0;
+    std::atomic<uint64_t> rehashed   = 0; ///< Elements moved by all rehashes.
+    std::atomic<uint64_t> max_capacity = 0;
+    std::atomic<uint64_t> peak_load  = 0; ///< In per mille of the capacity of a heap table.
+};
+
+/// The @p HashStats of all tables with the given types.
+template<class Key, class T, class H>
+HashStats& hash_stats() {
+    static HashStats stats(typeid(Key), typeid(T), typeid(H));
+    return stats;
+}
+
+/// Prints one line per kind of table used so far - most frequently used first.
+void hash_stats_report(std::ostream&);
+void hash_stats_reset();
+#define THORIN_HASH_STATS(x) x
+#else
+#define THORIN_HASH_STATS(x)
+#endif
+
+//------------------------------------------------------------------------------
+
 namespace detail {
 
 /// Used internally for @p HashSet and @p HashMap.
@@ -224,6 +280,7 @@ public:
 #endif
     {
         fill(nodes_);
+        THORIN_HASH_STATS(HashStats::inc(stats().tables));
     }
     HashTable(size_t capacity)
         : capacity_(capacity < StackCapacity ? StackCapacity : std::max(capacity, size_t(MinHeapCapacity)))
@@ -235,6 +292,8 @@ public:
     {
         assert(is_power_of_2(capacity));
         fill(nodes_);
+        THORIN_HASH_STATS(HashStats::inc(stats().tables));
+        THORIN_HASH_STATS(HashStats::inc(stats().promotions, on_heap()));
     }
     HashTable(HashTable&& other)
         : HashTable()
@@ -255,6 +314,8 @@ public:
             nodes_ = array_.data();
             array_ = other.array_;
         }
+        THORIN_HASH_STATS(HashStats::inc(stats().tables));
+        THORIN_HASH_STATS(HashStats::inc(stats().promotions, on_heap()));
     }
     template<class InputIt>
     HashTable(InputIt first, InputIt last)
@@ -276,6 +337,8 @@ public:
     size_t capacity() const { return capacity_; }
     size_t size() const { return size_; }
     bool empty() const { return size() == 0; }
+    /// Memory allocated outside of this object - @c 0 as long as the elements fit into the inline array.
+    size_t heap_bytes() const { return on_heap() ? capacity_ * sizeof(value_type) : 0; }
 #if THORIN_ENABLE_CHECKS
     int id() const { return id_; }
 #endif
@@ -385,11 +448,12 @@ public:
             if (empty())
                 return end();
 
-            for (size_t i = desired_pos(k); true; i = mod(i+1)) {
-                if (is_invalid(i))
-                    return end();
-                if (H::eq(key(nodes_+i), k))
-                    return iterator(nodes_+i, this);
+            THORIN_HASH_STATS(HashStats::inc(stats().lookups));
+            for (size_t start = desired_pos(k), i = start; true; i = mod(i+1)) {
+                if (is_invalid(i) || H::eq(key(nodes_+i), k)) {
+                    THORIN_HASH_STATS(stats().probe(mod(i - start) + 1));
+                    return is_invalid(i) ? end() : iterator(nodes_+i, this);
+                }
             }
         }
 
@@ -425,6 +489,10 @@ public:
         capacity_ = std::max(new_capacity, size_t(MinHeapCapacity));
         auto old_nodes = alloc();
         swap(old_nodes, nodes_);
+        THORIN_HASH_STATS(HashStats::inc(stats().rehashes));
+        THORIN_HASH_STATS(HashStats::inc(stats().rehashed, size_));
+        THORIN_HASH_STATS(HashStats::inc(stats().promotions, old_capacity == StackCapacity));
+        THORIN_HASH_STATS(HashStats::max(stats().max_capacity, capacity_));
 
         for (size_t i = 0; i != old_capacity; ++i) {
             auto& old = old_nodes[i];
@@ -489,14 +557,19 @@ private:
         auto& k = key(&n);
 
         auto result = end_ptr();
-        for (size_t i = desired_pos(k), distance = 0; true; i = mod(i+1), ++distance) {
+        THORIN_HASH_STATS(HashStats::inc(stats().lookups));
+        for (size_t start = desired_pos(k), i = start, distance = 0; true; i = mod(i+1), ++distance) {
             if (is_invalid(i)) {
                 ++size_;
                 swap(nodes_[i], n);
                 result = result == end_ptr() ? nodes_+i : result;
+                THORIN_HASH_STATS(stats().probe(mod(result - nodes_ - start) + 1));
+                THORIN_HASH_STATS(HashStats::inc(stats().inserts));
+                THORIN_HASH_STATS(HashStats::max(stats().peak_load, size_*1000_u64/capacity_));
                 debug(i);
                 return std::make_pair(iterator(result, this), true);
             } else if (result == end_ptr() && H::eq(key(nodes_+i), k)) {
+                THORIN_HASH_STATS(stats().probe(mod(i - start) + 1));
                 return std::make_pair(iterator(nodes_+i, this), false);
             } else {
                 size_t cur_distance = probe_distance(i);
@@ -510,6 +583,9 @@ private:
     }
 
 #if THORIN_ENABLE_PROFILING
+    static HashStats& stats() { return hash_stats<Key, T, H>(); }
+#endif
+#if THORIN_ENABLE_PROFILING && THORIN_ENABLE_CHECKS
     void debug(size_t i) {
         if (capacity() >= 32) {
             auto dib = probe_distance(i);
@@ -535,10 +611,14 @@ private:
     //@{ array set
     iterator array_find(const key_type& k) {
         assert(!on_heap());
+        THORIN_HASH_STATS(HashStats::inc(stats().lookups));
         for (auto i = array_.data(), e = array_.data() + size_; i != e; ++i) {
-            if (H::eq(key(i), k))
+            if (H::eq(key(i), k)) {
+                THORIN_HASH_STATS(stats().probe(i - array_.data() + 1));
                 return iterator(i, this);
+            }
         }
+        THORIN_HASH_STATS(stats().probe(size_));
         return end();
     }
 
@@ -554,6 +634,7 @@ private:
         auto i = array_find(key(p));
         if (i == end()) {
             ++size_;
+            THORIN_HASH_STATS(HashStats::inc(stats().inserts));
             return std::make_pair(iterator(p, this), true);
         }
         key(p) = H::sentinel();
@@ -590,6 +671,511 @@ private:
 #endif
 };
 
+//------------------------------------------------------------------------------
+
+/// Detects whether @p H asks to cache its hashes via <tt>static constexpr bool cache_hash = true;</tt> - e.g. because hashing chases pointers or walks a string.
+template<class H, class = void> struct caches_hash : std::false_type {};
+template<class H> struct caches_hash<H, std::void_t<decltype(H::cache_hash)>> : std::bool_constant<H::cache_hash> {};
+
+/**
+ * The control bytes of 16 consecutive slots of a @p SwissTable.
+ * Matching yields a mask with bit @c i set for slot @c i.
+ * The width is the same with and without SSE2 so the layout - and thus the iteration order - of a table does not depend on the instruction set.
+ */
+class Group {
+public:
+    enum : int8_t { Empty = -128, Deleted = -2 };
+    static constexpr size_t Width = 16;
+
+    explicit Group(const int8_t* ctrl) {
+#if THORIN_SSE2
+        ctrl_ = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ctrl));
+#else
+        std::memcpy(ctrl_, ctrl, Width);
+#endif
+    }
+
+    uint32_t match(int8_t h2) const {
+#if THORIN_SSE2
+        return uint32_t(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(h2), ctrl_)));
+#else
+        uint32_t mask = 0;
+        for (size_t i = 0; i != Width; ++i)
+            mask |= uint32_t(ctrl_[i] == h2) << i;
+        return mask;
+#endif
+    }
+
+    uint32_t match_empty() const { return match(Empty); }
+
+    /// Empty and deleted slots - the only ones with the sign bit set.
+    uint32_t match_free() const {
+#if THORIN_SSE2
+        return uint32_t(_mm_movemask_epi8(ctrl_));
+#else
+        uint32_t mask = 0;
+        for (size_t i = 0; i != Width; ++i)
+            mask |= uint32_t(ctrl_[i] < 0) << i;
+        return mask;
+#endif
+    }
+
+    /// Index of the lowest/highest set bit of @p mask which must not be 0.
+    //@{
+    static size_t lowest(uint32_t mask) {
+#if defined(__GNUC__) || defined(__clang__)
+        return __builtin_ctz(mask);
+#elif defined(_MSC_VER)
+        unsigned long i;
+        _BitScanForward(&i, mask);
+        return i;
+#else
+        return bitcount((mask & (~mask + 1_u32)) - 1_u32);
+#endif
+    }
+    static size_t highest(uint32_t mask) {
+#if defined(__GNUC__) || defined(__clang__)
+        return 31 - __builtin_clz(mask);
+#elif defined(_MSC_VER)
+        unsigned long i;
+        _BitScanReverse(&i, mask);
+        return i;
+#else
+        return log2(mask);
+#endif
+    }
+    //@}
+
+private:
+#if THORIN_SSE2
+    __m128i ctrl_;
+#else
+    int8_t ctrl_[Width];
+#endif
+};
+
+/**
+ * Alternative to @p HashTable for @p HashSet and @p HashMap - enabled with the CMake option @c THORIN_SWISS_TABLE.
+ * A control byte per slot holds 7 bits of the hash of a full slot or marks it as empty or deleted.
+ * Lookups compare the control bytes of a whole @p Group at once and only touch slots whose 7 bits match.
+ * If @p H sets @c cache_hash, the full hashes are kept in a separate array so that rehashing never calls @p H::hash and
+ * @p H::eq is only called on a full match.
+ * Erasing marks the slot as deleted; these tombstones are dropped by the next rehash.
+ * @p HashStats::probes counts groups instead of slots for this table.
+ */
+template<class Key, class T, class H, size_t StackCapacity>
+class SwissTable {
+public:
+    enum { MinCapacity = StackCapacity*4 < Group::Width ? Group::Width : StackCapacity*4 };
+    typedef Key key_type;
+    typedef typename std::conditional<std::is_void_v<T>, Key, T>::type mapped_type;
+    typedef typename std::conditional<std::is_void_v<T>, Key, std::pair<Key, T>>::type value_type;
+
+private:
+    static constexpr bool cache_hash = caches_hash<H>::value;
+    static constexpr size_t npos = size_t(-1);
+
+    static key_type& key(value_type* ptr) {
+        if constexpr (std::is_void_v<T>)
+            return *ptr;
+        else
+            return ptr->first;
+    }
+
+    bool is_full(size_t i) const { return ctrl_[i] >= 0; }
+
+public:
+    template<bool is_const>
+    class iterator_base {
+    public:
+        typedef typename SwissTable<Key, T, H, StackCapacity>::value_type value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef typename std::conditional<is_const, const value_type&, value_type&>::type reference;
+        typedef typename std::conditional<is_const, const value_type*, value_type*>::type pointer;
+        typedef std::forward_iterator_tag iterator_category;
+
+        iterator_base(value_type* ptr, const SwissTable* table)
+            : ptr_(ptr)
+            , table_(table)
+#if THORIN_ENABLE_CHECKS
+            , id_(table->id_)
+#endif
+        {}
+
+        iterator_base(const iterator_base<false>& i)
+            : ptr_(i.ptr_)
+            , table_(i.table_)
+#if THORIN_ENABLE_CHECKS
+            , id_(i.id_)
+#endif
+        {}
+
+#if THORIN_ENABLE_CHECKS
+        inline int id() const { return id_; }
+        inline void verify() const { assert(table_->id_ == id_); }
+        inline void verify(iterator_base i) const {
+            assert(table_ == i.table_ && id_ == i.id_);(void)i;
+            verify();
+        }
+#else
+        inline void verify() const {}
+        inline void verify(iterator_base) const {}
+#endif
+
+        iterator_base& operator=(const iterator_base& other) = default;
+        iterator_base& operator++() { verify(); *this = skip(ptr_+1, table_); return *this; }
+        iterator_base operator++(int) { verify(); iterator_base res = *this; ++(*this); return res; }
+        reference operator*() const { verify(); return *ptr_; }
+        pointer operator->() const { verify(); return ptr_; }
+        bool operator==(const iterator_base& other) const { verify(other); return this->ptr_ == other.ptr_; }
+        bool operator!=(const iterator_base& other) const { verify(other); return this->ptr_ != other.ptr_; }
+
+    private:
+        static iterator_base skip(value_type* ptr, const SwissTable* table) {
+            while (ptr != table->end_ptr() && !table->is_full(ptr - table->slots_))
+                ++ptr;
+            return iterator_base(ptr, table);
+        }
+
+        value_type* ptr_;
+        const SwissTable* table_;
+#if THORIN_ENABLE_CHECKS
+        int id_;
+#endif
+        friend class SwissTable;
+    };
+
+    typedef std::size_t size_type;
+    typedef iterator_base<false> iterator;
+    typedef iterator_base<true> const_iterator;
+
+    SwissTable() { THORIN_HASH_STATS(HashStats::inc(stats().tables)); }
+    SwissTable(size_t capacity)
+        : SwissTable()
+    {
+        if (capacity != 0)
+            rehash(capacity);
+    }
+    SwissTable(SwissTable&& other)
+        : SwissTable()
+    {
+        swap(*this, other);
+    }
+    SwissTable(const SwissTable& other)
+        : capacity_(other.capacity_)
+        , size_(other.size_)
+        , growth_left_(other.growth_left_)
+    {
+        THORIN_HASH_STATS(HashStats::inc(stats().tables));
+        THORIN_HASH_STATS(HashStats::inc(stats().promotions, capacity_ != 0));
+        if (capacity_ != 0) {
+            ctrl_  = new int8_t[capacity_ + Group::Width];
+            slots_ = new value_type[capacity_];
+            std::copy_n(other.ctrl_, capacity_ + Group::Width, ctrl_);
+            std::copy_n(other.slots_, capacity_, slots_);
+            if constexpr (cache_hash) {
+                hashes_ = new hash_t[capacity_];
+                std::copy_n(other.hashes_, capacity_, hashes_);
+            }
+        }
+    }
+    template<class InputIt>
+    SwissTable(InputIt first, InputIt last)
+        : SwissTable()
+    {
+        insert(first, last);
+    }
+    SwissTable(std::initializer_list<value_type> ilist)
+        : SwissTable()
+    {
+        insert(ilist);
+    }
+    ~SwissTable() { release(); }
+
+    //@{ getters
+    size_t capacity() const { return capacity_; }
+    size_t size() const { return size_; }
+    bool empty() const { return size() == 0; }
+    /// Memory allocated outside of this object: control bytes, slots, and cached hashes.
+    size_t heap_bytes() const {
+        if (capacity_ == 0) return 0;
+        return capacity_ + Group::Width + capacity_ * sizeof(value_type) + (cache_hash ? capacity_ * sizeof(hash_t) : 0);
+    }
+#if THORIN_ENABLE_CHECKS
+    int id() const { return id_; }
+#endif
+    //@}
+
+    //@{ get begin/end iterators
+    iterator begin() { return iterator::skip(slots_, this); }
+    iterator end() { return iterator(end_ptr(), this); }
+    const_iterator begin() const { return const_iterator(const_cast<SwissTable*>(this)->begin()); }
+    const_iterator end() const { return const_iterator(const_cast<SwissTable*>(this)->end()); }
+    const_iterator cbegin() const { return begin(); }
+    const_iterator cend() const { return end(); }
+    //@}
+
+    //@{ emplace/insert
+    template<class... Args>
+    std::pair<iterator,bool> emplace(Args&&... args) {
+        using std::swap;
+        value_type n(std::forward<Args>(args)...);
+        auto h = hash(key(&n));
+        if (auto i = find_index(key(&n), h); i != npos)
+            return std::make_pair(iterator(slots_+i, this), false);
+
+        auto i = find_free(h);
+        if (growth_left_ == 0 && ctrl_[i] == Group::Empty) {
+            // grow unless most of the used slots are tombstones
+            rehash(size_ >= max_load(capacity_)/2_s ? capacity_*2_s : capacity_);
+            i = find_free(h);
+        }
+
+        growth_left_ -= ctrl_[i] == Group::Empty ? 1 : 0;
+        set_ctrl(i, h2(h));
+        swap(slots_[i], n);
+        if constexpr (cache_hash) hashes_[i] = h;
+        ++size_;
+        THORIN_HASH_STATS(HashStats::inc(stats().inserts));
+        THORIN_HASH_STATS(HashStats::max(stats().peak_load, size_*1000_u64/capacity_));
+#if THORIN_ENABLE_CHECKS
+        ++id_;
+#endif
+        return std::make_pair(iterator(slots_+i, this), true);
+    }
+
+    std::pair<iterator, bool> insert(const value_type& value) { return emplace(value); }
+    std::pair<iterator, bool> insert(value_type&& value) { return emplace(std::move(value)); }
+    void insert(std::initializer_list<value_type> ilist) { insert(ilist.begin(), ilist.end()); }
+
+    template<class R>
+    bool insert_range(const R& range) { return insert(range.begin(), range.end()); }
+
+    template<class I>
+    bool insert(I begin, I end) {
+        size_t s = size() + std::distance(begin, end);
+        if (s > max_load(capacity_)) {
+            size_t c = round_to_power_of_2(s);
+            rehash(max_load(c) < s ? c*2_s : c);
+        }
+
+        bool changed = false;
+        for (auto i = begin; i != end; ++i)
+            changed |= emplace(*i).second;
+        return changed;
+    }
+    //@}
+
+    //@{ erase
+    void erase(const_iterator pos) {
+        pos.verify();
+        assert(pos.table_ == this && "iterator does not match to this table");
+        assert(!empty());
+        size_t i = pos.ptr_ - slots_;
+        assert(pos != end() && is_full(i));
+
+        // a probe stops at the first group with an empty slot;
+        // if no group around i could have been full when i was taken, i can become empty again
+        auto before = Group(ctrl_ + mod(i - Group::Width)).match_empty();
+        auto after  = Group(ctrl_ + i).match_empty();
+        bool was_never_full = before && after && (Group::Width - 1 - Group::highest(before)) + Group::lowest(after) < Group::Width;
+        growth_left_ += was_never_full ? 1 : 0;
+        set_ctrl(i, was_never_full ? Group::Empty : Group::Deleted);
+
+        value_type empty;
+        key(&empty) = H::sentinel();
+        slots_[i] = std::move(empty);
+        --size_;
+#if THORIN_ENABLE_CHECKS
+        ++id_;
+#endif
+    }
+
+    void erase(const_iterator first, const_iterator last) {
+        for (auto i = first; i != last; ++i)
+            erase(i);
+    }
+
+    size_t erase(const key_type& key) {
+        auto i = find(key);
+        if (i == end())
+            return 0;
+        erase(i);
+        return 1;
+    }
+    //@}
+
+    //@{ find
+    DEBUG_UTIL iterator find(const key_type& k) {
+        if (empty())
+            return end();
+        auto i = find_index(k, hash(k));
+        return i == npos ? end() : iterator(slots_+i, this);
+    }
+
+    DEBUG_UTIL const_iterator find(const key_type& key) const {
+        return const_iterator(const_cast<SwissTable*>(this)->find(key).ptr_, this);
+    }
+    //@}
+
+    void clear() {
+        release();
+        ctrl_ = nullptr;
+        slots_ = nullptr;
+        hashes_ = nullptr;
+        capacity_ = size_ = growth_left_ = 0;
+#if THORIN_ENABLE_CHECKS
+        ++id_;
+#endif
+    }
+
+    DEBUG_UTIL size_t count(const key_type& key) const { return find(key) == end() ? 0 : 1; }
+    DEBUG_UTIL bool contains(const key_type& key) const { return count(key) == 1; }
+
+    /// Grows the table to (at least) @p new_capacity slots - more if the elements would not fit - and drops all tombstones.
+    void rehash(size_t new_capacity) {
+        using std::swap;
+
+        new_capacity = std::max(round_to_power_of_2(new_capacity), uint64_t(MinCapacity));
+        while (max_load(new_capacity) < size_)
+            new_capacity *= 2_s;
+
+        auto old_ctrl = ctrl_;
+        auto old_slots = slots_;
+        auto old_hashes = hashes_;
+        auto old_capacity = capacity_;
+        alloc(new_capacity);
+        THORIN_HASH_STATS(HashStats::inc(stats().rehashes));
+        THORIN_HASH_STATS(HashStats::inc(stats().rehashed, size_));
+
+        for (size_t i = 0; i != old_capacity; ++i) {
+            if (old_ctrl[i] < 0) continue;
+            hash_t h;
+            if constexpr (cache_hash)
+                h = old_hashes[i];
+            else
+                h = hash(key(old_slots+i));
+            auto j = find_free(h);
+            set_ctrl(j, h2(h));
+            swap(slots_[j], old_slots[i]);
+            if constexpr (cache_hash) hashes_[j] = h;
+        }
+        growth_left_ -= size_;
+
+        delete[] old_ctrl;
+        delete[] old_slots;
+        delete[] old_hashes;
+#if THORIN_ENABLE_CHECKS
+        ++id_;
+#endif
+    }
+
+    friend void swap(SwissTable& t1, SwissTable& t2) {
+        using std::swap;
+        swap(t1.ctrl_,        t2.ctrl_);
+        swap(t1.slots_,       t2.slots_);
+        swap(t1.hashes_,      t2.hashes_);
+        swap(t1.capacity_,    t2.capacity_);
+        swap(t1.size_,        t2.size_);
+        swap(t1.growth_left_, t2.growth_left_);
+#if THORIN_ENABLE_CHECKS
+        swap(t1.id_,          t2.id_);
+#endif
+    }
+
+    SwissTable& operator=(SwissTable other) { swap(*this, other); return *this; }
+
+private:
+#if THORIN_ENABLE_PROFILING
+    static HashStats& stats() { return hash_stats<Key, T, H>(); }
+#endif
+    static hash_t hash(const key_type& key) { return murmur3(hash_t(H::hash(key))); }
+    static size_t h1(hash_t h) { return h >> 7_u32; }
+    static int8_t h2(hash_t h) { return int8_t(h & 0x7f_u32); }
+    static size_t max_load(size_t capacity) { return capacity - capacity/8_s; }
+    size_t mod(size_t i) const { return i & (capacity_-1); }
+    value_type* end_ptr() const { return slots_ + capacity_; }
+
+    /// The first @p Group::Width control bytes are mirrored behind the last one so that a @p Group never wraps around.
+    void set_ctrl(size_t i, int8_t c) {
+        ctrl_[i] = c;
+        if (i < Group::Width)
+            ctrl_[capacity_ + i] = c;
+    }
+
+    // The groups are visited in quadratic order which covers all of them as their number is a power of 2.
+    // There is always an empty slot as the load factor is at most 7/8, so the probe terminates.
+
+    size_t find_index(const key_type& k, hash_t h) const {
+        if (capacity_ == 0)
+            return npos;
+
+        THORIN_HASH_STATS(HashStats::inc(stats().lookups));
+        for (size_t pos = mod(h1(h)), step = 0; true; step += Group::Width, pos = mod(pos + step)) {
+            Group group(ctrl_ + pos);
+            for (auto mask = group.match(h2(h)); mask != 0; mask &= mask - 1_u32) {
+                auto i = mod(pos + Group::lowest(mask));
+                if ((!cache_hash || hashes_[i] == h) && H::eq(key(slots_+i), k)) {
+                    THORIN_HASH_STATS(stats().probe(step/Group::Width + 1));
+                    return i;
+                }
+            }
+            if (group.match_empty() != 0) {
+                THORIN_HASH_STATS(stats().probe(step/Group::Width + 1));
+                return npos;
+            }
+        }
+    }
+
+    size_t find_free(hash_t h) {
+        if (capacity_ == 0)
+            alloc(MinCapacity);
+
+        for (size_t pos = mod(h1(h)), step = 0; true; step += Group::Width, pos = mod(pos + step)) {
+            if (auto mask = Group(ctrl_ + pos).match_free(); mask != 0)
+                return mod(pos + Group::lowest(mask));
+        }
+    }
+
+    /// Also the first allocation of a table - which is not a rehash - so this is where its promotion to the heap is counted.
+    void alloc(size_t capacity) {
+        assert(is_power_of_2(capacity) && capacity >= Group::Width);
+        THORIN_HASH_STATS(HashStats::inc(stats().promotions, capacity_ == 0));
+        THORIN_HASH_STATS(HashStats::max(stats().max_capacity, capacity));
+        capacity_ = capacity;
+        growth_left_ = max_load(capacity);
+        ctrl_ = new int8_t[capacity + Group::Width];
+        std::fill_n(ctrl_, capacity + Group::Width, int8_t(Group::Empty));
+        slots_ = new value_type[capacity]();
+        hashes_ = cache_hash ? new hash_t[capacity] : nullptr;
+    }
+
+    void release() {
+        delete[] ctrl_;
+        delete[] slots_;
+        delete[] hashes_;
+    }
+
+    int8_t* ctrl_ = nullptr;
+    value_type* slots_ = nullptr;
+    hash_t* hashes_ = nullptr;
+    uint32_t capacity_ = 0;
+    uint32_t size_ = 0;
+    uint32_t growth_left_ = 0;
+#if THORIN_ENABLE_CHECKS
+    int id_ = 0;
+#endif
+};
+
+/// The implementation behind @p HashSet and @p HashMap.
+#if THORIN_ENABLE_SWISS_TABLE
+template<class Key, class T, class H, size_t StackCapacity>
+using Table = SwissTable<Key, T, H, StackCapacity>;
+#else
+template<class Key, class T, class H, size_t StackCapacity>
+using Table = HashTable<Key, T, H, StackCapacity>;
+#endif
+
 }
 
 //------------------------------------------------------------------------------
@@ -599,9 +1185,9 @@ private:
  * We use our own implementation in order to have a consistent and deterministic behavior across different platforms.
  */
 template<class Key, class H = typename Key::Hash, size_t StackCapacity = 4>
-class HashSet : public detail::HashTable<Key, void, H, StackCapacity> {
+class HashSet : public detail::Table<Key, void, H, StackCapacity> {
 public:
-    typedef detail::HashTable<Key, void, H, StackCapacity> Super;
+    typedef detail::Table<Key, void, H, StackCapacity> Super;
     typedef typename Super::key_type key_type;
     typedef typename Super::mapped_type mapped_type;
     typedef typename Super::value_type value_type;
@@ -631,9 +1217,9 @@ public:
  * We use our own implementation in order to have a consistent and deterministic behavior across different platforms.
  */
 template<class Key, class T, class H = typename Key::Hash, size_t StackCapacity = 4>
-class HashMap : public detail::HashTable<Key, T, H, StackCapacity> {
+class HashMap : public detail::Table<Key, T, H, StackCapacity> {
 public:
-    typedef detail::HashTable<Key, T, H, StackCapacity> Super;
+    typedef detail::Table<Key, T, H, StackCapacity> Super;
     typedef typename Super::key_type key_type;
     typedef typename Super::mapped_type mapped_type;
     typedef typename Super::value_type value_type;
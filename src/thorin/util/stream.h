@@ -85,6 +85,7 @@ public:
     {}
 
     std::string str() const { return oss_.str(); }
+    void clear() { oss_.str({}); }
 
     friend void swap(StringStream& a, StringStream& b) {
         using std::swap;
@@ -1,23 +1,99 @@
 #include "thorin/util/symbol.h"
 
 #include <iomanip>
+#include <mutex>
+#include <shared_mutex>
 #include <sstream>
 
 namespace thorin {
 
-Symbol::Table Symbol::table_;
-
 #ifdef _MSC_VER
 static const char* duplicate(const char* s) { return _strdup(s); }
 #else // _MSC_VER
 static const char* duplicate(const char* s) { return strdup(s); }
 #endif // _MSC_VER
 
+namespace {
+
+/// An interned string together with its hash so that neither the table nor the thread caches ever hash a string twice.
+struct Entry {
+    const char* str;
+    hash_t hash;
+
+    /// Only used by the table to spot its sentinel - @p EntryHash::eq compares the contents.
+    bool operator==(Entry other) const { return str == other.str; }
+};
+
+struct EntryHash {
+    static hash_t hash(Entry e) { return e.hash; }
+    static bool eq(Entry e1, Entry e2) { return e1.hash == e2.hash && std::strcmp(e1.str, e2.str) == 0; }
+    static Entry sentinel() { return { (const char*)(1), 0 }; }
+};
+
+class Table {
+public:
+    static constexpr size_t NumShards = 16;
+
+    ~Table() {
+        for (auto& shard : shards_) {
+            for (auto e : shard.set)
+                free((void*) const_cast<char*>(e.str));
+        }
+    }
+
+    const char* insert(Entry key) {
+        // the top bits pick the shard; the HashSet inside uses the low bits
+        auto& shard = shards_[key.hash >> (sizeof(hash_t) * 8 - 4)];
+        {
+            std::shared_lock<std::shared_mutex> lock(shard.mutex);
+            auto i = shard.set.find(key);
+            if (i != shard.set.end())
+                return i->str;
+        }
+
+        std::unique_lock<std::shared_mutex> lock(shard.mutex);
+        auto i = shard.set.find(key); // someone else might have been faster
+        if (i == shard.set.end())
+            i = shard.set.emplace(Entry { duplicate(key.str), key.hash }).first;
+        return i->str;
+    }
+
+private:
+    struct Shard {
+        std::shared_mutex mutex;
+        HashSet<Entry, EntryHash> set;
+    };
+
+    Shard shards_[NumShards];
+};
+
+static_assert(Table::NumShards == 1 << 4, "shard index uses the top 4 bits of the hash");
+
+/// Function-local so that @p Symbol%s of other static objects can be created before @c main.
+Table& table() {
+    static Table table;
+    return table;
+}
+
+/// Direct-mapped cache of the last @p Symbol%s interned by this thread.
+struct Cache {
+    static constexpr size_t Size = 256;
+    Entry entries[Size] = {};
+};
+
+}
+
 void Symbol::insert(const char* s) {
-    auto i = table_.map.find(s);
-    if (i == table_.map.end())
-        i = table_.map.emplace(duplicate(s)).first;
-    str_ = *i;
+    Entry key { s, thorin::hash(s) };
+    thread_local Cache cache;
+    auto& entry = cache.entries[key.hash & (Cache::Size - 1)];
+    if (entry.str != nullptr && EntryHash::eq(entry, key)) {
+        str_ = entry.str;
+        return;
+    }
+
+    str_ = table().insert(key);
+    entry = { str_, key.hash };
 }
 
 std::string Symbol::remove_quotation() const {
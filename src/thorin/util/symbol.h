@@ -1,15 +1,23 @@
 #ifndef THORIN_UTIL_SYMBOL_H
 #define THORIN_UTIL_SYMBOL_H
 
+#include <cstring>
 #include <string>
 
 #include "thorin/util/hash.h"
 
 namespace thorin {
 
+/**
+ * An interned string - two @p Symbol%s are equal iff their @p c_str%s are the same pointer.
+ * The intern table is sharded and each shard is guarded by a reader/writer lock;
+ * on top of that each thread caches its recent lookups, so re-interning a hot name neither locks nor probes the table.
+ * Hence, @p Symbol%s may be created from several threads at the same time.
+ */
 class Symbol {
 public:
     struct Hash {
+        static constexpr bool cache_hash = true;
         static hash_t hash(Symbol s) { return thorin::hash(s.c_str()); }
         static bool eq(Symbol s1, Symbol s2) { return s1 == s2; }
         static Symbol sentinel() { return Symbol(/*dummy*/23); }
@@ -21,11 +29,15 @@ public:
 
     const char* c_str() const { return str_; }
     std::string str() const { return str_; }
-    operator bool() const { return *this != Symbol(""); }
+    operator bool() const { return !empty(); }
     bool operator==(Symbol symbol) const { return c_str() == symbol.c_str(); }
     bool operator!=(Symbol symbol) const { return c_str() != symbol.c_str(); }
-    bool operator==(const char* s) const { return c_str() == Symbol(s).c_str(); }
-    bool operator!=(const char* s) const { return c_str() != Symbol(s).c_str(); }
+    /// @name comparison with literals
+    /// These compare the characters directly instead of interning @p s first.
+    //@{
+    bool operator==(const char* s) const { return std::strcmp(c_str(), s) == 0; }
+    bool operator!=(const char* s) const { return std::strcmp(c_str(), s) != 0; }
+    //@}
     bool empty() const { return *str_ == '\0'; }
     bool is_anonymous() { return (*this) == "_"; }
     std::string remove_quotation() const;
@@ -35,19 +47,9 @@ private:
         : str_((const char*)(1))
     {}
 
-    struct Table {
-        ~Table() {
-            for (auto s : map)
-                free((void*) const_cast<char*>(s));
-        }
-
-        HashSet<const char*, StrHash> map;
-    };
-
     void insert(const char* str);
 
     const char* str_;
-    static Table table_;
 };
 
 inline Symbol operator+(Symbol s1, Symbol s2) { return std::string(s1.c_str()) + s2.str(); }
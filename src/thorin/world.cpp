@@ -9,12 +9,16 @@
 #include <unistd.h>
 #endif
 
+#include <algorithm>
+#include <atomic>
 #include <cmath>
+#include <iomanip>
 
 #include "thorin/def.h"
 #include "thorin/primop.h"
 #include "thorin/continuation.h"
 #include "thorin/type.h"
+#include "thorin/analyses/footprint.h"
 #include "thorin/analyses/scope.h"
 #include "thorin/analyses/verify.h"
 #include "thorin/transform/cleanup_world.h"
@@ -26,8 +30,10 @@
 #include "thorin/transform/hoist_enters.h"
 #include "thorin/transform/inliner.h"
 #include "thorin/transform/lift_builtins.h"
+#include "thorin/transform/loop_opt.h"
 #include "thorin/transform/partial_evaluation.h"
 #include "thorin/transform/split_slots.h"
+#include "thorin/transform/vectorize.h"
 #include "thorin/util/array.h"
 
 #if (defined(__clang__) || defined(__GNUC__)) && (defined(__x86_64__) || defined(__i386__))
@@ -42,14 +48,26 @@ namespace thorin {
  * constructor and destructor
  */
 
+#if THORIN_ENABLE_PROFILING
+/// The hash table statistics are reported when the last @p World is gone.
+static std::atomic<int> num_worlds = 0;
+#endif
+
 World::World(const std::string& name) {
     data_.name_   = name;
     data_.branch_ = continuation(fn_type({type_bool(), fn_type(), fn_type()}), Intrinsic::Branch, {"br"});
     data_.end_scope_ = continuation(fn_type(), Intrinsic::EndScope, {"end_scope"});
+#if THORIN_ENABLE_PROFILING
+    ++num_worlds;
+#endif
 }
 
 World::~World() {
     for (auto def : data_.defs_) delete def;
+#if THORIN_ENABLE_PROFILING
+    if (--num_worlds == 0)
+        hash_stats_report(std::cerr);
+#endif
 }
 
 const Def* World::variant_index(const Def* value, Debug dbg) {
@@ -93,6 +111,11 @@ const Def* World::allset(PrimTypeTag tag, Debug dbg, size_t length) {
  * arithops
  */
 
+/// Only fold operations on @p Vector%s lane by lane if all lanes are known - otherwise this would undo vectorization.
+static bool is_const_vector(const Vector* vec) {
+    return vec && std::all_of(vec->ops().begin(), vec->ops().end(), [] (const Def* op) { return op->isa<PrimLit>(); });
+}
+
 const Def* World::binop(int tag, const Def* lhs, const Def* rhs, Debug dbg) {
     if (is_arithop(tag))
         return arithop((ArithOpTag) tag, lhs, rhs, dbg);
@@ -111,7 +134,7 @@ const Def* World::arithop(ArithOpTag tag, const Def* a, const Def* b, Debug dbg)
     auto lvec = a->isa<Vector>();
     auto rvec = b->isa<Vector>();
 
-    if (lvec && rvec) {
+    if (is_const_vector(lvec) && is_const_vector(rvec)) {
         size_t num = lvec->type()->as<PrimType>()->length();
         Array<const Def*> ops(num);
         for (size_t i = 0; i != num; ++i)
@@ -431,7 +454,7 @@ const Def* World::cmp(CmpTag tag, const Def* a, const Def* b, Debug dbg) {
     auto lvec = a->isa<Vector>();
     auto rvec = b->isa<Vector>();
 
-    if (lvec && rvec) {
+    if (is_const_vector(lvec) && is_const_vector(rvec)) {
         size_t num = lvec->type()->as<PrimType>()->length();
         Array<const Def*> ops(num);
         for (size_t i = 0; i != num; ++i)
@@ -1178,6 +1201,12 @@ const App* World::app(const Def* callee, const Defs args, Debug dbg) {
  * misc
  */
 
+const Array<const Def*> World::copy_defs() const {
+    Array<const Def*> result(data_.defs_.begin(), data_.defs_.end());
+    std::sort(result.begin(), result.end(), GIDLt<const Def*>());
+    return result;
+}
+
 std::vector<Continuation*> World::copy_continuations() const {
     std::vector<Continuation*> result;
 
@@ -1186,6 +1215,7 @@ std::vector<Continuation*> World::copy_continuations() const {
             result.emplace_back(lam);
     }
 
+    std::sort(result.begin(), result.end(), GIDLt<Continuation*>());
     return result;
 }
 #if THORIN_ENABLE_CHECKS
@@ -1214,6 +1244,31 @@ const char* World::level2string(LogLevel level) {
     THORIN_UNREACHABLE;
 }
 
+std::string World::quote_json(const std::string& str) {
+    std::ostringstream oss;
+    oss << '"';
+    for (unsigned char c : str) {
+        switch (c) {
+            case '"':  oss << "\\\""; break;
+            case '\\': oss << "\\\\"; break;
+            case '\n': oss << "\\n"; break;
+            case '\t': oss << "\\t"; break;
+            default:
+                if (c < 0x20)
+                    oss << "\\u" << std::hex << std::setw(4) << std::setfill('0') << int(c) << std::dec;
+                else
+                    oss << c;
+        }
+    }
+    oss << '"';
+    return oss.str();
+}
+
+void World::emit_json(LogLevel level, const Loc& loc, const std::string& msg) {
+    static const char* names[] = { "debug", "verbose", "info", "warn", "error" };
+    stream().ostream() << "{\"level\":\"" << names[int(level)] << "\",\"loc\":" << quote_json(loc.to_string()) << ",\"msg\":" << quote_json(msg) << '}' << std::endl;
+}
+
 int World::level2color(LogLevel level) {
     switch (level) {
         case LogLevel::Error:   return 1;
@@ -1284,6 +1339,10 @@ void World::opt() {
     VLOG("running pass {}", #pass); \
     pass; \
     debug_verify(*this); \
+    if (auto& stream = state_.footprint_stream) { \
+        stream->fmt("{{\"pass\":\"{}\",\"footprint\":", #pass); \
+        footprint(*this).stream(*stream).fmt("}}").endl().flush(); \
+    } \
 }
 
     RUN_PASS(cleanup())
@@ -1293,7 +1352,11 @@ void World::opt() {
     RUN_PASS(split_slots(*this))
     RUN_PASS(closure_conversion(*this))
     RUN_PASS(lift_builtins(*this))
+#if !THORIN_ENABLE_RV
+    RUN_PASS(vectorize(*this))
+#endif
     RUN_PASS(inliner(*this))
+    RUN_PASS(loop_opt(*this))
     RUN_PASS(hoist_enters(*this))
     RUN_PASS(dead_load_opt(*this))
     RUN_PASS(cleanup())
@@ -1,15 +1,21 @@
 #ifndef THORIN_WORLD_H
 #define THORIN_WORLD_H
 
+#include <atomic>
 #include <cassert>
 #include <iostream>
 #include <functional>
 #include <initializer_list>
+#include <map>
+#include <sstream>
 #include <string>
 
 #include "thorin/enums.h"
 #include "thorin/continuation.h"
 #include "thorin/primop.h"
+#include "thorin/analyses/callgraph.h"
+#include "thorin/analyses/verify.h"
+#include "thorin/transform/flatten_options.h"
 #include "thorin/util/hash.h"
 #include "thorin/util/stream.h"
 #include "thorin/config.h"
@@ -17,6 +23,17 @@
 namespace thorin {
 
 enum class LogLevel { Debug, Verbose, Info, Warn, Error };
+/// @p Text is meant for humans; @p JSON writes one object per line with the fields @c level, @c loc, and @c msg.
+enum class LogFormat { Text, JSON };
+
+/// Log calls below this @p LogLevel are compiled out - e.g. pass <tt>-DTHORIN_MIN_LOG_LEVEL=3</tt> to keep only warnings and errors.
+#ifndef THORIN_MIN_LOG_LEVEL
+#ifdef NDEBUG
+#define THORIN_MIN_LOG_LEVEL 1
+#else
+#define THORIN_MIN_LOG_LEVEL 0
+#endif
+#endif
 
 /**
  * The World represents the whole program and manages creation and destruction of Thorin nodes.
@@ -46,6 +63,7 @@ enum class LogLevel { Debug, Verbose, Info, Warn, Error };
 class World : public TypeTable, public Streamable<World> {
 public:
     struct SeaHash {
+        static constexpr bool cache_hash = true;
         static hash_t hash(const Def* def) { return def->hash(); }
         static bool eq(const Def* d1, const Def* d2) { return d1->equal(d2); }
         static const Def* sentinel() { return (const Def*)(1); }
@@ -57,15 +75,10 @@ public:
         static size_t sentinel() { return size_t(-1); }
     };
 
-    struct ExternalsHash {
-        static hash_t hash(const std::string& s) { return thorin::hash(s.c_str()); }
-        static bool eq(const std::string& s1, const std::string& s2) { return s1 == s2; }
-        static std::string sentinel() { return std::string(); }
-    };
-
     using Sea         = HashSet<const Def*, SeaHash>;///< This @p HashSet contains Thorin's "sea of nodes".
     using Breakpoints = HashSet<size_t, BreakHash>;
-    using Externals   = HashMap<std::string, Continuation*, ExternalsHash>;
+    /// Ordered by name: passes and backends start their walks here, which makes the order they visit everything in reproducible.
+    using Externals   = std::map<std::string, Continuation*>;
 
     World(World&&) = delete;
     World& operator=(const World&) = delete;
@@ -92,8 +105,8 @@ public:
     const Externals& externals() const { return data_.externals_; }
     void make_external(Continuation* cont) { data_.externals_.emplace(cont->unique_name(), cont); }
     void make_internal(Continuation* cont) { data_.externals_.erase(cont->unique_name()); }
-    bool is_external(const Continuation* cont) { return data_.externals_.contains(cont->unique_name()); }
-    Continuation* lookup(const std::string& name) { return data_.externals_.lookup(name).value_or(nullptr); }
+    bool is_external(const Continuation* cont) { return data_.externals_.count(cont->unique_name()) != 0; }
+    Continuation* lookup(const std::string& name) { auto i = data_.externals_.find(name); return i != data_.externals_.end() ? i->second : nullptr; }
     //@}
 
     // literals
@@ -253,13 +266,21 @@ public:
 
     const std::string& name() const { return data_.name_; }
     const Sea& defs() const { return data_.defs_; }
-    const Array<const Def*> copy_defs() const { return Array<const Def*>(data_.defs_.begin(), data_.defs_.end()); }
+    CallGraph& call_graph() { return data_.call_graph_; }
+    /// Sorted by gid so that passes walking them create new @p Def%s in a reproducible order.
+    const Array<const Def*> copy_defs() const;
     std::vector<Continuation*> copy_continuations() const; // TODO remove this
 
     /// @name partial evaluation done?
     //@{
     void mark_pe_done(bool flag = true) { state_.pe_done = flag; }
     bool is_pe_done() const { return state_.pe_done; }
+    /// Used by @p debug_verify after each pass.
+    const VerifyOptions& verify_options() const { return state_.verify_options; }
+    void set(const VerifyOptions& verify_options) { state_.verify_options = verify_options; }
+    /// Used by @p flatten_tuples.
+    const FlattenOptions& flatten_options() const { return state_.flatten_options; }
+    void set(const FlattenOptions& flatten_options) { state_.flatten_options = flatten_options; }
     //@}
 
 #if THORIN_ENABLE_CHECKS
@@ -280,16 +301,39 @@ public:
     /// Writes to a file named @c name().
     DEBUG_UTIL void write() const { Streamable<World>::write(name()); }
     LogLevel min_level() const { return state_.min_level; }
+    LogFormat log_format() const { return state_.log_format; }
+    bool is_logged(LogLevel level) const { return int(level) >= THORIN_MIN_LOG_LEVEL && stream_ && int(min_level()) <= int(level); }
 
     void set(LogLevel min_level) { state_.min_level = min_level; }
+    void set(LogFormat log_format) { state_.log_format = log_format; }
     void set(std::shared_ptr<Stream> stream) { stream_ = stream; }
+    /// After each pass of @p opt, writes the name of the pass and the @p footprint of the @p World as one JSON line to @p stream.
+    void set_footprint_stream(std::shared_ptr<Stream> stream) { state_.footprint_stream = stream; }
 
     template<class... Args>
     void log(LogLevel level, Loc loc, const char* fmt, Args&&... args) {
-        if (stream_ && int(min_level()) <= int(level)) {
-            stream().fmt("{}:{}: ", colorize(level2string(level), level2color(level)), colorize(loc.to_string(), 7));
-            stream().fmt(fmt, std::forward<Args&&>(args)...).endl().flush();
+        if (is_logged(level))
+            emit(level, loc, [&] (Stream& s) -> Stream& { return s.fmt(fmt, std::forward<Args&&>(args)...); });
+    }
+
+    /**
+     * Used by the @c *LOG macros: @p print only runs - and hence the arguments of the message are only evaluated - if @p level is logged.
+     * A call site which passes a @p limit emits at most @p limit messages during the whole run;
+     * the type of @p print - a fresh lambda for each use of a macro - identifies the call site.
+     */
+    template<class F>
+    void log(LogLevel level, const char* file, u32 line, F&& print, size_t limit = size_t(-1)) {
+        if (!is_logged(level)) return;
+        Loc loc(file, {line, u32(-1)}, {line, u32(-1)});
+        if (limit != size_t(-1)) {
+            static std::atomic<size_t> num = 0;
+            auto n = num++;
+            if (n == limit)
+                emit(level, loc, [&] (Stream& s) -> Stream& { return s.fmt("further messages from here are suppressed"); });
+            if (n >= limit)
+                return;
         }
+        emit(level, loc, print);
     }
 
     template<class... Args>
@@ -308,6 +352,25 @@ public:
     static const char* level2string(LogLevel level);
     static int level2color(LogLevel level);
     static std::string colorize(const std::string& str, int color);
+    /// @p str as a JSON string literal, including the quotes.
+    static std::string quote_json(const std::string& str);
+
+private:
+    template<class F>
+    void emit(LogLevel level, const Loc& loc, F&& print) {
+        if (log_format() == LogFormat::JSON) {
+            std::ostringstream oss;
+            Stream s(oss);
+            print(s);
+            emit_json(level, loc, oss.str());
+        } else {
+            stream().fmt("{}:{}: ", colorize(level2string(level), level2color(level)), colorize(loc.to_string(), 7));
+            print(stream()).endl().flush();
+        }
+    }
+    void emit_json(LogLevel level, const Loc& loc, const std::string& msg);
+
+public:
     //@}
 
     friend void swap(World& w1, World& w2) {
@@ -344,8 +407,12 @@ private:
 
     struct State {
         LogLevel min_level = LogLevel::Error;
+        LogFormat log_format = LogFormat::Text;
         u32 cur_gid = 0;
         bool pe_done = false;
+        VerifyOptions verify_options;
+        FlattenOptions flatten_options;
+        std::shared_ptr<Stream> footprint_stream;
 #if THORIN_ENABLE_CHECKS
         bool track_history = false;
         Breakpoints breakpoints;
@@ -359,6 +426,7 @@ private:
         Sea defs_;
         Continuation* branch_;
         Continuation* end_scope_;
+        CallGraph call_graph_;
     } data_;
 
     std::shared_ptr<Stream> stream_;
@@ -369,18 +437,25 @@ private:
     friend class Filter;
     friend class App;
     friend class Importer;
+    friend class BinaryReader;
 };
 
 }
 
-#define ELOG(...) log(thorin::LogLevel::Error,   thorin::Loc(__FILE__, {__LINE__, thorin::u32(-1)}, {__LINE__, thorin::u32(-1)}), __VA_ARGS__)
-#define WLOG(...) log(thorin::LogLevel::Warn,    thorin::Loc(__FILE__, {__LINE__, thorin::u32(-1)}, {__LINE__, thorin::u32(-1)}), __VA_ARGS__)
-#define ILOG(...) log(thorin::LogLevel::Info,    thorin::Loc(__FILE__, {__LINE__, thorin::u32(-1)}, {__LINE__, thorin::u32(-1)}), __VA_ARGS__)
-#define VLOG(...) log(thorin::LogLevel::Verbose, thorin::Loc(__FILE__, {__LINE__, thorin::u32(-1)}, {__LINE__, thorin::u32(-1)}), __VA_ARGS__)
-#ifndef NDEBUG
-#define DLOG(...) log(thorin::LogLevel::Debug,   thorin::Loc(__FILE__, {__LINE__, thorin::u32(-1)}, {__LINE__, thorin::u32(-1)}), __VA_ARGS__)
-#else
-#define DLOG(...) ignore()
-#endif
+/// @name logging
+/// Use as <tt>world.VLOG("...", args...)</tt>; the arguments are only evaluated if the @p LogLevel is logged.
+/// The @c _N variants emit at most @c n messages per call site, e.g. inside a loop over all nodes.
+//@{
+#define THORIN_LOG(level, limit, ...) log(level, __FILE__, __LINE__, [&] (thorin::Stream& log_stream_) -> thorin::Stream& { return log_stream_.fmt(__VA_ARGS__); }, limit)
+#define ELOG(...)      THORIN_LOG(thorin::LogLevel::Error,   size_t(-1), __VA_ARGS__)
+#define WLOG(...)      THORIN_LOG(thorin::LogLevel::Warn,    size_t(-1), __VA_ARGS__)
+#define ILOG(...)      THORIN_LOG(thorin::LogLevel::Info,    size_t(-1), __VA_ARGS__)
+#define VLOG(...)      THORIN_LOG(thorin::LogLevel::Verbose, size_t(-1), __VA_ARGS__)
+#define DLOG(...)      THORIN_LOG(thorin::LogLevel::Debug,   size_t(-1), __VA_ARGS__)
+#define WLOG_N(n, ...) THORIN_LOG(thorin::LogLevel::Warn,    size_t(n),  __VA_ARGS__)
+#define ILOG_N(n, ...) THORIN_LOG(thorin::LogLevel::Info,    size_t(n),  __VA_ARGS__)
+#define VLOG_N(n, ...) THORIN_LOG(thorin::LogLevel::Verbose, size_t(n),  __VA_ARGS__)
+#define DLOG_N(n, ...) THORIN_LOG(thorin::LogLevel::Debug,   size_t(n),  __VA_ARGS__)
+//@}
 
 #endif